@@ -0,0 +1,551 @@
+/**
+ * Keeps the single instance of the release counters, and reads the
+ * statistics from whichever allocator the build uses. Release builds with
+ * SNEK_ALLOC_PROFILE also keep the per call site allocation profile here,
+ * and builds with SNEK_GUARD_PAGES the guard page allocator.
+ * \file allocator.c
+ * \author hexadec
+ * \brief This file contains the allocator statistics, the allocation profiler and the guard page allocator
+ */
+
+#define SNEK_ALLOCATOR_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "allocator.h"
+
+#ifdef SNEK_DEBUGMALLOC
+
+void getAllocatorStats(AllocatorStats * stats) {
+    DebugmallocStats merged;
+    debugmalloc_stats(&merged);
+    stats->live_bytes = merged.alloc_bytes;
+    stats->peak_bytes = merged.max_alloc_bytes;
+    stats->live_count = merged.alloc_count;
+    stats->total_count = merged.all_alloc_count;
+}
+
+void getAllocatorThreadCounts(AllocatorThreadCounts * counts) {
+    DebugmallocThreadStats * own = debugmalloc_thread_stats();
+    counts->allocations = own->all_alloc_count;
+    counts->frees = own->all_free_count;
+}
+
+#else
+
+AllocatorStats allocator_counters = {0, 0, 0, 0};
+
+__thread AllocatorThreadCounts allocator_thread_counts = {0, 0};
+
+void getAllocatorStats(AllocatorStats * stats) {
+    stats->live_bytes = __atomic_load_n(&allocator_counters.live_bytes, __ATOMIC_RELAXED);
+    stats->peak_bytes = __atomic_load_n(&allocator_counters.peak_bytes, __ATOMIC_RELAXED);
+    stats->live_count = __atomic_load_n(&allocator_counters.live_count, __ATOMIC_RELAXED);
+    stats->total_count = __atomic_load_n(&allocator_counters.total_count, __ATOMIC_RELAXED);
+}
+
+void getAllocatorThreadCounts(AllocatorThreadCounts * counts) {
+    *counts = allocator_thread_counts;
+}
+
+#ifdef SNEK_ALLOC_PROFILE
+
+/** @brief Number of call sites the profile can hold (power of two) */
+#define PROFILE_SITES 4096
+
+/** @brief Number of independently locked tables of sampled blocks (power of two) */
+#define PROFILE_SHARDS 64
+
+/** @brief Initial number of slots in a table of sampled blocks */
+#define PROFILE_SHARD_CAPACITY 64
+
+/**
+ * @brief Aggregated profile of a call site, counters are updated atomically
+ */
+typedef struct ProfileSite {
+    /** @brief Source file of the call site, \p NULL for unused sites */
+    const char * file;
+    /** @brief Line of the call site */
+    unsigned line;
+    /** @brief Number of sampled allocations */
+    long long allocations;
+    /** @brief Requested bytes of the sampled allocations */
+    long long bytes;
+    /** @brief Number of sampled blocks freed */
+    long long frees;
+    /** @brief Total lifetime of the freed sampled blocks in nanoseconds */
+    long long lifetime_ns;
+    /** @brief Longest lifetime of a freed sampled block in nanoseconds */
+    long long max_lifetime_ns;
+} ProfileSite;
+
+/**
+ * @brief Sampled block that has not been freed yet
+ */
+typedef struct SampledBlock {
+    /** @brief Address of the block, \p NULL for unused slots */
+    void * memory;
+    /** @brief Call site that allocated the block */
+    ProfileSite * site;
+    /** @brief Time of the allocation in nanoseconds */
+    long long allocated_ns;
+} SampledBlock;
+
+/**
+ * @brief Open addressing table of sampled blocks, one of \p PROFILE_SHARDS
+ */
+typedef struct SampledShard {
+    /** @brief Protects the table */
+    pthread_mutex_t lock;
+    /** @brief Slots of the table */
+    SampledBlock * blocks;
+    /** @brief Number of slots in \p blocks (power of two, 0 until first used) */
+    size_t capacity;
+    /** @brief Number of used slots in \p blocks */
+    size_t count;
+} SampledShard;
+
+/**
+ * @brief Reads the profiling configuration from the environment, called once
+ */
+static void startProfiling();
+
+/**
+ * @brief Writes the CSV report of the profile, registered with \p atexit
+ */
+static void writeProfileReport();
+
+/**
+ * @brief Finds the profile of a call site, adding it if needed
+ * @param file source file of the call site
+ * @param line line of the call site
+ * @return the profile of the call site, \p NULL if the profile is full
+ */
+static ProfileSite * findSite(const char * file, unsigned line);
+
+/**
+ * @brief Hash of an address, shard and slot are taken from different bits
+ * @param memory address to hash
+ * @return hash value
+ */
+static uint64_t hashAddress(const void * memory);
+
+/**
+ * @brief Returns the home slot of a sampled block, from bits below the shard bits
+ * @param shard shard of the block
+ * @param memory address of the block
+ * @return index of the slot
+ */
+static size_t homeSlot(const SampledShard * shard, const void * memory);
+
+/**
+ * @brief Finds the slot of a sampled block, or the empty slot where it belongs
+ * @param shard shard of the block, locked
+ * @param memory address of the block
+ * @return index of the slot
+ */
+static size_t findSampledSlot(const SampledShard * shard, const void * memory);
+
+/**
+ * @brief Doubles the table of a shard
+ * @param shard shard to grow, locked
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool growShard(SampledShard * shard);
+
+/**
+ * @brief Compares sites for the report, in the order selected by SNEK_ALLOC_PROFILE_SORT
+ * @param first first site
+ * @param second second site
+ * @return negative if \p first comes first, positive if \p second comes first
+ */
+static int compareSites(const void * first, const void * second);
+
+/**
+ * @brief Returns the current time of the monotonic clock
+ * @return time in nanoseconds
+ */
+static long long currentTime();
+
+/** @brief Ensures the configuration is read once */
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+
+/** @brief Whether profiling is enabled */
+static bool profiling = false;
+
+/** @brief Path of the report */
+static const char * report_path = NULL;
+
+/** @brief Report order: 0 by bytes, 1 by allocations, 2 by average lifetime */
+static int report_order = 0;
+
+/** @brief One in this many allocations of a thread is sampled */
+static unsigned sample_rate = 1;
+
+/** @brief Allocations of the thread to skip before the next sample */
+static __thread unsigned sample_countdown = 0;
+
+/** @brief Number of sampled blocks not freed yet, frees are not looked up while 0 */
+static long sampled_live = 0;
+
+/** @brief Profiles of the call sites, claimed under \p sites_lock */
+static ProfileSite sites[PROFILE_SITES];
+
+/** @brief Serializes claiming call sites */
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Sampled blocks that have not been freed, sharded by address */
+static SampledShard shards[PROFILE_SHARDS];
+
+static void startProfiling() {
+    report_path = getenv("SNEK_ALLOC_PROFILE");
+    if (report_path == NULL || report_path[0] == '\0')
+        return;
+    const char * rate = getenv("SNEK_ALLOC_SAMPLE");
+    if (rate != NULL && atoi(rate) > 0)
+        sample_rate = (unsigned) atoi(rate);
+    const char * order = getenv("SNEK_ALLOC_PROFILE_SORT");
+    if (order != NULL && strcmp(order, "count") == 0)
+        report_order = 1;
+    else if (order != NULL && strcmp(order, "lifetime") == 0)
+        report_order = 2;
+    for (int i = 0; i < PROFILE_SHARDS; i++)
+        pthread_mutex_init(&shards[i].lock, NULL);
+    atexit(writeProfileReport);
+    profiling = true;
+}
+
+void profileAllocation(void * memory, size_t size, const char * file, unsigned line) {
+    pthread_once(&profile_once, startProfiling);
+    if (!profiling || memory == NULL)
+        return;
+    if (sample_countdown > 0) {
+        sample_countdown--;
+        return;
+    }
+    sample_countdown = sample_rate - 1;
+    ProfileSite * site = findSite(file, line);
+    if (site == NULL)
+        return;
+    __atomic_add_fetch(&site->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->bytes, (long long) size, __ATOMIC_RELAXED);
+    SampledShard * shard = &shards[hashAddress(memory) >> 58 & (PROFILE_SHARDS - 1)];
+    pthread_mutex_lock(&shard->lock);
+    // Keep the table at most half full, a block that does not fit only loses its lifetime
+    if ((shard->count + 1) * 2 > shard->capacity && !growShard(shard)) {
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+    shard->blocks[findSampledSlot(shard, memory)] = (SampledBlock) {memory, site, currentTime()};
+    shard->count++;
+    pthread_mutex_unlock(&shard->lock);
+    __atomic_add_fetch(&sampled_live, 1, __ATOMIC_RELAXED);
+}
+
+void profileFree(void * memory) {
+    if (memory == NULL || __atomic_load_n(&sampled_live, __ATOMIC_RELAXED) == 0)
+        return;
+    SampledShard * shard = &shards[hashAddress(memory) >> 58 & (PROFILE_SHARDS - 1)];
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count == 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+    size_t mask = shard->capacity - 1;
+    size_t hole = findSampledSlot(shard, memory);
+    SampledBlock block = shard->blocks[hole];
+    if (block.memory == NULL) {
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+    // Shift the rest of the probe sequence back, so no tombstones are needed
+    for (size_t index = (hole + 1) & mask; shard->blocks[index].memory != NULL; index = (index + 1) & mask) {
+        size_t home = homeSlot(shard, shard->blocks[index].memory);
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            shard->blocks[hole] = shard->blocks[index];
+            hole = index;
+        }
+    }
+    shard->blocks[hole].memory = NULL;
+    shard->count--;
+    pthread_mutex_unlock(&shard->lock);
+    __atomic_sub_fetch(&sampled_live, 1, __ATOMIC_RELAXED);
+    long long lifetime = currentTime() - block.allocated_ns;
+    __atomic_add_fetch(&block.site->frees, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&block.site->lifetime_ns, lifetime, __ATOMIC_RELAXED);
+    long long longest = __atomic_load_n(&block.site->max_lifetime_ns, __ATOMIC_RELAXED);
+    while (lifetime > longest && !__atomic_compare_exchange_n(&block.site->max_lifetime_ns, &longest, lifetime, true,
+                                                              __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static ProfileSite * findSite(const char * file, unsigned line) {
+    size_t index = (size_t) (hashAddress(file) ^ line * 0x9E3779B97F4A7C15ULL) >> 52 & (PROFILE_SITES - 1);
+    for (int probe = 0; probe < PROFILE_SITES; probe++, index = (index + 1) & (PROFILE_SITES - 1)) {
+        ProfileSite * site = &sites[index];
+        const char * site_file = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+        if (site_file == NULL) {
+            pthread_mutex_lock(&sites_lock);
+            // Claimed by another thread meanwhile, it may be the same call site
+            if (site->file == NULL) {
+                site->line = line;
+                __atomic_store_n(&site->file, file, __ATOMIC_RELEASE);
+            }
+            site_file = site->file;
+            pthread_mutex_unlock(&sites_lock);
+        }
+        if (site_file == file && site->line == line)
+            return site;
+    }
+    return NULL;
+}
+
+static uint64_t hashAddress(const void * memory) {
+    return ((uint64_t) (uintptr_t) memory >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static size_t homeSlot(const SampledShard * shard, const void * memory) {
+    return (size_t) (hashAddress(memory) >> 26) & (shard->capacity - 1);
+}
+
+static size_t findSampledSlot(const SampledShard * shard, const void * memory) {
+    size_t mask = shard->capacity - 1;
+    size_t index = homeSlot(shard, memory);
+    while (shard->blocks[index].memory != NULL && shard->blocks[index].memory != memory)
+        index = (index + 1) & mask;
+    return index;
+}
+
+static bool growShard(SampledShard * shard) {
+    size_t capacity = shard->capacity == 0 ? PROFILE_SHARD_CAPACITY : shard->capacity * 2;
+    SampledBlock * old_blocks = shard->blocks;
+    size_t old_capacity = shard->capacity;
+    SampledBlock * blocks = calloc(capacity, sizeof(SampledBlock));
+    if (blocks == NULL)
+        return false;
+    shard->blocks = blocks;
+    shard->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_blocks[i].memory != NULL)
+            shard->blocks[findSampledSlot(shard, old_blocks[i].memory)] = old_blocks[i];
+    }
+    free(old_blocks);
+    return true;
+}
+
+static int compareSites(const void * first, const void * second) {
+    const ProfileSite * a = first;
+    const ProfileSite * b = second;
+    long long key_a, key_b;
+    if (report_order == 1) {
+        key_a = a->allocations;
+        key_b = b->allocations;
+    } else if (report_order == 2) {
+        key_a = a->frees > 0 ? a->lifetime_ns / a->frees : 0;
+        key_b = b->frees > 0 ? b->lifetime_ns / b->frees : 0;
+    } else {
+        key_a = a->bytes;
+        key_b = b->bytes;
+    }
+    return key_a < key_b ? 1 : key_a > key_b ? -1 : 0;
+}
+
+static void writeProfileReport() {
+    ProfileSite * sorted = malloc(PROFILE_SITES * sizeof(ProfileSite));
+    if (sorted == NULL)
+        return;
+    int count = 0;
+    for (int i = 0; i < PROFILE_SITES; i++) {
+        if (__atomic_load_n(&sites[i].file, __ATOMIC_ACQUIRE) != NULL)
+            sorted[count++] = sites[i];
+    }
+    qsort(sorted, count, sizeof(ProfileSite), compareSites);
+    FILE * file = fopen(report_path, "w");
+    if (file == NULL) {
+        perror("Couldn't write the allocation profile");
+        free(sorted);
+        return;
+    }
+    fprintf(file, "file,line,sampled_allocations,estimated_allocations,estimated_bytes,"
+                  "average_size,sampled_frees,average_lifetime_us,max_lifetime_us,sampled_live\n");
+    for (int i = 0; i < count; i++) {
+        const ProfileSite * site = &sorted[i];
+        fprintf(file, "%s,%u,%lld,%lld,%lld,%lld,%lld,%.1f,%.1f,%lld\n",
+                site->file, site->line, site->allocations, site->allocations * sample_rate,
+                site->bytes * sample_rate, site->allocations > 0 ? site->bytes / site->allocations : 0,
+                site->frees, site->frees > 0 ? site->lifetime_ns / 1e3 / site->frees : 0.0,
+                site->max_lifetime_ns / 1e3, site->allocations - site->frees);
+    }
+    fclose(file);
+    free(sorted);
+}
+
+static long long currentTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+#endif //SNEK_ALLOC_PROFILE
+
+#ifdef SNEK_GUARD_PAGES
+
+/** @brief Number of freed blocks kept inaccessible before they are unmapped */
+#define GUARD_QUARANTINE 1024
+
+/** @brief Marks the header of blocks allocated by \p guardMalloc */
+#define GUARD_MAGIC 0x5A4E454BU
+
+/** @brief Alignment of the blocks */
+#define GUARD_ALIGNMENT 16
+
+/** @brief Value uninitialized blocks are filled with, to make reads of them visible */
+#define GUARD_GARBAGE 'G'
+
+/**
+ * @brief Header stored right before every guarded block
+ */
+typedef struct GuardHeader {
+    /** @brief Requested size of the block */
+    size_t size;
+    /** @brief \p GUARD_MAGIC while the block is allocated */
+    unsigned magic;
+    /** @brief Pads the header to \p GUARD_ALIGNMENT bytes */
+    unsigned padding;
+} GuardHeader;
+
+/**
+ * @brief Mapping of a freed block waiting in the quarantine
+ */
+typedef struct GuardMapping {
+    /** @brief Start of the mapping, \p NULL for unused entries */
+    void * start;
+    /** @brief Length of the mapping including the guard page */
+    size_t length;
+} GuardMapping;
+
+/**
+ * @brief Computes the mapping of a block
+ * @param size requested size of the block
+ * @param accessible set to the number of accessible bytes before the guard page
+ * @return length of the mapping including the guard page
+ */
+static size_t guardLayout(size_t size, size_t * accessible);
+
+/**
+ * @brief Looks up the header of a block, aborting if it is not a guarded block
+ * @param memory the block
+ * @param operation name of the calling function, for the error message
+ * @return the header
+ */
+static GuardHeader * guardHeader(void * memory, const char * operation);
+
+/** @brief Freed mappings, a ring buffer, the oldest is unmapped when it is full */
+static GuardMapping quarantine[GUARD_QUARANTINE];
+
+/** @brief Next entry of \p quarantine to use */
+static size_t quarantine_next = 0;
+
+/** @brief Protects \p quarantine */
+static pthread_mutex_t quarantine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t guardLayout(size_t size, size_t * accessible) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t aligned = (size + GUARD_ALIGNMENT - 1) / GUARD_ALIGNMENT * GUARD_ALIGNMENT;
+    *accessible = (aligned + sizeof(GuardHeader) + page - 1) / page * page;
+    return *accessible + page;
+}
+
+void * guardMalloc(size_t size) {
+    // Like debugmalloc, a zero-sized allocation returns NULL
+    if (size == 0 || size > SIZE_MAX / 2)
+        return NULL;
+    size_t accessible;
+    size_t length = guardLayout(size, &accessible);
+    char * start = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED)
+        return NULL;
+    if (mprotect(start + accessible, length - accessible, PROT_NONE) != 0) {
+        munmap(start, length);
+        return NULL;
+    }
+    size_t aligned = (size + GUARD_ALIGNMENT - 1) / GUARD_ALIGNMENT * GUARD_ALIGNMENT;
+    char * memory = start + accessible - aligned;
+    GuardHeader * header = (GuardHeader *) memory - 1;
+    header->size = size;
+    header->magic = GUARD_MAGIC;
+    memset(memory, GUARD_GARBAGE, aligned);
+    long long live = __atomic_add_fetch(&allocator_counters.live_bytes, (long long) size, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&allocator_counters.peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&allocator_counters.peak_bytes, &peak, live, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&allocator_counters.live_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocator_counters.total_count, 1, __ATOMIC_RELAXED);
+    allocator_thread_counts.allocations++;
+    return memory;
+}
+
+void * guardCalloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+    void * memory = guardMalloc(count * size);
+    if (memory != NULL)
+        memset(memory, 0, count * size);
+    return memory;
+}
+
+void * guardRealloc(void * memory, size_t size) {
+    if (memory == NULL)
+        return guardMalloc(size);
+    if (size == 0) {
+        guardFree(memory);
+        return NULL;
+    }
+    GuardHeader * header = guardHeader(memory, "realloc");
+    void * resized = guardMalloc(size);
+    if (resized == NULL)
+        return NULL;
+    memcpy(resized, memory, header->size < size ? header->size : size);
+    guardFree(memory);
+    return resized;
+}
+
+void guardFree(void * memory) {
+    if (memory == NULL)
+        return;
+    GuardHeader * header = guardHeader(memory, "free");
+    size_t size = header->size;
+    size_t accessible;
+    size_t length = guardLayout(size, &accessible);
+    size_t aligned = (size + GUARD_ALIGNMENT - 1) / GUARD_ALIGNMENT * GUARD_ALIGNMENT;
+    char * start = (char *) memory + aligned - accessible;
+    // A second free of the block faults on the header from here on
+    header->magic = 0;
+    mprotect(start, accessible, PROT_NONE);
+    __atomic_sub_fetch(&allocator_counters.live_bytes, (long long) size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&allocator_counters.live_count, 1, __ATOMIC_RELAXED);
+    allocator_thread_counts.frees++;
+    pthread_mutex_lock(&quarantine_lock);
+    GuardMapping oldest = quarantine[quarantine_next];
+    quarantine[quarantine_next] = (GuardMapping) {start, length};
+    quarantine_next = (quarantine_next + 1) % GUARD_QUARANTINE;
+    pthread_mutex_unlock(&quarantine_lock);
+    if (oldest.start != NULL)
+        munmap(oldest.start, oldest.length);
+}
+
+static GuardHeader * guardHeader(void * memory, const char * operation) {
+    GuardHeader * header = (GuardHeader *) memory - 1;
+    if ((uintptr_t) memory % GUARD_ALIGNMENT != 0 || header->magic != GUARD_MAGIC) {
+        fprintf(stderr, "guard pages: %s of %p, which is not an allocated block\n", operation, memory);
+        abort();
+    }
+    return header;
+}
+
+#endif //SNEK_GUARD_PAGES
+
+#endif //SNEK_DEBUGMALLOC
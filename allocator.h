@@ -0,0 +1,248 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_ALLOCATOR_H
+#define SNEK_ALLOCATOR_H
+
+/*
+ * Allocator layer included by every translation unit instead of debugmalloc.h.
+ * With SNEK_DEBUGMALLOC defined (the SNEK_DEBUGMALLOC CMake option), every
+ * allocation is checked by debugmalloc. Otherwise the system allocator is called
+ * directly, and only relaxed atomic counters are kept next to it.
+ * With SNEK_ALLOC_PROFILE also defined, allocations can be profiled per call site.
+ * With SNEK_GUARD_PAGES defined, every block ends at an inaccessible page instead.
+ * Like debugmalloc.h, it has to be included after the system headers.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Allocation statistics of the process
+ */
+typedef struct AllocatorStats {
+    /** @brief Bytes currently allocated */
+    long long live_bytes;
+    /** @brief Highest value \p live_bytes has reached */
+    long long peak_bytes;
+    /** @brief Blocks currently allocated */
+    long live_count;
+    /** @brief Allocations made, never decreased */
+    long long total_count;
+} AllocatorStats;
+
+/**
+ * In debug builds the sizes are the ones requested, and the peak is exact,
+ * tracked over all threads at once. In release builds the sizes are the
+ * usable sizes of the blocks reported by the system allocator.
+ * @brief Reads the allocation statistics
+ * @param stats structure to fill
+ */
+void getAllocatorStats(AllocatorStats * stats);
+
+/**
+ * @brief Allocations and frees made by a single thread
+ */
+typedef struct AllocatorThreadCounts {
+    /** @brief Blocks allocated, a resized block counts as a free and an allocation */
+    long long allocations;
+    /** @brief Blocks freed */
+    long long frees;
+} AllocatorThreadCounts;
+
+/**
+ * Unlike \p getAllocatorStats, this is not disturbed by the background threads.
+ * Only the calls going through this layer are counted, the allocations made
+ * inside libraries, such as ncurses, are not.
+ * @brief Reads the allocations and frees of the calling thread
+ * @param counts structure to fill
+ */
+void getAllocatorThreadCounts(AllocatorThreadCounts * counts);
+
+#ifdef SNEK_DEBUGMALLOC
+
+#include "debugmalloc.h"
+
+#else
+
+/** @brief Counters of the release allocator, updated with relaxed atomics */
+extern AllocatorStats allocator_counters;
+
+/** @brief Counters of the calling thread, see \p getAllocatorThreadCounts */
+extern __thread AllocatorThreadCounts allocator_thread_counts;
+
+#ifdef SNEK_GUARD_PAGES
+
+/**
+ * Every block gets its own mapping, and is placed at its end, right before a page
+ * without access rights, so reading or writing past the block faults at the
+ * offending instruction. Blocks are aligned to 16 bytes, so overruns into the
+ * alignment padding are not caught. Freed blocks lose their access rights and
+ * are kept in a quarantine before being unmapped, so using them faults too.
+ * Every block costs at least two pages and a few memory mappings, this mode is
+ * meant for soak tests, not for large score files.
+ * @brief \p malloc placing the block against a guard page
+ * @param size size of the block
+ * @return the block, \p NULL on failure
+ */
+void * guardMalloc(size_t size);
+
+/**
+ * @brief \p calloc placing the block against a guard page, see \p guardMalloc
+ * @param count number of items
+ * @param size size of an item
+ * @return the zeroed block, \p NULL on failure
+ */
+void * guardCalloc(size_t count, size_t size);
+
+/**
+ * @brief \p realloc moving the block into a new guarded mapping, see \p guardMalloc
+ * @param memory block to resize, \p NULL to allocate
+ * @param size new size of the block, 0 to free
+ * @return the resized block, \p NULL on failure (the old block is kept)
+ */
+void * guardRealloc(void * memory, size_t size);
+
+/**
+ * Aborts if \p memory has not been allocated by \p guardMalloc.
+ * @brief \p free moving the block into the quarantine, see \p guardMalloc
+ * @param memory block to free, \p NULL is ignored
+ */
+void guardFree(void * memory);
+
+#ifndef SNEK_ALLOCATOR_IMPLEMENTATION
+#define malloc(SIZE_TO_ALLOC) guardMalloc(SIZE_TO_ALLOC)
+#define calloc(NUMBER_OF_ITEMS,ITEM_SIZE) guardCalloc((NUMBER_OF_ITEMS), (ITEM_SIZE))
+#define realloc(POINTER,SIZE_TO_ALLOC) guardRealloc((POINTER), (SIZE_TO_ALLOC))
+#define free(POINTER) guardFree(POINTER)
+#endif
+
+#else
+
+#include <malloc.h>
+
+#ifdef SNEK_ALLOC_PROFILE
+
+/**
+ * Profiling is enabled at runtime by the SNEK_ALLOC_PROFILE environment variable,
+ * holding the path of the CSV report written at exit. Every SNEK_ALLOC_SAMPLE-th
+ * allocation of each thread is sampled (1 by default), and the count, size and
+ * lifetime of the sampled blocks are aggregated per call site.
+ * @brief Records a new block in the allocation profile
+ * @param memory the block, \p NULL is ignored
+ * @param size requested size of the block
+ * @param file source file of the call site
+ * @param line line of the call site
+ */
+void profileAllocation(void * memory, size_t size, const char * file, unsigned line);
+
+/**
+ * @brief Records the end of the lifetime of a block in the allocation profile
+ * @param memory the block, \p NULL is ignored
+ */
+void profileFree(void * memory);
+
+#else
+
+/** @brief Profiling is not compiled in */
+static inline void profileAllocation(void * memory, size_t size, const char * file, unsigned line) {
+    (void) memory;
+    (void) size;
+    (void) file;
+    (void) line;
+}
+
+/** @brief Profiling is not compiled in */
+static inline void profileFree(void * memory) {
+    (void) memory;
+}
+
+#endif //SNEK_ALLOC_PROFILE
+
+/**
+ * @brief Counts a new block
+ * @param memory the block, \p NULL is ignored
+ */
+static inline void allocator_count_block(void * memory) {
+    if (memory == NULL)
+        return;
+    long long size = (long long) malloc_usable_size(memory);
+    long long live = __atomic_add_fetch(&allocator_counters.live_bytes, size, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&allocator_counters.peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&allocator_counters.peak_bytes, &peak, live, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&allocator_counters.live_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocator_counters.total_count, 1, __ATOMIC_RELAXED);
+    allocator_thread_counts.allocations++;
+}
+
+/**
+ * @brief Uncounts a block that is about to be freed
+ * @param memory the block, \p NULL is ignored
+ */
+static inline void allocator_uncount_block(void * memory) {
+    if (memory == NULL)
+        return;
+    __atomic_sub_fetch(&allocator_counters.live_bytes, (long long) malloc_usable_size(memory), __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&allocator_counters.live_count, 1, __ATOMIC_RELAXED);
+    allocator_thread_counts.frees++;
+}
+
+/** @brief Counted \p malloc, \p file and \p line identify the call site */
+static inline void * allocator_malloc(size_t size, const char * file, unsigned line) {
+    void * memory = malloc(size);
+    allocator_count_block(memory);
+    profileAllocation(memory, size, file, line);
+    return memory;
+}
+
+/** @brief Counted \p calloc, \p file and \p line identify the call site */
+static inline void * allocator_calloc(size_t count, size_t size, const char * file, unsigned line) {
+    void * memory = calloc(count, size);
+    allocator_count_block(memory);
+    profileAllocation(memory, count * size, file, line);
+    return memory;
+}
+
+/** @brief Counted \p realloc, \p file and \p line identify the call site */
+static inline void * allocator_realloc(void * memory, size_t size, const char * file, unsigned line) {
+    // The old block is only uncounted once it is gone, a failed realloc leaves it in place.
+    // Its profile ends before, the old address must not be used afterwards
+    size_t old_size = memory != NULL ? malloc_usable_size(memory) : 0;
+    profileFree(memory);
+    void * resized = realloc(memory, size);
+    if (resized == NULL && size != 0)
+        return NULL;
+    if (memory != NULL) {
+        __atomic_sub_fetch(&allocator_counters.live_bytes, (long long) old_size, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&allocator_counters.live_count, 1, __ATOMIC_RELAXED);
+        allocator_thread_counts.frees++;
+    }
+    allocator_count_block(resized);
+    profileAllocation(resized, size, file, line);
+    return resized;
+}
+
+/** @brief Counted \p free */
+static inline void allocator_free(void * memory) {
+    allocator_uncount_block(memory);
+    profileFree(memory);
+    free(memory);
+}
+
+// The allocator itself calls the system allocator directly
+#ifndef SNEK_ALLOCATOR_IMPLEMENTATION
+#define malloc(SIZE_TO_ALLOC) allocator_malloc((SIZE_TO_ALLOC), __FILE__, __LINE__)
+#define calloc(NUMBER_OF_ITEMS,ITEM_SIZE) allocator_calloc((NUMBER_OF_ITEMS), (ITEM_SIZE), __FILE__, __LINE__)
+#define realloc(POINTER,SIZE_TO_ALLOC) allocator_realloc((POINTER), (SIZE_TO_ALLOC), __FILE__, __LINE__)
+#define free(POINTER) allocator_free(POINTER)
+#endif
+
+#endif //SNEK_GUARD_PAGES
+
+#endif //SNEK_DEBUGMALLOC
+
+#endif //SNEK_ALLOCATOR_H
@@ -0,0 +1,1012 @@
+/**
+ * Arcade server, running the games of many players in one process.
+ * Players connect to a Unix domain socket with a terminal in raw mode, e.g.
+ * \p socat \p -,raw,echo=0 \p UNIX-CONNECT:/tmp/snek_arcade.sock, type their
+ * nickname, and play as in the terminal game. A single thread serves every
+ * session: an epoll loop handles the connections and the keys, and a shared
+ * timer wheel steps the games when their ticks are due.
+ * Instead of ncurses, every session has a model of its terminal and an output
+ * buffer, and only the cells that changed since the last frame are sent as
+ * ANSI escape sequences. The scores are saved and ranked like in the game, on a
+ * thread of their own, so locking and syncing the scores file never stalls the sessions.
+ * \file arcade.c
+ * \author hexadec
+ * \brief This file contains the multi-session arcade server
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "snek.h"
+#include "game.h"
+#include "fileio.h"
+#include "scorecache.h"
+#include "timerwheel.h"
+#include "metrics.h"
+#include "allocator.h"
+
+/** @brief Default path of the socket of the server */
+#define ARCADE_DEFAULT_SOCKET "/tmp/snek_arcade.sock"
+
+/** @brief Default size of the game area, a common terminal size */
+#define ARCADE_COLUMNS 80
+/** @brief Default size of the game area, a common terminal size */
+#define ARCADE_ROWS 24
+
+/** @brief Default time between two steps of a game, the same as in the terminal game */
+#define ARCADE_TICK_MS 750
+
+/** @brief Number of slots of the timer wheel, a turn is longer than a tick */
+#define ARCADE_WHEEL_SLOTS 1024
+
+/** @brief Resolution of the timer wheel */
+#define ARCADE_WHEEL_RESOLUTION_NS 1000000LL
+
+/** @brief Most events handled by one call of \p epoll_wait */
+#define ARCADE_MAX_EVENTS 256
+
+/** @brief Most bytes waiting to be sent to a session, slower clients are disconnected */
+#define ARCADE_OUTPUT_LIMIT 65536
+
+/** @brief Bytes read from a session at once */
+#define ARCADE_READ_SIZE 256
+
+/** @brief Cell of the frame border */
+#define CELL_FRAME 1
+/** @brief Cell of the snake */
+#define CELL_SNAKE 2
+/** @brief Cell of the food */
+#define CELL_FOOD 3
+
+/**
+ * @brief Colors of the cells, the same as the color pairs of the terminal game
+ */
+typedef enum CellColor {
+    /** @brief White text, black background */
+    COLOR_WHITE_TEXT = 0,
+    /** @brief Red text, black background */
+    COLOR_RED_TEXT,
+    /** @brief Green text, black background */
+    COLOR_GREEN_TEXT
+} CellColor;
+
+/**
+ * The low byte is an ASCII character or one of the \p CELL_ values,
+ * the high byte is the \p CellColor.
+ * @brief A character cell of the terminal of a session
+ */
+typedef uint16_t Cell;
+
+/**
+ * @brief State of a session
+ */
+typedef enum SessionState {
+    /** @brief Typing the nickname */
+    SESSION_NICKNAME,
+    /** @brief Playing */
+    SESSION_PLAYING,
+    /** @brief The game is over, the session is closed once its output has been sent */
+    SESSION_CLOSING
+} SessionState;
+
+/**
+ * @brief Bytes waiting to be sent to a session
+ */
+typedef struct OutputBuffer {
+    /** @brief The bytes, \p NULL until the first output */
+    char * data;
+    /** @brief Number of bytes in \p data */
+    size_t length;
+    /** @brief Number of bytes of \p data already sent */
+    size_t sent;
+    /** @brief Size of \p data */
+    size_t capacity;
+} OutputBuffer;
+
+/**
+ * @brief A finished game waiting to be saved
+ */
+typedef struct QueuedGame {
+    /** @brief The game, its \p nick is set to \p nick when it is saved */
+    GameRecord game;
+    /** @brief Nickname of the player, the session may be gone by the time the game is saved */
+    char nick[NICK_MAX_LENGTH + 1];
+} QueuedGame;
+
+/**
+ * @brief Finished games handed over to the thread saving the scores
+ */
+typedef struct ScoreQueue {
+    /** @brief Protects the queue */
+    pthread_mutex_t lock;
+    /** @brief Protects \p Arcade::scores, held only to look up a highscore or swap the cache */
+    pthread_mutex_t scores_lock;
+    /** @brief Signalled when a game is queued or the server stops */
+    pthread_cond_t queued;
+    /** @brief The thread saving the scores */
+    pthread_t thread;
+    /** @brief Whether \p thread is running, the games are saved right away otherwise */
+    bool started;
+    /** @brief Set when the server stops, the thread saves the queued games and exits */
+    bool stopping;
+    /** @brief Set by the thread if the score cache couldn't be refreshed for lack of memory */
+    int failed;
+    /** @brief Games waiting to be saved */
+    QueuedGame * games;
+    /** @brief Number of items in \p games */
+    size_t count;
+    /** @brief Number of items allocated in \p games */
+    size_t capacity;
+} ScoreQueue;
+
+/**
+ * @brief A connected player
+ */
+typedef struct Session {
+    /** @brief Socket of the session */
+    int fd;
+    /** @brief State of the session */
+    SessionState state;
+    /** @brief Game of the session, set up when the nickname has been typed */
+    Snek snek;
+    /** @brief Next tick of the game, in the timer wheel of the server */
+    Timer timer;
+    /** @brief Nickname of the player, the \p player_name of the game */
+    char nick[NICK_MAX_LENGTH + 1];
+    /** @brief Number of bytes of \p nick */
+    size_t nick_length;
+    /** @brief Cells the terminal of the session shows */
+    Cell * shown;
+    /** @brief Column of the cursor of the terminal, -1 if not known */
+    int cursor_x;
+    /** @brief Row of the cursor of the terminal */
+    int cursor_y;
+    /** @brief Color the terminal draws with, -1 if not known */
+    int color;
+    /** @brief Bytes waiting to be sent */
+    OutputBuffer output;
+    /** @brief Whether the socket is watched for becoming writable */
+    bool waiting_to_write;
+    /** @brief Previous session of the server */
+    struct Session * prev;
+    /** @brief Next session of the server */
+    struct Session * next;
+} Session;
+
+/**
+ * @brief State of the server
+ */
+typedef struct Arcade {
+    /** @brief The epoll instance */
+    int epoll;
+    /** @brief Listening socket */
+    int listener;
+    /** @brief Timer wheel of the ticks of every game */
+    TimerWheel * wheel;
+    /** @brief Scores of every player, for the highscores, refreshed after every game, see \p ScoreQueue::scores_lock */
+    ScoreCache * scores;
+    /** @brief Finished games waiting to be saved */
+    ScoreQueue saver;
+    /** @brief Size of the game area of every session */
+    Point game_size;
+    /** @brief Time between two steps of a game */
+    long long tick_ns;
+    /** @brief The border of the frame, copied into \p frame before drawing a frame */
+    Cell * background;
+    /** @brief The frame being drawn */
+    Cell * frame;
+    /** @brief First session of the list of every session */
+    Session * sessions;
+    /** @brief Sessions connected so far */
+    long long sessions_total;
+    /** @brief Sessions currently connected */
+    long open;
+    /** @brief Most sessions connected at the same time */
+    long open_peak;
+    /** @brief Games finished */
+    long long games;
+    /** @brief Steps of all games */
+    long long ticks;
+    /** @brief Bytes sent to the sessions */
+    long long bytes_sent;
+    /** @brief Whether accepting has failed for lack of descriptors, reported once */
+    bool descriptors_exhausted;
+} Arcade;
+
+/** @brief Set by the signal handler to stop the server */
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * @brief Stops the server on \p SIGINT and \p SIGTERM
+ * @param signal code of received signal
+ */
+static void stopServer(int);
+
+/**
+ * If the path is taken by a socket no server listens on, the socket is replaced.
+ * @brief Creates the listening socket of the server
+ * @param path path of the socket
+ * @return the socket, -1 on failure
+ */
+static int listenOn(const char *);
+
+/**
+ * @brief Accepts every pending connection, and starts a session for each
+ * @param arcade the server
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool acceptSessions(Arcade *);
+
+/**
+ * @brief Reads the keys of a session, and handles them according to its state
+ * @param arcade the server
+ * @param session the session to read from
+ * @return \p true if the session goes on, \p false if it has to be closed
+ */
+static bool readSession(Arcade *, Session *);
+
+/**
+ * @brief Adds a byte of the nickname, or finishes it and starts the game
+ * @param arcade the server
+ * @param session the session typing its nickname
+ * @param key the typed byte
+ * @return \p true if the session goes on, \p false if it has to be closed
+ */
+static bool typeNickname(Arcade *, Session *, unsigned char);
+
+/**
+ * @brief Starts the game of a session
+ * @param arcade the server
+ * @param session the session whose nickname has been typed
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool startGame(Arcade *, Session *);
+
+/**
+ * Like in the terminal game, a valid control key steps the game immediately,
+ * and the next step comes a tick later.
+ * @brief Steps the game of a session, and sends the new frame
+ * @param arcade the server
+ * @param session the playing session
+ * @return \p true if the session goes on, \p false if it has to be closed
+ */
+static bool stepSession(Arcade *, Session *);
+
+/**
+ * @brief Callback of the timer wheel, steps the game whose tick is due
+ * @param timer timer of the session
+ * @param context the server
+ */
+static void tickExpired(Timer *, void *);
+
+/**
+ * The game is queued to be saved, the session is closed once the game over screen has been sent.
+ * @brief Finishes the game of a session
+ * @param arcade the server
+ * @param session the session whose snake has died
+ * @return \p true if the session goes on, \p false if it has to be closed
+ */
+static bool finishGame(Arcade *, Session *);
+
+/**
+ * Every batch of queued games is written, then a second score cache, only used by
+ * this thread, is refreshed once and swapped with the one of the server. The cache
+ * swapped out catches up with the scores file at the next refresh, so the sessions
+ * never wait for the file to be read.
+ * @brief Entry point of the thread saving the scores
+ * @param context the server
+ * @return \p NULL
+ */
+static void * saveGames(void *);
+
+/**
+ * If the thread saving the scores is not running, the game is saved right away.
+ * @brief Queues a finished game to be saved
+ * @param arcade the server
+ * @param game the game
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool queueGame(Arcade *, const GameRecord *);
+
+/**
+ * @brief Saves the queued games and stops the thread saving the scores
+ * @param arcade the server
+ */
+static void stopSaver(Arcade *);
+
+/**
+ * @brief Draws the game of a session into the frame of the server
+ * @param arcade the server
+ * @param session the playing session
+ */
+static void drawFrame(Arcade *, const Session *);
+
+/**
+ * @brief Appends the cells that differ from the terminal of a session to its output
+ * @param arcade the server, its frame is the one to show
+ * @param session the session to update
+ * @return number of bytes appended, -1 if there is not enough memory
+ */
+static long renderFrame(Arcade *, Session *);
+
+/**
+ * @brief Writes text into the frame of the server
+ * @param arcade the server
+ * @param x column of the first character
+ * @param y row of the text
+ * @param text ASCII text, cut at the edge of the frame
+ * @param color color of the text
+ */
+static void drawText(Arcade *, int, int, const char *, CellColor);
+
+/**
+ * @brief Appends bytes to the output of a session
+ * @param session the session
+ * @param bytes bytes to append
+ * @param length number of bytes
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool appendOutput(Session *, const char *, size_t);
+
+/**
+ * Sends as much of the output as the socket takes, and watches the socket
+ * for becoming writable if some of it remains.
+ * @brief Sends the output of a session
+ * @param arcade the server
+ * @param session the session
+ * @return \p true if the session goes on, \p false if it has to be closed
+ */
+static bool flushOutput(Arcade *, Session *);
+
+/**
+ * @brief Closes the connection of a session and frees it
+ * @param arcade the server
+ * @param session the session to close
+ */
+static void closeSession(Arcade *, Session *);
+
+/**
+ * @brief Prints the usage of the program
+ * @param program name of the executable
+ */
+static void printUsage(const char *);
+
+/**
+ * \p --socket sets the path of the socket, \p --columns and \p --rows the size
+ * of the game area, and \p --tick-ms the time between two steps of a game.
+ * The server runs until it gets \p SIGINT or \p SIGTERM, then prints a summary.
+ * The metrics are exported like in the game, if SNEK_METRICS is set.
+ * @brief Entry point of the arcade server
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @return 0 on success, 1 on wrong arguments, 2 if the socket cannot be opened, -3 if there is not enough memory
+ */
+int main(int argc, char ** argv) {
+    const char * path = ARCADE_DEFAULT_SOCKET;
+    Arcade arcade;
+    memset(&arcade, 0, sizeof(Arcade));
+    arcade.game_size = (Point) {ARCADE_COLUMNS, ARCADE_ROWS};
+    long tick_ms = ARCADE_TICK_MS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            arcade.game_size.x = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            arcade.game_size.y = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tick-ms") == 0 && i + 1 < argc) {
+            tick_ms = atol(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    // Same limits as the terminal
+    if (arcade.game_size.x < 35 || arcade.game_size.y < 8 || arcade.game_size.x > 255 || arcade.game_size.y > 255 || tick_ms < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    arcade.tick_ns = tick_ms * 1000000LL;
+    // Every session takes a descriptor
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    struct sigaction handler;
+    memset(&handler, 0, sizeof(struct sigaction));
+    handler.sa_handler = stopServer;
+    sigaction(SIGINT, &handler, NULL);
+    sigaction(SIGTERM, &handler, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    startMetrics();
+
+    size_t cells = (size_t) arcade.game_size.x * arcade.game_size.y;
+    arcade.wheel = createTimerWheel(ARCADE_WHEEL_SLOTS, ARCADE_WHEEL_RESOLUTION_NS);
+    arcade.scores = createScoreCache(TOPLIST_SIZE);
+    arcade.background = malloc(cells * sizeof(Cell));
+    arcade.frame = malloc(cells * sizeof(Cell));
+    if (arcade.wheel == NULL || arcade.scores == NULL || arcade.background == NULL || arcade.frame == NULL
+        || !loadScoreCache(arcade.scores, NULL)) {
+        freeTimerWheel(arcade.wheel);
+        freeScoreCache(arcade.scores);
+        free(arcade.background);
+        free(arcade.frame);
+        fprintf(stderr, "Couldn't allocate memory\n");
+        return -3;
+    }
+    // The border is the same in every frame, the same blocks as drawn by the terminal game
+    int columns = arcade.game_size.x;
+    int rows = arcade.game_size.y;
+    for (size_t i = 0; i < cells; i++)
+        arcade.background[i] = ' ';
+    for (int x = 0; x < columns; x++)
+        arcade.background[columns + x] = arcade.background[(rows - 1) * columns + x] = CELL_FRAME;
+    for (int y = 2; y < rows - 1; y++)
+        arcade.background[y * columns] = arcade.background[y * columns + columns - 1] = CELL_FRAME;
+
+    arcade.listener = listenOn(path);
+    arcade.epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (arcade.listener < 0 || arcade.epoll < 0 || epoll_ctl(arcade.epoll, EPOLL_CTL_ADD, arcade.listener, &event) != 0) {
+        perror(path);
+        if (arcade.listener >= 0) {
+            close(arcade.listener);
+            unlink(path);
+        }
+        freeTimerWheel(arcade.wheel);
+        freeScoreCache(arcade.scores);
+        free(arcade.background);
+        free(arcade.frame);
+        return 2;
+    }
+    fprintf(stderr, "Listening on %s\n", path);
+    pthread_mutex_init(&arcade.saver.lock, NULL);
+    pthread_mutex_init(&arcade.saver.scores_lock, NULL);
+    pthread_cond_init(&arcade.saver.queued, NULL);
+    arcade.saver.started = pthread_create(&arcade.saver.thread, NULL, saveGames, &arcade) == 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    bool success = true;
+    struct epoll_event events[ARCADE_MAX_EVENTS];
+    while (!stopping && success) {
+        int count = epoll_wait(arcade.epoll, events, ARCADE_MAX_EVENTS, nextTimerTimeout(arcade.wheel));
+        if (count < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < count && success; i++) {
+            Session * session = events[i].data.ptr;
+            if (session == NULL) {
+                success = acceptSessions(&arcade);
+                continue;
+            }
+            bool open = true;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                open = false;
+            if (open && (events[i].events & EPOLLOUT))
+                open = flushOutput(&arcade, session);
+            if (open && (events[i].events & EPOLLIN))
+                open = readSession(&arcade, session);
+            if (!open)
+                closeSession(&arcade, session);
+        }
+        advanceTimerWheel(arcade.wheel, tickExpired, &arcade);
+        if (__atomic_load_n(&arcade.saver.failed, __ATOMIC_RELAXED))
+            success = false;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+    while (arcade.sessions != NULL)
+        closeSession(&arcade, arcade.sessions);
+    close(arcade.epoll);
+    close(arcade.listener);
+    unlink(path);
+    stopSaver(&arcade);
+    closeScoreWriter();
+    freeTimerWheel(arcade.wheel);
+    freeScoreCache(arcade.scores);
+    free(arcade.background);
+    free(arcade.frame);
+    if (!success)
+        fprintf(stderr, "Couldn't allocate memory\n");
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1E9;
+    double cpu = (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                 + (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+    printf("sessions: %lld\npeak sessions: %ld\ngames: %lld\nticks: %lld\nbytes sent: %lld\n"
+           "seconds: %.3f\ncpu seconds: %.3f\nticks per second: %.0f\n",
+           arcade.sessions_total, arcade.open_peak, arcade.games, arcade.ticks, arcade.bytes_sent,
+           elapsed, cpu, elapsed > 0 ? (double) arcade.ticks / elapsed : 0.0);
+    return success ? 0 : -3;
+}
+
+static void stopServer(int signal) {
+    (void) signal;
+    stopping = 1;
+}
+
+static int listenOn(const char * path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        // Left behind by a server that is gone, if nothing answers on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = errno == EADDRINUSE && probe >= 0
+                     && connect(probe, (struct sockaddr *) &address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+        if (!stale || unlink(path) != 0 || bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+static bool acceptSessions(Arcade * arcade) {
+    int fd;
+    while ((fd = accept(arcade->listener, NULL, NULL)) >= 0) {
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+            close(fd);
+            continue;
+        }
+        Session * session = calloc(1, sizeof(Session));
+        if (session == NULL) {
+            close(fd);
+            return false;
+        }
+        session->fd = fd;
+        session->state = SESSION_NICKNAME;
+        session->cursor_x = -1;
+        session->color = -1;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = session};
+        if (epoll_ctl(arcade->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(session);
+            continue;
+        }
+        session->next = arcade->sessions;
+        if (arcade->sessions != NULL)
+            arcade->sessions->prev = session;
+        arcade->sessions = session;
+        arcade->sessions_total++;
+        if (++arcade->open > arcade->open_peak)
+            arcade->open_peak = arcade->open;
+        // Clear the screen, and ask for the nickname where the terminal game does
+        char prompt[64];
+        int columns = arcade->game_size.x;
+        int length = snprintf(prompt, sizeof(prompt), "\x1b[0m\x1b[2J\x1b[%d;%dHNickname?  ",
+                              arcade->game_size.y / 2 + 1, columns / 2 - (columns > 30 ? 8 : columns / 4) + 1);
+        if (!appendOutput(session, prompt, (size_t) length)) {
+            closeSession(arcade, session);
+            return false;
+        }
+        if (!flushOutput(arcade, session))
+            closeSession(arcade, session);
+    }
+    if ((errno == EMFILE || errno == ENFILE) && !arcade->descriptors_exhausted) {
+        // The pending connections wait in the backlog until sessions are closed
+        perror("Couldn't accept more sessions");
+        arcade->descriptors_exhausted = true;
+    }
+    return true;
+}
+
+static bool readSession(Arcade * arcade, Session * session) {
+    unsigned char keys[ARCADE_READ_SIZE];
+    ssize_t length = read(session->fd, keys, sizeof(keys));
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR))
+        return false;
+    if (length < 0)
+        return true;
+    switch (session->state) {
+        case SESSION_NICKNAME:
+            for (ssize_t i = 0; i < length && session->state == SESSION_NICKNAME; i++) {
+                if (!typeNickname(arcade, session, keys[i]))
+                    return false;
+            }
+            return flushOutput(arcade, session);
+        case SESSION_PLAYING:
+            // Like the terminal game, only the first key is handled, the rest is discarded
+            switch (keys[0]) {
+                case 'w':
+                    if (session->snek.direction == DOWN)
+                        return true;
+                    session->snek.direction = UP;
+                    break;
+                case 'a':
+                    if (session->snek.direction == RIGHT)
+                        return true;
+                    session->snek.direction = LEFT;
+                    break;
+                case 's':
+                    if (session->snek.direction == UP)
+                        return true;
+                    session->snek.direction = DOWN;
+                    break;
+                case 'd':
+                    if (session->snek.direction == LEFT)
+                        return true;
+                    session->snek.direction = RIGHT;
+                    break;
+                default:
+                    return true;
+            }
+            return stepSession(arcade, session);
+        case SESSION_CLOSING:
+            return true;
+    }
+    return true;
+}
+
+static bool typeNickname(Arcade * arcade, Session * session, unsigned char key) {
+    if (key == '\r' || key == '\n') {
+        if (session->nick_length == 0)
+            strcpy(session->nick, "anonymous");
+        return startGame(arcade, session);
+    }
+    if (key == 0x7F || key == '\b') {
+        if (session->nick_length == 0)
+            return true;
+        // Remove the continuation bytes of a multibyte character as well
+        while (session->nick_length > 1 && ((unsigned char) session->nick[session->nick_length - 1] & 0xC0u) == 0x80)
+            session->nick_length--;
+        session->nick[--session->nick_length] = '\0';
+        return appendOutput(session, "\b \b", 3);
+    }
+    // The comma separates the fields of the scores file
+    if (key < ' ' || key == ',' || session->nick_length == NICK_MAX_LENGTH)
+        return true;
+    session->nick[session->nick_length++] = (char) key;
+    session->nick[session->nick_length] = '\0';
+    return appendOutput(session, (const char *) &key, 1);
+}
+
+static bool startGame(Arcade * arcade, Session * session) {
+    Snek * snek = &session->snek;
+    size_t cells = (size_t) arcade->game_size.x * arcade->game_size.y;
+    session->shown = malloc(cells * sizeof(Cell));
+    snek->food = malloc(sizeof(Point));
+    snek->game_size = arcade->game_size;
+    if (session->shown == NULL || snek->food == NULL || !createSnake(snek))
+        return false;
+    snek->player_name = session->nick;
+    snek->score = 1;
+    snek->direction = UP;
+    pthread_mutex_lock(&arcade->saver.scores_lock);
+    snek->highscore = getCachedHighscore(arcade->scores, session->nick);
+    pthread_mutex_unlock(&arcade->saver.scores_lock);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &snek->started);
+    placeNewFood(snek);
+    session->state = SESSION_PLAYING;
+    // Hide the cursor and clear the screen, the terminal shows blank cells from here
+    for (size_t i = 0; i < cells; i++)
+        session->shown[i] = ' ';
+    session->cursor_x = -1;
+    session->color = -1;
+    const char clear[] = "\x1b[?25l\x1b[0m\x1b[2J";
+    if (!appendOutput(session, clear, sizeof(clear) - 1))
+        return false;
+    drawFrame(arcade, session);
+    long bytes = renderFrame(arcade, session);
+    if (bytes < 0)
+        return false;
+    recordFrame(bytes);
+    scheduleTimer(arcade->wheel, &session->timer, arcade->tick_ns);
+    return true;
+}
+
+static bool stepSession(Arcade * arcade, Session * session) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    Snek * snek = &session->snek;
+    snek->ticks++;
+    arcade->ticks++;
+    bool alive = stepGame(snek);
+    if (!alive)
+        return finishGame(arcade, session);
+    drawFrame(arcade, session);
+    long bytes = renderFrame(arcade, session);
+    if (bytes < 0)
+        return false;
+    scheduleTimer(arcade->wheel, &session->timer, arcade->tick_ns);
+    bool open = flushOutput(arcade, session);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    recordFrame(bytes);
+    recordTick(elapsedNanoseconds(&start, &end));
+    return open;
+}
+
+static void tickExpired(Timer * timer, void * context) {
+    Arcade * arcade = context;
+    Session * session = (Session *) ((char *) timer - offsetof(Session, timer));
+    if (!stepSession(arcade, session))
+        closeSession(arcade, session);
+}
+
+static bool finishGame(Arcade * arcade, Session * session) {
+    Snek * snek = &session->snek;
+    cancelTimer(arcade->wheel, &session->timer);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    GameRecord game = {
+            session->nick, snek->score, (int64_t) time(NULL),
+            (int) ((now.tv_sec - snek->started.tv_sec) * 1000L + (now.tv_nsec - snek->started.tv_nsec) / (long) 1E6),
+            snek->ticks, snek->game_size.x, snek->game_size.y, snek->food_eaten
+    };
+    arcade->games++;
+    recordGame();
+    if (!queueGame(arcade, &game))
+        return false;
+    session->state = SESSION_CLOSING;
+    // Game over in the middle of the game area, then the cursor back below it
+    char message[128];
+    int length = snprintf(message, sizeof(message), "\x1b[1;31;40m\x1b[%d;%dHGAME OVER\x1b[0m\x1b[%d;1HScore: %d\r\n\x1b[?25h",
+                          snek->game_size.y / 2 + 1, snek->game_size.x / 2 - 4, snek->game_size.y, snek->score);
+    if (!appendOutput(session, message, (size_t) length))
+        return false;
+    return flushOutput(arcade, session);
+}
+
+static bool queueGame(Arcade * arcade, const GameRecord * game) {
+    ScoreQueue * saver = &arcade->saver;
+    if (!saver->started)
+        return saveScore(game) <= 0 || refreshScoreCache(arcade->scores) >= 0;
+    pthread_mutex_lock(&saver->lock);
+    bool success = true;
+    if (saver->count == saver->capacity) {
+        size_t capacity = saver->capacity == 0 ? 16 : saver->capacity * 2;
+        QueuedGame * games = realloc(saver->games, capacity * sizeof(QueuedGame));
+        if (games != NULL) {
+            saver->games = games;
+            saver->capacity = capacity;
+        } else {
+            success = false;
+        }
+    }
+    if (success) {
+        QueuedGame * queued = &saver->games[saver->count++];
+        queued->game = *game;
+        snprintf(queued->nick, sizeof(queued->nick), "%s", game->nick);
+        pthread_cond_signal(&saver->queued);
+    }
+    pthread_mutex_unlock(&saver->lock);
+    return success;
+}
+
+static void * saveGames(void * context) {
+    Arcade * arcade = context;
+    ScoreQueue * saver = &arcade->saver;
+    // The games being saved, swapped with the queue so the server can go on queueing
+    QueuedGame * batch = NULL;
+    size_t capacity = 0;
+    // Refreshed without holding any lock, then swapped with the cache of the server
+    ScoreCache * spare = createScoreCache(TOPLIST_SIZE);
+    if (spare == NULL || !loadScoreCache(spare, NULL))
+        __atomic_store_n(&saver->failed, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&saver->lock);
+    while (true) {
+        while (saver->count == 0 && !saver->stopping)
+            pthread_cond_wait(&saver->queued, &saver->lock);
+        if (saver->count == 0)
+            break;
+        QueuedGame * games = saver->games;
+        size_t games_capacity = saver->capacity;
+        size_t count = saver->count;
+        saver->games = batch;
+        saver->capacity = capacity;
+        saver->count = 0;
+        batch = games;
+        capacity = games_capacity;
+        pthread_mutex_unlock(&saver->lock);
+        bool saved = false;
+        for (size_t i = 0; i < count; i++) {
+            batch[i].game.nick = batch[i].nick;
+            if (saveScore(&batch[i].game) > 0)
+                saved = true;
+        }
+        if (saved && spare != NULL) {
+            if (refreshScoreCache(spare) >= 0) {
+                pthread_mutex_lock(&saver->scores_lock);
+                ScoreCache * shown = arcade->scores;
+                arcade->scores = spare;
+                spare = shown;
+                pthread_mutex_unlock(&saver->scores_lock);
+            } else {
+                __atomic_store_n(&saver->failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+        pthread_mutex_lock(&saver->lock);
+    }
+    pthread_mutex_unlock(&saver->lock);
+    freeScoreCache(spare);
+    free(batch);
+    return NULL;
+}
+
+static void stopSaver(Arcade * arcade) {
+    ScoreQueue * saver = &arcade->saver;
+    if (saver->started) {
+        pthread_mutex_lock(&saver->lock);
+        saver->stopping = true;
+        pthread_cond_signal(&saver->queued);
+        pthread_mutex_unlock(&saver->lock);
+        pthread_join(saver->thread, NULL);
+        saver->started = false;
+    }
+    free(saver->games);
+    saver->games = NULL;
+    pthread_mutex_destroy(&saver->lock);
+    pthread_mutex_destroy(&saver->scores_lock);
+    pthread_cond_destroy(&saver->queued);
+}
+
+static void drawFrame(Arcade * arcade, const Session * session) {
+    const Snek * snek = &session->snek;
+    int columns = arcade->game_size.x;
+    memcpy(arcade->frame, arcade->background, (size_t) columns * arcade->game_size.y * sizeof(Cell));
+    char status[50];
+    sprintf(status, "SCORE%6d        HIGHSCORE%6d", snek->score, snek->highscore);
+    drawText(arcade, 0, 0, session->nick, COLOR_WHITE_TEXT);
+    drawText(arcade, (int) (columns / 2 - strlen(status) / 2), 0, status, COLOR_WHITE_TEXT);
+    arcade->frame[snek->food->y * columns + snek->food->x] = CELL_FOOD | COLOR_RED_TEXT << 8;
+    LinkedList * snake = snek->snake;
+    snake->toStart(snake);
+    do {
+        const Point * point = snake->node->data;
+        arcade->frame[point->y * columns + point->x] = CELL_SNAKE | COLOR_GREEN_TEXT << 8;
+    } while (snake->next(snake));
+}
+
+static long renderFrame(Arcade * arcade, Session * session) {
+    // The glyphs of the special cells, the same characters as drawn by the terminal game
+    static const char * glyphs[] = {[CELL_FRAME] = "▒", [CELL_SNAKE] = "▓", [CELL_FOOD] = "●"};
+    static const char * colors[] = {[COLOR_WHITE_TEXT] = "\x1b[37;40m", [COLOR_RED_TEXT] = "\x1b[31;40m",
+                                    [COLOR_GREEN_TEXT] = "\x1b[32;40m"};
+    size_t before = session->output.length - session->output.sent;
+    int columns = arcade->game_size.x;
+    int rows = arcade->game_size.y;
+    char sequence[32];
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < columns; x++) {
+            Cell cell = arcade->frame[y * columns + x];
+            if (cell == session->shown[y * columns + x])
+                continue;
+            session->shown[y * columns + x] = cell;
+            if (session->cursor_x != x || session->cursor_y != y) {
+                int length = sprintf(sequence, "\x1b[%d;%dH", y + 1, x + 1);
+                if (!appendOutput(session, sequence, (size_t) length))
+                    return -1;
+            }
+            int color = cell >> 8;
+            if (session->color != color) {
+                if (!appendOutput(session, colors[color], strlen(colors[color])))
+                    return -1;
+                session->color = color;
+            }
+            char character = (char) (cell & 0xFF);
+            const char * glyph = character >= ' ' ? &character : glyphs[(int) character];
+            if (!appendOutput(session, glyph, character >= ' ' ? 1 : strlen(glyph)))
+                return -1;
+            // The cursor stays on the last column until the next character
+            session->cursor_x = x + 1 < columns ? x + 1 : -1;
+            session->cursor_y = y;
+        }
+    }
+    return (long) (session->output.length - session->output.sent - before);
+}
+
+static void drawText(Arcade * arcade, int x, int y, const char * text, CellColor color) {
+    int columns = arcade->game_size.x;
+    for (; *text != '\0' && x < columns; text++, x++) {
+        // Cells hold single bytes, the other characters of a nickname are drawn as '?'
+        unsigned char character = (unsigned char) *text;
+        if (character >= 0x80 && (character & 0xC0u) == 0x80) {
+            x--;
+            continue;
+        }
+        arcade->frame[y * columns + x] = (Cell) ((character < 0x80 ? character : '?') | color << 8);
+    }
+}
+
+static bool appendOutput(Session * session, const char * bytes, size_t length) {
+    OutputBuffer * output = &session->output;
+    if (output->length + length > output->capacity) {
+        size_t capacity = output->capacity > 0 ? output->capacity : 4096;
+        while (capacity < output->length + length)
+            capacity *= 2;
+        char * data = realloc(output->data, capacity);
+        if (data == NULL)
+            return false;
+        output->data = data;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->length, bytes, length);
+    output->length += length;
+    return true;
+}
+
+static bool flushOutput(Arcade * arcade, Session * session) {
+    OutputBuffer * output = &session->output;
+    while (output->sent < output->length) {
+        ssize_t sent = send(session->fd, output->data + output->sent, output->length - output->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+        output->sent += (size_t) sent;
+        arcade->bytes_sent += sent;
+    }
+    bool pending = output->sent < output->length;
+    if (!pending) {
+        output->length = output->sent = 0;
+        // The game over screen has been sent
+        if (session->state == SESSION_CLOSING)
+            return false;
+    } else if (output->length - output->sent > ARCADE_OUTPUT_LIMIT) {
+        // The client does not keep up with its frames
+        return false;
+    }
+    if (pending != session->waiting_to_write) {
+        struct epoll_event event = {.events = EPOLLIN | (pending ? EPOLLOUT : 0), .data.ptr = session};
+        if (epoll_ctl(arcade->epoll, EPOLL_CTL_MOD, session->fd, &event) != 0)
+            return false;
+        session->waiting_to_write = pending;
+    }
+    return true;
+}
+
+static void closeSession(Arcade * arcade, Session * session) {
+    cancelTimer(arcade->wheel, &session->timer);
+    close(session->fd);
+    if (session->snek.snake != NULL)
+        freeSnake(&session->snek);
+    free(session->snek.food);
+    free(session->shown);
+    free(session->output.data);
+    if (session->prev != NULL)
+        session->prev->next = session->next;
+    else
+        arcade->sessions = session->next;
+    if (session->next != NULL)
+        session->next->prev = session->prev;
+    arcade->open--;
+    free(session);
+}
+
+static void printUsage(const char * program) {
+    fprintf(stderr, "Usage: %s [--socket PATH] [--columns N] [--rows N] [--tick-ms N]\n", program);
+}
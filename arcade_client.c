@@ -0,0 +1,301 @@
+/**
+ * Scripted clients of the arcade server, for testing it locally under load.
+ * Every client connects, types a nickname and presses random control keys,
+ * and connects again when the server closes its finished game. The output of
+ * the server is read and counted, but not interpreted. All clients run in a
+ * single thread, driven by an epoll loop and a timer wheel like the server.
+ * \file arcade_client.c
+ * \author hexadec
+ * \brief This file contains the scripted clients of the arcade server
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "timerwheel.h"
+#include "allocator.h"
+
+/** @brief Default path of the socket of the server, the same as the default of the server */
+#define CLIENT_DEFAULT_SOCKET "/tmp/snek_arcade.sock"
+
+/** @brief Default number of clients */
+#define CLIENT_DEFAULT_CLIENTS 100
+
+/** @brief Default duration of the run, in seconds */
+#define CLIENT_DEFAULT_SECONDS 10
+
+/** @brief Default mean time between two keys of a client */
+#define CLIENT_DEFAULT_KEY_MS 1000
+
+/** @brief Time before connecting again after a game, or after a failed connection */
+#define CLIENT_RECONNECT_NS 10000000LL
+
+/** @brief Most events handled by one call of \p epoll_wait */
+#define CLIENT_MAX_EVENTS 256
+
+/**
+ * @brief A scripted player
+ */
+typedef struct Client {
+    /** @brief Socket of the client, -1 if not connected */
+    int fd;
+    /** @brief Number of the client, part of its nickname */
+    int index;
+    /** @brief Next key to press, or next connection attempt if not connected */
+    Timer timer;
+    /** @brief State of the random generator of the keys */
+    unsigned seed;
+} Client;
+
+/**
+ * @brief Settings and totals of a run
+ */
+typedef struct Clients {
+    /** @brief The epoll instance */
+    int epoll;
+    /** @brief Timer wheel of the keys and connections of every client */
+    TimerWheel * wheel;
+    /** @brief Address of the server */
+    struct sockaddr_un address;
+    /** @brief Mean time between two keys of a client */
+    long long key_ns;
+    /** @brief Sessions started */
+    long long sessions;
+    /** @brief Games finished, closed by the server */
+    long long games;
+    /** @brief Failed connection attempts */
+    long long connect_errors;
+    /** @brief Keys pressed */
+    long long keys;
+    /** @brief Bytes received from the server */
+    long long received;
+} Clients;
+
+/** @brief Set by the signal handler to stop the run early */
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * @brief Stops the run on \p SIGINT and \p SIGTERM
+ * @param signal code of received signal
+ */
+static void stopClients(int);
+
+/**
+ * On failure the client tries again later.
+ * @brief Connects a client to the server, and types its nickname
+ * @param clients the run
+ * @param client client to connect
+ */
+static void connectClient(Clients *, Client *);
+
+/**
+ * @brief Closes the connection of a client
+ * @param clients the run
+ * @param client the client
+ */
+static void disconnectClient(Clients *, Client *);
+
+/**
+ * @brief Reads everything the server has sent to a client
+ * @param clients the run
+ * @param client the client
+ * @return \p true if the connection is still open, \p false if the server has closed it
+ */
+static bool readClient(Clients *, Client *);
+
+/**
+ * @brief Callback of the timer wheel, presses a key or connects the client
+ * @param timer timer of the client
+ * @param context the run
+ */
+static void clientTimerExpired(Timer *, void *);
+
+/**
+ * @brief Time until the next key of a client
+ * @param clients the run
+ * @param client the client
+ * @return random time, between half and one and a half of the mean time
+ */
+static long long nextKeyDelay(const Clients *, Client *);
+
+/**
+ * @brief Prints the usage of the program
+ * @param program name of the executable
+ */
+static void printUsage(const char *);
+
+/**
+ * \p --socket sets the path of the socket of the server, \p --clients the number of
+ * clients, \p --seconds the duration of the run, and \p --key-ms the mean time
+ * between two keys of a client. A summary is printed at the end of the run.
+ * @brief Entry point of the scripted clients
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @return 0 on success, 1 on wrong arguments, -3 if there is not enough memory
+ */
+int main(int argc, char ** argv) {
+    const char * path = CLIENT_DEFAULT_SOCKET;
+    long count = CLIENT_DEFAULT_CLIENTS;
+    long seconds = CLIENT_DEFAULT_SECONDS;
+    long key_ms = CLIENT_DEFAULT_KEY_MS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--key-ms") == 0 && i + 1 < argc) {
+            key_ms = atol(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    Clients clients;
+    memset(&clients, 0, sizeof(Clients));
+    clients.address.sun_family = AF_UNIX;
+    if (count < 1 || seconds < 1 || key_ms < 1 || strlen(path) >= sizeof(clients.address.sun_path)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    strcpy(clients.address.sun_path, path);
+    clients.key_ns = key_ms * 1000000LL;
+    // Every client takes a descriptor
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    struct sigaction handler;
+    memset(&handler, 0, sizeof(struct sigaction));
+    handler.sa_handler = stopClients;
+    sigaction(SIGINT, &handler, NULL);
+    sigaction(SIGTERM, &handler, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    Client * players = calloc(count, sizeof(Client));
+    clients.wheel = createTimerWheel(1024, 1000000LL);
+    clients.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (players == NULL || clients.wheel == NULL || clients.epoll < 0) {
+        free(players);
+        freeTimerWheel(clients.wheel);
+        if (clients.epoll >= 0)
+            close(clients.epoll);
+        fprintf(stderr, "Couldn't allocate memory\n");
+        return -3;
+    }
+    for (long i = 0; i < count; i++) {
+        players[i].fd = -1;
+        players[i].index = (int) i;
+        players[i].seed = (unsigned) i * 2654435761u + 1;
+        connectClient(&clients, &players[i]);
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    now = start;
+    struct epoll_event events[CLIENT_MAX_EVENTS];
+    while (!stopping && (now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec) < seconds * 1000000000LL) {
+        int ready = epoll_wait(clients.epoll, events, CLIENT_MAX_EVENTS, nextTimerTimeout(clients.wheel));
+        for (int i = 0; i < ready; i++) {
+            Client * client = events[i].data.ptr;
+            if (!readClient(&clients, client)) {
+                clients.games++;
+                disconnectClient(&clients, client);
+                scheduleTimer(clients.wheel, &client->timer, CLIENT_RECONNECT_NS);
+            }
+        }
+        advanceTimerWheel(clients.wheel, clientTimerExpired, &clients);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+    double elapsed = (double) (now.tv_sec - start.tv_sec) + (double) (now.tv_nsec - start.tv_nsec) / 1E9;
+
+    for (long i = 0; i < count; i++) {
+        cancelTimer(clients.wheel, &players[i].timer);
+        disconnectClient(&clients, &players[i]);
+    }
+    close(clients.epoll);
+    freeTimerWheel(clients.wheel);
+    free(players);
+    printf("clients: %ld\nsessions: %lld\ngames: %lld\nconnect errors: %lld\nkeys: %lld\nbytes received: %lld\n"
+           "seconds: %.3f\nbytes per second: %.0f\n",
+           count, clients.sessions, clients.games, clients.connect_errors, clients.keys, clients.received,
+           elapsed, elapsed > 0 ? (double) clients.received / elapsed : 0.0);
+    return 0;
+}
+
+static void stopClients(int signal) {
+    (void) signal;
+    stopping = 1;
+}
+
+static void connectClient(Clients * clients, Client * client) {
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // A full backlog refuses non-blocking connections with EAGAIN, that is retried as well
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *) &clients->address, sizeof(clients->address)) != 0) {
+        clients->connect_errors++;
+        disconnectClient(clients, client);
+        scheduleTimer(clients->wheel, &client->timer, CLIENT_RECONNECT_NS);
+        return;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+    char nick[32];
+    int length = snprintf(nick, sizeof(nick), "bot%d\r", client->index);
+    if (epoll_ctl(clients->epoll, EPOLL_CTL_ADD, client->fd, &event) != 0
+        || send(client->fd, nick, (size_t) length, MSG_NOSIGNAL) != length) {
+        clients->connect_errors++;
+        disconnectClient(clients, client);
+        scheduleTimer(clients->wheel, &client->timer, CLIENT_RECONNECT_NS);
+        return;
+    }
+    clients->sessions++;
+    scheduleTimer(clients->wheel, &client->timer, nextKeyDelay(clients, client));
+}
+
+static void disconnectClient(Clients * clients, Client * client) {
+    (void) clients;
+    if (client->fd >= 0)
+        close(client->fd);
+    client->fd = -1;
+}
+
+static bool readClient(Clients * clients, Client * client) {
+    char buffer[4096];
+    ssize_t length;
+    while ((length = read(client->fd, buffer, sizeof(buffer))) > 0)
+        clients->received += length;
+    return length < 0 && (errno == EAGAIN || errno == EINTR);
+}
+
+static void clientTimerExpired(Timer * timer, void * context) {
+    Clients * clients = context;
+    Client * client = (Client *) ((char *) timer - offsetof(Client, timer));
+    if (client->fd < 0) {
+        connectClient(clients, client);
+        return;
+    }
+    static const char keys[] = "wasd";
+    char key = keys[rand_r(&client->seed) % 4];
+    // The server closing the connection is noticed by the next read
+    if (send(client->fd, &key, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == 1)
+        clients->keys++;
+    scheduleTimer(clients->wheel, &client->timer, nextKeyDelay(clients, client));
+}
+
+static long long nextKeyDelay(const Clients * clients, Client * client) {
+    return clients->key_ns / 2 + (long long) ((double) rand_r(&client->seed) / RAND_MAX * (double) clients->key_ns);
+}
+
+static void printUsage(const char * program) {
+    fprintf(stderr, "Usage: %s [--socket PATH] [--clients N] [--seconds N] [--key-ms N]\n", program);
+}
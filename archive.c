@@ -0,0 +1,819 @@
+/**
+ * The archive stores every finished game with its metadata. New games are appended
+ * as fixed size rows to a staging file, with the same single \p O_APPEND write
+ * as \p saveScore. When enough of them have been collected, they are compacted into
+ * a block of the archive file, where each column is stored separately:
+ * nicknames as a block-local dictionary, timestamps as zigzag varint deltas,
+ * every other column as zigzag varints. The block header holds the minimum,
+ * the maximum, the location and the CRC-32 of each column, so readers can skip
+ * blocks by their statistics and read only the columns they need.
+ * Values are stored in host byte order, the archive is not meant to be moved between hosts.
+ * \file archive.c
+ * \author hexadec
+ * \brief This file contains the columnar score archive
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "allocator.h"
+
+/** @brief Identifies a block of the archive ("SNKB") */
+#define ARCHIVE_MAGIC 0x424B4E53u
+
+/** @brief Maximum length of a varint encoded 64 bit value */
+#define VARINT_MAX_SIZE 10
+
+/**
+ * @brief Row of the staging file
+ */
+typedef struct {
+    /** @brief Nickname, truncated to \p NICK_MAX_LENGTH characters */
+    char nick[NICK_MAX_LENGTH + 1];
+    /** @brief End of the game, seconds since the epoch */
+    int64_t timestamp;
+    /** @brief Score, duration, ticks, width, height and food eaten */
+    int32_t values[6];
+} PendingRow;
+
+/**
+ * @brief Location and statistics of a column in a block
+ */
+typedef struct {
+    /** @brief Smallest value (0 for nicknames) */
+    int64_t min;
+    /** @brief Largest value (0 for nicknames) */
+    int64_t max;
+    /** @brief Offset of the column from the end of the block header */
+    uint32_t offset;
+    /** @brief Size of the encoded column in bytes */
+    uint32_t size;
+    /** @brief CRC-32 of the encoded column */
+    uint32_t checksum;
+    /** @brief Unused, keeps the header aligned */
+    uint32_t reserved;
+} ColumnHeader;
+
+/**
+ * @brief Header of a block, followed by the encoded columns
+ */
+typedef struct {
+    /** @brief \p ARCHIVE_MAGIC */
+    uint32_t magic;
+    /** @brief Number of games in the block */
+    uint32_t rows;
+    /** @brief Size of the encoded columns following the header */
+    uint32_t payload_size;
+    /** @brief CRC-32 of the column headers */
+    uint32_t checksum;
+    /** @brief Column headers, indexed by \p ArchiveColumn */
+    ColumnHeader columns[ARCHIVE_COLUMNS];
+} BlockHeader;
+
+/**
+ * @brief Growing byte buffer used while encoding a block
+ */
+typedef struct {
+    /** @brief Buffer contents */
+    unsigned char * data;
+    /** @brief Number of bytes used */
+    size_t size;
+    /** @brief Number of bytes allocated */
+    size_t capacity;
+} ByteBuffer;
+
+/**
+ * @brief Makes room for more bytes in a buffer
+ * @param buffer buffer to grow
+ * @param extra number of bytes that will be appended
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool reserveBytes(ByteBuffer * buffer, size_t extra);
+
+/**
+ * @brief Appends a zigzag varint to a buffer, which must have room for it
+ * @param buffer buffer to append to
+ * @param value value to encode
+ */
+static void putVarint(ByteBuffer * buffer, int64_t value);
+
+/**
+ * @brief Decodes a zigzag varint
+ * @param position read position, advanced past the value
+ * @param end end of the readable bytes
+ * @param value set to the decoded value
+ * @return \p true on success, \p false if the value is truncated
+ */
+static bool getVarint(const unsigned char ** position, const unsigned char * end, int64_t * value);
+
+/**
+ * @brief Calculates the CRC-32 (IEEE 802.3) of a byte range
+ * @param data bytes to check
+ * @param size number of bytes
+ * @return checksum
+ */
+static uint32_t crc32(const unsigned char * data, size_t size);
+
+/**
+ * @brief Reads a numeric column of a staged row
+ * @param row row to read
+ * @param column numeric column
+ * @return value of the column
+ */
+static int64_t pendingValue(const PendingRow * row, ArchiveColumn column);
+
+/**
+ * Encodes the staged rows as a block and appends it to the archive,
+ * the caller must hold an exclusive lock on the staging file.
+ * @brief Compacts staged rows into a block
+ * @param fd the archive file, opened for appending
+ * @param rows rows to compact
+ * @param count number of rows
+ * @return 0 on success, -1 on failure
+ */
+static int writeBlock(int fd, const PendingRow * rows, uint32_t count);
+
+/**
+ * @brief Reads a block header and checks that the whole block fits in the file
+ * @param fd the archive file
+ * @param offset offset of the header
+ * @param file_size size of the archive file
+ * @param header header to fill
+ * @return \p true if a valid block starts at \p offset
+ */
+static bool readBlockHeader(int fd, off_t offset, off_t file_size, BlockHeader * header);
+
+/**
+ * Blocks are not aligned, so the file is searched byte by byte for \p ARCHIVE_MAGIC,
+ * and every match is checked as a header.
+ * @brief Finds the next valid block after a damaged one
+ * @param fd the archive file
+ * @param offset first offset to check
+ * @param file_size size of the archive file
+ * @return offset of the next valid block, -1 if there is none
+ */
+static off_t findNextBlock(int fd, off_t offset, off_t file_size);
+
+/**
+ * A torn or corrupt block is skipped by searching for the next valid header,
+ * so it does not hide the blocks appended after it.
+ * @brief Walks the valid blocks of the archive file
+ * @param fd the archive file
+ * @param file_size size of the archive file
+ * @param reader reader to add the blocks to, \p NULL to only find the end
+ * @param last set to the offset of the last valid block, -1 if there is none
+ * @return end of the last valid block, -1 on allocation failure
+ */
+static off_t scanArchive(int fd, off_t file_size, ArchiveReader * reader, off_t * last);
+
+/**
+ * A compaction that crashed, or failed to empty the staging file, leaves the games
+ * it has written to the archive staged as well. They are at the start of the
+ * staging file and the last block of the archive holds the last of them,
+ * so comparing that block with the staged rows finds how many are archived already.
+ * @brief Counts the staged games that are already in the archive
+ * @param archive descriptor of the archive file
+ * @param last offset of the last valid block of the archive, -1 if there is none
+ * @param fd descriptor of the staging file
+ * @param total number of staged rows
+ * @return number of staged rows already archived, -1 on failure
+ */
+static off_t countArchivedRows(int archive, off_t last, int fd, off_t total);
+
+/**
+ * Encodes the nicknames of a block as a dictionary of the distinct names
+ * (count, then length-prefixed strings) followed by one dictionary index per game.
+ * @brief Appends the nickname column of a block to a buffer
+ * @param buffer buffer to append to
+ * @param rows rows of the block
+ * @param count number of rows, at most \p ARCHIVE_BLOCK_ROWS
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool encodeNicks(ByteBuffer * buffer, const PendingRow * rows, uint32_t count);
+
+/**
+ * @brief Decodes the nickname column of a block into a batch
+ * @param cursor read position, advanced past the column
+ * @param end end of the column
+ * @param rows number of games in the block
+ * @param batch batch with room for \p rows nicknames
+ * @return \p true on success, \p false if the column is malformed
+ */
+static bool decodeNicks(const unsigned char ** cursor, const unsigned char * end, uint32_t rows, ArchiveBatch * batch);
+
+/**
+ * @brief Decodes a numeric column of a block
+ * @param cursor read position, advanced past the column
+ * @param end end of the column
+ * @param rows number of games in the block
+ * @param delta the column is delta encoded
+ * @param values array of \p rows items to fill
+ * @return \p true on success, \p false if the column is malformed
+ */
+static bool decodeValues(const unsigned char ** cursor, const unsigned char * end, uint32_t rows, bool delta, int64_t * values);
+
+/**
+ * @brief Compacts the staging file if it holds enough rows
+ * @param fd descriptor of the staging file
+ */
+static void compactPending(int fd);
+
+/**
+ * @brief Makes sure a batch can hold the given number of games in the requested columns
+ * @param batch batch to grow
+ * @param rows number of games
+ * @param columns mask of the requested columns
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool reserveBatch(ArchiveBatch * batch, uint32_t rows, unsigned columns);
+
+/**
+ * @brief Reads staged rows into a new pseudo-block of the reader
+ * @param reader reader to add the block to
+ * @param fd descriptor of the staging file
+ * @param first index of the first row to read
+ * @param count number of rows to read
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool addPendingBlock(ArchiveReader * reader, int fd, off_t first, uint32_t count);
+
+/**
+ * @brief Fills a batch from the staged rows of a pseudo-block
+ * @param block pseudo-block holding the rows
+ * @param columns mask of the requested columns
+ * @param batch batch to fill
+ * @return 0 on success, -1 on allocation failure
+ */
+static int readPendingBlock(const ArchiveBlock * block, unsigned columns, ArchiveBatch * batch);
+
+static const char archive_file[] = "scores.archive";
+static const char pending_file[] = "scores.pending";
+
+static bool reserveBytes(ByteBuffer * buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity)
+        return true;
+    size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+    while (capacity < buffer->size + extra)
+        capacity *= 2;
+    unsigned char * data = realloc(buffer->data, capacity);
+    if (data == NULL)
+        return false;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static void putVarint(ByteBuffer * buffer, int64_t value) {
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    while (zigzag >= 0x80) {
+        buffer->data[buffer->size++] = (unsigned char) (zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    buffer->data[buffer->size++] = (unsigned char) zigzag;
+}
+
+static bool getVarint(const unsigned char ** position, const unsigned char * end, int64_t * value) {
+    uint64_t zigzag = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*position >= end)
+            return false;
+        unsigned char byte = *(*position)++;
+        zigzag |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t crc32(const unsigned char * data, size_t size) {
+    static uint32_t table[256];
+    static bool initialised = false;
+    if (!initialised) {
+        // Racing threads compute the same table, so this is harmless
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            table[i] = crc;
+        }
+        __atomic_store_n(&initialised, true, __ATOMIC_RELEASE);
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static int64_t pendingValue(const PendingRow * row, ArchiveColumn column) {
+    if (column == ARCHIVE_TIMESTAMP)
+        return row->timestamp;
+    if (column == ARCHIVE_SCORE)
+        return row->values[0];
+    // Duration, ticks, width, height and food follow each other
+    return row->values[column - ARCHIVE_DURATION + 1];
+}
+
+int appendArchiveRecord(const GameRecord * game) {
+    PendingRow row;
+    memset(&row, 0, sizeof(PendingRow));
+    strncat(row.nick, game->nick, NICK_MAX_LENGTH);
+    row.timestamp = game->timestamp;
+    int32_t values[6] = {game->score, game->duration_ms, game->ticks, game->width, game->height, game->food_eaten};
+    memcpy(row.values, values, sizeof(values));
+
+    int fd = open(pending_file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    // Appenders share the lock, only compaction needs it exclusively
+    while (flock(fd, LOCK_SH) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    ssize_t written;
+    do {
+        written = write(fd, &row, sizeof(PendingRow));
+    } while (written < 0 && errno == EINTR);
+    struct stat info;
+    bool full = fstat(fd, &info) == 0 && info.st_size >= (off_t) (ARCHIVE_BLOCK_ROWS * sizeof(PendingRow));
+    flock(fd, LOCK_UN);
+    if (written == (ssize_t) sizeof(PendingRow) && full)
+        compactPending(fd);
+    close(fd);
+    return written == (ssize_t) sizeof(PendingRow) ? 0 : -1;
+}
+
+static void compactPending(int fd) {
+    // Another process is already compacting, or reading, if the lock is taken
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+        return;
+    struct stat info;
+    int archive = -1;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t) (ARCHIVE_BLOCK_ROWS * sizeof(PendingRow)))
+        archive = open(archive_file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (archive >= 0) {
+        off_t total = info.st_size / (off_t) sizeof(PendingRow);
+        PendingRow * rows = malloc(ARCHIVE_BLOCK_ROWS * sizeof(PendingRow));
+        struct stat archive_info;
+        bool success = rows != NULL && fstat(archive, &archive_info) == 0;
+        // The tail torn by an earlier crash is cut off, or the new blocks would follow it
+        off_t last;
+        off_t end = success ? scanArchive(archive, archive_info.st_size, NULL, &last) : -1;
+        if (end < 0 || (end < archive_info.st_size && ftruncate(archive, end) != 0))
+            success = false;
+        // Games archived by an interrupted compaction are skipped, not written again
+        off_t archived = success ? countArchivedRows(archive, last, fd, total) : -1;
+        success = archived >= 0;
+        // Every block is at most ARCHIVE_BLOCK_ROWS long, even if compaction has been failing
+        for (off_t first = archived; success && first < total; first += ARCHIVE_BLOCK_ROWS) {
+            uint32_t count = total - first < ARCHIVE_BLOCK_ROWS ? (uint32_t) (total - first) : ARCHIVE_BLOCK_ROWS;
+            success = pread(fd, rows, count * sizeof(PendingRow), first * (off_t) sizeof(PendingRow)) == (ssize_t) (count * sizeof(PendingRow))
+                      && writeBlock(archive, rows, count) == 0;
+        }
+        // A crash or failure before this point is undone by the next compaction or reader
+        if (success && ftruncate(fd, 0) != 0)
+            success = false;
+        free(rows);
+        close(archive);
+    }
+    flock(fd, LOCK_UN);
+}
+
+static bool encodeNicks(ByteBuffer * buffer, const PendingRow * rows, uint32_t count) {
+    // Open addressing table of row indices, twice the block size keeps it at most half full
+    enum { TABLE_SIZE = 2 * ARCHIVE_BLOCK_ROWS };
+    int32_t * table = malloc(TABLE_SIZE * sizeof(int32_t));
+    uint32_t * ids = malloc(count * sizeof(uint32_t));
+    uint32_t * firsts = malloc(count * sizeof(uint32_t));
+    if (table == NULL || ids == NULL || firsts == NULL || !reserveBytes(buffer, (size_t) count * (2 * VARINT_MAX_SIZE + NICK_MAX_LENGTH))) {
+        free(table);
+        free(ids);
+        free(firsts);
+        return false;
+    }
+    memset(table, -1, TABLE_SIZE * sizeof(int32_t));
+    uint32_t distinct = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t hash = 2166136261u;
+        for (const char * c = rows[i].nick; *c != '\0' && c < rows[i].nick + NICK_MAX_LENGTH; c++)
+            hash = (hash ^ (unsigned char) *c) * 16777619u;
+        uint32_t slot = hash & (TABLE_SIZE - 1);
+        while (table[slot] >= 0 && strncmp(rows[firsts[table[slot]]].nick, rows[i].nick, NICK_MAX_LENGTH) != 0)
+            slot = (slot + 1) & (TABLE_SIZE - 1);
+        if (table[slot] < 0) {
+            table[slot] = (int32_t) distinct;
+            firsts[distinct++] = i;
+        }
+        ids[i] = (uint32_t) table[slot];
+    }
+    putVarint(buffer, distinct);
+    for (uint32_t i = 0; i < distinct; i++) {
+        size_t length = strnlen(rows[firsts[i]].nick, NICK_MAX_LENGTH);
+        putVarint(buffer, (int64_t) length);
+        memcpy(buffer->data + buffer->size, rows[firsts[i]].nick, length);
+        buffer->size += length;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        putVarint(buffer, ids[i]);
+    free(table);
+    free(ids);
+    free(firsts);
+    return true;
+}
+
+static int writeBlock(int fd, const PendingRow * rows, uint32_t count) {
+    BlockHeader header;
+    memset(&header, 0, sizeof(BlockHeader));
+    header.magic = ARCHIVE_MAGIC;
+    header.rows = count;
+    ByteBuffer buffer = {NULL, 0, 0};
+    if (!reserveBytes(&buffer, sizeof(BlockHeader))) return -1;
+    buffer.size = sizeof(BlockHeader);
+
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        ColumnHeader * column_header = &header.columns[column];
+        column_header->offset = (uint32_t) (buffer.size - sizeof(BlockHeader));
+        if (column == ARCHIVE_NICK) {
+            if (!encodeNicks(&buffer, rows, count)) {
+                free(buffer.data);
+                return -1;
+            }
+        } else {
+            if (!reserveBytes(&buffer, (size_t) count * VARINT_MAX_SIZE)) {
+                free(buffer.data);
+                return -1;
+            }
+            int64_t previous = 0;
+            column_header->min = column_header->max = pendingValue(&rows[0], column);
+            for (uint32_t i = 0; i < count; i++) {
+                int64_t value = pendingValue(&rows[i], column);
+                if (value < column_header->min) column_header->min = value;
+                if (value > column_header->max) column_header->max = value;
+                // Games end in roughly increasing order, so timestamp deltas are small
+                putVarint(&buffer, column == ARCHIVE_TIMESTAMP ? value - previous : value);
+                previous = value;
+            }
+        }
+        column_header->size = (uint32_t) (buffer.size - sizeof(BlockHeader) - column_header->offset);
+        column_header->checksum = crc32(buffer.data + sizeof(BlockHeader) + column_header->offset, column_header->size);
+    }
+    header.payload_size = (uint32_t) (buffer.size - sizeof(BlockHeader));
+    header.checksum = crc32((const unsigned char *) header.columns, sizeof(header.columns));
+    memcpy(buffer.data, &header, sizeof(BlockHeader));
+
+    int result = write(fd, buffer.data, buffer.size) == (ssize_t) buffer.size && fdatasync(fd) == 0 ? 0 : -1;
+    free(buffer.data);
+    return result;
+}
+
+static bool readBlockHeader(int fd, off_t offset, off_t file_size, BlockHeader * header) {
+    return offset + (off_t) sizeof(BlockHeader) <= file_size
+           && pread(fd, header, sizeof(BlockHeader), offset) == (ssize_t) sizeof(BlockHeader)
+           && header->magic == ARCHIVE_MAGIC
+           && header->checksum == crc32((const unsigned char *) header->columns, sizeof(header->columns))
+           && offset + (off_t) sizeof(BlockHeader) + header->payload_size <= file_size;
+}
+
+static off_t findNextBlock(int fd, off_t offset, off_t file_size) {
+    uint32_t magic = ARCHIVE_MAGIC;
+    unsigned char chunk[65536];
+    BlockHeader header;
+    while (offset + (off_t) sizeof(BlockHeader) <= file_size) {
+        ssize_t size = pread(fd, chunk, sizeof(chunk), offset);
+        if (size < (ssize_t) sizeof(magic))
+            return -1;
+        for (ssize_t i = 0; i + (ssize_t) sizeof(magic) <= size; i++) {
+            if (memcmp(chunk + i, &magic, sizeof(magic)) == 0 && readBlockHeader(fd, offset + i, file_size, &header))
+                return offset + i;
+        }
+        // The last bytes of the chunk may start a magic cut in two
+        offset += size - (ssize_t) sizeof(magic) + 1;
+    }
+    return -1;
+}
+
+static off_t scanArchive(int fd, off_t file_size, ArchiveReader * reader, off_t * last) {
+    size_t capacity = 0;
+    off_t offset = 0;
+    off_t end = 0;
+    BlockHeader header;
+    *last = -1;
+    while (offset >= 0 && offset + (off_t) sizeof(BlockHeader) <= file_size) {
+        if (!readBlockHeader(fd, offset, file_size, &header)) {
+            offset = findNextBlock(fd, offset + 1, file_size);
+            continue;
+        }
+        if (reader != NULL) {
+            if (reader->block_count == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                ArchiveBlock * blocks = realloc(reader->blocks, capacity * sizeof(ArchiveBlock));
+                if (blocks == NULL)
+                    return -1;
+                reader->blocks = blocks;
+            }
+            ArchiveBlock * block = &reader->blocks[reader->block_count++];
+            block->offset = offset;
+            block->rows = header.rows;
+            block->pending = NULL;
+            for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+                block->min[column] = header.columns[column].min;
+                block->max[column] = header.columns[column].max;
+            }
+        }
+        *last = offset;
+        offset += (off_t) sizeof(BlockHeader) + header.payload_size;
+        end = offset;
+    }
+    return end;
+}
+
+static off_t countArchivedRows(int archive, off_t last, int fd, off_t total) {
+    if (last < 0)
+        return 0;
+    ArchiveBlock block = {.offset = last, .pending = NULL};
+    ArchiveReader reader = {.fd = archive, .block_count = 1, .blocks = &block};
+    ArchiveBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    PendingRow * rows = NULL;
+    off_t archived = -1;
+    if (readArchiveBlock(&reader, 0, ARCHIVE_COLUMN_BIT(ARCHIVE_COLUMNS) - 1, &batch) == 0
+        && batch.rows <= ARCHIVE_BLOCK_ROWS && (rows = malloc(ARCHIVE_BLOCK_ROWS * sizeof(PendingRow))) != NULL) {
+        archived = 0;
+        // Compaction writes blocks of ARCHIVE_BLOCK_ROWS games, starting at the first staged row
+        for (off_t first = 0; archived == 0 && first + batch.rows <= total; first += ARCHIVE_BLOCK_ROWS) {
+            size_t size = batch.rows * sizeof(PendingRow);
+            if (batch.rows == 0 || pread(fd, rows, size, first * (off_t) sizeof(PendingRow)) != (ssize_t) size)
+                break;
+            uint32_t row = 0;
+            for (; row < batch.rows; row++) {
+                if (strncmp(batch.nicks[row], rows[row].nick, NICK_MAX_LENGTH + 1) != 0)
+                    break;
+                int column = ARCHIVE_SCORE;
+                while (column < ARCHIVE_COLUMNS && batch.values[column][row] == pendingValue(&rows[row], column))
+                    column++;
+                if (column < ARCHIVE_COLUMNS)
+                    break;
+            }
+            if (row == batch.rows)
+                archived = first + batch.rows;
+        }
+    }
+    free(rows);
+    freeArchiveBatch(&batch);
+    return archived;
+}
+
+ArchiveReader * openArchive() {
+    ArchiveReader * reader = malloc(sizeof(ArchiveReader));
+    if (reader == NULL)
+        return NULL;
+    reader->block_count = 0;
+    reader->blocks = NULL;
+    // Holding the lock of the staging file keeps compaction from moving games
+    // from it into the archive between the two reads, so none is missed or counted twice
+    int fd = open(pending_file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0)
+        flock(fd, LOCK_SH);
+    reader->fd = open(archive_file, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    off_t file_size = reader->fd >= 0 && fstat(reader->fd, &info) == 0 ? info.st_size : 0;
+    off_t last;
+    bool success = scanArchive(reader->fd, file_size, reader, &last) >= 0;
+
+    // Games that have not been compacted yet form pseudo-blocks at the end
+    if (fd >= 0) {
+        off_t total = success && fstat(fd, &info) == 0 ? info.st_size / (off_t) sizeof(PendingRow) : 0;
+        off_t archived = total > 0 ? countArchivedRows(reader->fd, last, fd, total) : 0;
+        success = success && archived >= 0;
+        for (off_t first = archived; first < total && success; first += ARCHIVE_BLOCK_ROWS) {
+            uint32_t count = total - first < ARCHIVE_BLOCK_ROWS ? (uint32_t) (total - first) : ARCHIVE_BLOCK_ROWS;
+            success = addPendingBlock(reader, fd, first, count);
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+    if (!success) {
+        closeArchive(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+static bool addPendingBlock(ArchiveReader * reader, int fd, off_t first, uint32_t count) {
+    ArchiveBlock * blocks = realloc(reader->blocks, (reader->block_count + 1) * sizeof(ArchiveBlock));
+    if (blocks == NULL)
+        return false;
+    reader->blocks = blocks;
+    PendingRow * rows = malloc(count * sizeof(PendingRow));
+    if (rows == NULL)
+        return false;
+    ssize_t size = pread(fd, rows, count * sizeof(PendingRow), first * (off_t) sizeof(PendingRow));
+    count = size > 0 ? (uint32_t) (size / (ssize_t) sizeof(PendingRow)) : 0;
+    ArchiveBlock * block = &reader->blocks[reader->block_count++];
+    block->offset = -1;
+    block->rows = count;
+    block->pending = rows;
+    block->min[ARCHIVE_NICK] = block->max[ARCHIVE_NICK] = 0;
+    for (int column = ARCHIVE_SCORE; column < ARCHIVE_COLUMNS; column++) {
+        block->min[column] = count > 0 ? pendingValue(&rows[0], column) : 0;
+        block->max[column] = block->min[column];
+        for (uint32_t i = 1; i < count; i++) {
+            int64_t value = pendingValue(&rows[i], column);
+            if (value < block->min[column]) block->min[column] = value;
+            if (value > block->max[column]) block->max[column] = value;
+        }
+    }
+    return true;
+}
+
+bool archiveBlockMayMatch(const ArchiveBlock * block, const ArchiveFilter * filters, int filter_count) {
+    for (int i = 0; i < filter_count; i++) {
+        if (block->max[filters[i].column] < filters[i].min || block->min[filters[i].column] > filters[i].max)
+            return false;
+    }
+    return true;
+}
+
+static bool reserveBatch(ArchiveBatch * batch, uint32_t rows, unsigned columns) {
+    if (rows > batch->capacity) {
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            free(batch->values[column]);
+            batch->values[column] = NULL;
+        }
+        free(batch->nicks);
+        batch->nicks = NULL;
+        batch->capacity = rows;
+    }
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        if (column == ARCHIVE_NICK) {
+            if ((columns & ARCHIVE_COLUMN_BIT(column)) && batch->nicks == NULL) {
+                batch->nicks = malloc(batch->capacity * sizeof(char *));
+                if (batch->nicks == NULL)
+                    return false;
+            }
+        } else if ((columns & ARCHIVE_COLUMN_BIT(column)) && batch->values[column] == NULL) {
+            batch->values[column] = malloc(batch->capacity * sizeof(int64_t));
+            if (batch->values[column] == NULL)
+                return false;
+        }
+    }
+    size_t nick_size = (size_t) rows * (NICK_MAX_LENGTH + 1);
+    if ((columns & ARCHIVE_COLUMN_BIT(ARCHIVE_NICK)) && batch->nick_capacity < nick_size) {
+        char * nick_data = realloc(batch->nick_data, nick_size);
+        if (nick_data == NULL)
+            return false;
+        batch->nick_data = nick_data;
+        batch->nick_capacity = nick_size;
+    }
+    return true;
+}
+
+static int readPendingBlock(const ArchiveBlock * block, unsigned columns, ArchiveBatch * batch) {
+    const PendingRow * rows = block->pending;
+    if (!reserveBatch(batch, block->rows, columns))
+        return -1;
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        if (!(columns & ARCHIVE_COLUMN_BIT(column)))
+            continue;
+        for (uint32_t i = 0; i < block->rows; i++) {
+            if (column == ARCHIVE_NICK) {
+                batch->nicks[i] = batch->nick_data + (size_t) i * (NICK_MAX_LENGTH + 1);
+                memcpy(batch->nicks[i], rows[i].nick, NICK_MAX_LENGTH + 1);
+                batch->nicks[i][NICK_MAX_LENGTH] = '\0';
+            } else {
+                batch->values[column][i] = pendingValue(&rows[i], column);
+            }
+        }
+    }
+    batch->rows = block->rows;
+    return 0;
+}
+
+int readArchiveBlock(const ArchiveReader * reader, size_t index, unsigned columns, ArchiveBatch * batch) {
+    const ArchiveBlock * block = &reader->blocks[index];
+    batch->rows = 0;
+    if (block->offset < 0)
+        return readPendingBlock(block, columns, batch);
+    BlockHeader header;
+    if (pread(reader->fd, &header, sizeof(BlockHeader), block->offset) != (ssize_t) sizeof(BlockHeader))
+        return -1;
+    if (!reserveBatch(batch, header.rows, columns))
+        return -1;
+
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        if (!(columns & ARCHIVE_COLUMN_BIT(column)))
+            continue;
+        const ColumnHeader * column_header = &header.columns[column];
+        unsigned char * data = malloc(column_header->size > 0 ? column_header->size : 1);
+        if (data == NULL)
+            return -1;
+        off_t position = block->offset + (off_t) sizeof(BlockHeader) + column_header->offset;
+        if (pread(reader->fd, data, column_header->size, position) != (ssize_t) column_header->size
+            || crc32(data, column_header->size) != column_header->checksum) {
+            free(data);
+            return -1;
+        }
+        const unsigned char * cursor = data;
+        const unsigned char * end = data + column_header->size;
+        bool valid = column == ARCHIVE_NICK
+                ? decodeNicks(&cursor, end, header.rows, batch)
+                : decodeValues(&cursor, end, header.rows, column == ARCHIVE_TIMESTAMP, batch->values[column]);
+        if (!valid) {
+            free(data);
+            return -1;
+        }
+        free(data);
+    }
+    batch->rows = header.rows;
+    return 0;
+}
+
+static bool decodeNicks(const unsigned char ** cursor, const unsigned char * end, uint32_t rows, ArchiveBatch * batch) {
+    int64_t distinct;
+    if (!getVarint(cursor, end, &distinct) || distinct < 0 || distinct > rows)
+        return false;
+    // The dictionary is stored in the nickname storage, games point into it
+    for (int64_t i = 0; i < distinct; i++) {
+        int64_t length;
+        if (!getVarint(cursor, end, &length) || length < 0 || length > NICK_MAX_LENGTH || end - *cursor < length)
+            return false;
+        char * nick = batch->nick_data + (size_t) i * (NICK_MAX_LENGTH + 1);
+        memcpy(nick, *cursor, (size_t) length);
+        nick[length] = '\0';
+        *cursor += length;
+    }
+    for (uint32_t i = 0; i < rows; i++) {
+        int64_t id;
+        if (!getVarint(cursor, end, &id) || id < 0 || id >= distinct)
+            return false;
+        batch->nicks[i] = batch->nick_data + (size_t) id * (NICK_MAX_LENGTH + 1);
+    }
+    return true;
+}
+
+static bool decodeValues(const unsigned char ** cursor, const unsigned char * end, uint32_t rows, bool delta, int64_t * values) {
+    int64_t value = 0;
+    for (uint32_t i = 0; i < rows; i++) {
+        int64_t decoded;
+        if (!getVarint(cursor, end, &decoded))
+            return false;
+        value = delta ? value + decoded : decoded;
+        values[i] = value;
+    }
+    return true;
+}
+
+void filterArchiveBatch(ArchiveBatch * batch, const ArchiveFilter * filters, int filter_count) {
+    if (filter_count == 0)
+        return;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < batch->rows; i++) {
+        bool match = true;
+        for (int j = 0; j < filter_count && match; j++) {
+            int64_t value = batch->values[filters[j].column][i];
+            match = value >= filters[j].min && value <= filters[j].max;
+        }
+        if (!match)
+            continue;
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            if (column == ARCHIVE_NICK && batch->nicks != NULL)
+                batch->nicks[kept] = batch->nicks[i];
+            else if (column != ARCHIVE_NICK && batch->values[column] != NULL)
+                batch->values[column][kept] = batch->values[column][i];
+        }
+        kept++;
+    }
+    batch->rows = kept;
+}
+
+void freeArchiveBatch(ArchiveBatch * batch) {
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        free(batch->values[column]);
+        batch->values[column] = NULL;
+    }
+    free(batch->nicks);
+    free(batch->nick_data);
+    batch->nicks = NULL;
+    batch->nick_data = NULL;
+    batch->rows = batch->capacity = 0;
+    batch->nick_capacity = 0;
+}
+
+void closeArchive(ArchiveReader * reader) {
+    if (reader == NULL)
+        return;
+    if (reader->fd >= 0)
+        close(reader->fd);
+    for (size_t i = 0; i < reader->block_count; i++)
+        free(reader->blocks[i].pending);
+    free(reader->blocks);
+    free(reader);
+}
@@ -0,0 +1,186 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_ARCHIVE_H
+#define SNEK_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "snek.h"
+
+/** @brief Number of games collected before they are compacted into a columnar block */
+#define ARCHIVE_BLOCK_ROWS 4096
+
+/** @brief Bit of a column in a column mask */
+#define ARCHIVE_COLUMN_BIT(column) (1u << (unsigned) (column))
+
+/**
+ * @brief Columns of the score archive
+ */
+typedef enum ArchiveColumn {
+    /** @brief Nickname of the player */
+    ARCHIVE_NICK,
+    /** @brief Score achieved */
+    ARCHIVE_SCORE,
+    /** @brief End of the game, seconds since the epoch (delta encoded) */
+    ARCHIVE_TIMESTAMP,
+    /** @brief Length of the game in milliseconds */
+    ARCHIVE_DURATION,
+    /** @brief Number of steps the snake has made */
+    ARCHIVE_TICKS,
+    /** @brief Width of the game area */
+    ARCHIVE_WIDTH,
+    /** @brief Height of the game area */
+    ARCHIVE_HEIGHT,
+    /** @brief Number of food eaten */
+    ARCHIVE_FOOD,
+    /** @brief Number of columns */
+    ARCHIVE_COLUMNS
+} ArchiveColumn;
+
+/**
+ * @brief Everything recorded about a finished game
+ */
+typedef struct GameRecord {
+    /** @brief Nickname of the player */
+    const char * nick;
+    /** @brief Score achieved */
+    int score;
+    /** @brief End of the game, seconds since the epoch */
+    int64_t timestamp;
+    /** @brief Length of the game in milliseconds */
+    int duration_ms;
+    /** @brief Number of steps the snake has made */
+    int ticks;
+    /** @brief Width of the game area */
+    int width;
+    /** @brief Height of the game area */
+    int height;
+    /** @brief Number of food eaten */
+    int food_eaten;
+} GameRecord;
+
+/**
+ * @brief Location and statistics of one block of the archive
+ */
+typedef struct ArchiveBlock {
+    /** @brief Offset of the block header in the archive, -1 for games not compacted yet */
+    int64_t offset;
+    /** @brief Number of games in the block */
+    uint32_t rows;
+    /** @brief Smallest value of each numeric column */
+    int64_t min[ARCHIVE_COLUMNS];
+    /** @brief Largest value of each numeric column */
+    int64_t max[ARCHIVE_COLUMNS];
+    /** @brief Raw rows of games not compacted yet, \p NULL for blocks of the archive */
+    void * pending;
+} ArchiveBlock;
+
+/**
+ * @brief Index of an opened archive
+ */
+typedef struct ArchiveReader {
+    /** @brief Descriptor of the archive file, -1 if there is none */
+    int fd;
+    /** @brief Number of items in \p blocks */
+    size_t block_count;
+    /** @brief Blocks of the archive, followed by blocks of the games not compacted yet */
+    ArchiveBlock * blocks;
+} ArchiveReader;
+
+/**
+ * Decoded columns of a block. Only the requested columns are filled, the others
+ * must not be read. Buffers are reused when the batch is filled again.
+ * A batch must be zero-initialised before it is filled for the first time.
+ * @brief Decoded games of a block
+ */
+typedef struct ArchiveBatch {
+    /** @brief Number of games in the batch */
+    uint32_t rows;
+    /** @brief Number of games the buffers can hold */
+    uint32_t capacity;
+    /** @brief Values of the numeric columns, indexed by \p ArchiveColumn */
+    int64_t * values[ARCHIVE_COLUMNS];
+    /** @brief Nicknames, pointing into \p nick_data */
+    char ** nicks;
+    /** @brief Storage of the nicknames */
+    char * nick_data;
+    /** @brief Size of \p nick_data */
+    size_t nick_capacity;
+} ArchiveBatch;
+
+/**
+ * @brief Inclusive value range of a column, used to skip blocks and games
+ */
+typedef struct ArchiveFilter {
+    /** @brief Numeric column to filter */
+    ArchiveColumn column;
+    /** @brief Smallest accepted value */
+    int64_t min;
+    /** @brief Largest accepted value */
+    int64_t max;
+} ArchiveFilter;
+
+/**
+ * Appends a game to the staging file of the archive. Once \p ARCHIVE_BLOCK_ROWS games
+ * have been staged, the process that notices compacts them into a columnar block.
+ * @brief Adds a game to the archive
+ * @param game game to add
+ * @return 0 on success, -1 on failure
+ */
+int appendArchiveRecord(const GameRecord * game);
+
+/**
+ * Reads the block headers of the archive and the games not compacted yet.
+ * Corrupt or truncated blocks at the end of the archive are ignored.
+ * @brief Opens the archive for reading
+ * @return dynamically allocated reader, \p NULL on failure
+ */
+ArchiveReader * openArchive();
+
+/**
+ * @brief Checks the statistics of a block against filters
+ * @param block block to check
+ * @param filters filters that all have to match
+ * @param filter_count number of items in \p filters
+ * @return \p false if no game in the block can match, \p true otherwise
+ */
+bool archiveBlockMayMatch(const ArchiveBlock * block, const ArchiveFilter * filters, int filter_count);
+
+/**
+ * Decodes the requested columns of a block. Only the bytes of the requested columns
+ * are read, and each of them is verified against its checksum.
+ * Can be called from multiple threads with different batches.
+ * @brief Reads columns of a block
+ * @param reader opened archive
+ * @param index index of the block
+ * @param columns mask of \p ARCHIVE_COLUMN_BIT values
+ * @param batch batch to fill
+ * @return 0 on success, -1 on I/O error, corruption or allocation failure
+ */
+int readArchiveBlock(const ArchiveReader * reader, size_t index, unsigned columns, ArchiveBatch * batch);
+
+/**
+ * Keeps only the games of a batch that match all filters.
+ * The filtered columns must have been read.
+ * @brief Filters the games of a batch
+ * @param batch batch to filter
+ * @param filters filters that all have to match
+ * @param filter_count number of items in \p filters
+ */
+void filterArchiveBatch(ArchiveBatch * batch, const ArchiveFilter * filters, int filter_count);
+
+/**
+ * @brief Frees the buffers of a batch (not the batch itself)
+ * @param batch batch to free
+ */
+void freeArchiveBatch(ArchiveBatch * batch);
+
+/**
+ * @brief Frees all memory used by the reader and closes the archive, \p NULL is ignored
+ * @param reader reader to close
+ */
+void closeArchive(ArchiveReader * reader);
+
+#endif //SNEK_ARCHIVE_H
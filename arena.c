@@ -0,0 +1,480 @@
+/**
+ * The rules of the multi-snake game: many snakes, played by the keyboard or
+ * by the computer, on a board with a single occupancy index. A step of the
+ * arena moves every snake at the same time, in a few passes over the snakes,
+ * without comparing the snakes with each other.
+ * \file arena.c
+ * \author hexadec
+ * \brief This file contains the rules of the multi-snake game
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "trace.h"
+#include "allocator.h"
+
+/** @brief Initial number of items of the ring of a snake */
+#define ARENA_INITIAL_CAPACITY 8
+
+/** @brief Random blocks tried before searching the board for a free one */
+#define ARENA_RANDOM_TRIES 64
+
+/** @brief Value of \p ArenaSnake::target if there is no food */
+#define ARENA_NO_CELL UINT32_MAX
+
+/**
+ * @brief Generates the next random number of the arena
+ * @param arena the arena
+ * @return random number
+ */
+static unsigned long long nextRandom(Arena *);
+
+/**
+ * Tries random blocks first, as the board is mostly free, then searches the
+ * whole board from a random block.
+ * @brief Finds a random free block of the game area
+ * @param arena the arena
+ * @return block number, \p ARENA_NO_CELL if the game area is full
+ */
+static uint32_t findFreeCell(Arena *);
+
+/**
+ * @brief Puts a food to a random free block, if there is one
+ * @param arena the arena
+ */
+static void placeArenaFood(Arena *);
+
+/**
+ * @brief Tile of \p Arena::food_tiles a block belongs to
+ * @param arena the arena
+ * @param cell block number
+ * @return index of the tile
+ */
+static size_t tileOfCell(const Arena *, uint32_t);
+
+/**
+ * @brief Block next to another one
+ * @param arena the arena
+ * @param cell block number
+ * @param direction direction of the neighbour
+ * @return block number of the neighbour
+ */
+static uint32_t neighbourCell(const Arena *, uint32_t, Direction);
+
+/**
+ * @brief Adds a new head to a snake, doubling its ring if it is full
+ * @param snake the snake
+ * @param cell block number of the new head
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool pushArenaHead(ArenaSnake *, uint32_t);
+
+/**
+ * @brief Removes the body of a snake from the board, and marks it dead
+ * @param arena the arena
+ * @param index index of the snake
+ */
+static void killArenaSnake(Arena *, size_t);
+
+/**
+ * The tiles are searched in growing squares around the tile of the block, and
+ * the nearest food of the first square holding any is chosen, which is near
+ * enough for a bot. Only the blocks of the tiles holding food are read.
+ * @brief Chooses a food near a block
+ * @param arena the arena
+ * @param cell block number
+ * @return block number of the food, \p ARENA_NO_CELL if there is no food
+ */
+static uint32_t findNearestFood(const Arena *, uint32_t);
+
+/**
+ * Another head next to the block may move to it in the same step, which kills both snakes.
+ * @brief Checks if the head of another living snake is next to a block
+ * @param arena the arena
+ * @param cell block number, inside the game area
+ * @param index index of the snake that is not counted
+ * @return \p true if another head is next to the block
+ */
+static bool isNearOtherHead(const Arena *, uint32_t, size_t);
+
+static const Direction opposite[] = {[UP] = DOWN, [DOWN] = UP, [LEFT] = RIGHT, [RIGHT] = LEFT};
+
+Arena * createArena(Point size, size_t snakes, size_t foods, unsigned long long seed) {
+    // Same limits as the terminal
+    if (size.x < 35 || size.y < 8 || snakes < 1 || snakes > ARENA_MAX_SNAKES || seed == 0)
+        return NULL;
+    size_t cell_count = (size_t) size.x * (size_t) size.y;
+    if (snakes + foods > (size_t) (size.x - 2) * (size_t) (size.y - 3) || cell_count >= ARENA_NO_CELL)
+        return NULL;
+    Arena * arena = calloc(1, sizeof(Arena));
+    if (arena == NULL)
+        return NULL;
+    arena->size = size;
+    arena->seed = seed;
+    arena->cells = malloc(cell_count * sizeof(uint16_t));
+    arena->marks = calloc(cell_count, sizeof(ArenaMark));
+    arena->snakes = calloc(snakes, sizeof(ArenaSnake));
+    arena->tile_columns = (size.x + ARENA_TILE - 1) / ARENA_TILE;
+    arena->tile_rows = (size.y + ARENA_TILE - 1) / ARENA_TILE;
+    arena->food_tiles = calloc((size_t) arena->tile_columns * (size_t) arena->tile_rows, sizeof(uint16_t));
+    if (arena->cells == NULL || arena->marks == NULL || arena->snakes == NULL || arena->food_tiles == NULL) {
+        freeArena(arena);
+        return NULL;
+    }
+    arena->snake_count = snakes;
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            bool inside = x >= 1 && y >= 2 && x <= size.x - 2 && y <= size.y - 2;
+            arena->cells[(size_t) y * size.x + x] = inside ? ARENA_EMPTY : ARENA_WALL;
+        }
+    }
+    for (size_t i = 0; i < snakes; i++) {
+        arena->snakes[i].capacity = ARENA_INITIAL_CAPACITY;
+        arena->snakes[i].body = malloc(ARENA_INITIAL_CAPACITY * sizeof(uint32_t));
+        if (arena->snakes[i].body == NULL) {
+            freeArena(arena);
+            return NULL;
+        }
+        respawnArenaSnake(arena, i);
+    }
+    for (size_t i = 0; i < foods; i++)
+        placeArenaFood(arena);
+    return arena;
+}
+
+void freeArena(Arena * arena) {
+    if (arena == NULL)
+        return;
+    if (arena->snakes != NULL) {
+        for (size_t i = 0; i < arena->snake_count; i++)
+            free(arena->snakes[i].body);
+    }
+    free(arena->snakes);
+    free(arena->food_tiles);
+    free(arena->marks);
+    free(arena->cells);
+    free(arena);
+}
+
+int stepArena(Arena * arena) {
+    TRACE_BEGIN("stepArena");
+    if (++arena->ticks == 0) {
+        // The stamps of the last 2^32 steps would be taken for the current ones
+        memset(arena->marks, 0, (size_t) arena->size.x * (size_t) arena->size.y * sizeof(ArenaMark));
+        arena->ticks = 1;
+    }
+    uint32_t tick = arena->ticks;
+    uint16_t * cells = arena->cells;
+    ArenaMark * marks = arena->marks;
+    ArenaSnake * snakes = arena->snakes;
+    size_t count = arena->snake_count;
+
+    // Where every head moves, and which heads move to the same block
+    for (size_t i = 0; i < count; i++) {
+        ArenaSnake * snake = &snakes[i];
+        if (!snake->alive)
+            continue;
+        uint32_t head = getArenaHead(snake);
+        // The frame is a wall, so the neighbour of a head is always on the board
+        snake->next = neighbourCell(arena, head, snake->direction);
+        snake->moved = snake->direction;
+        snake->eating = cells[snake->next] == ARENA_FOOD;
+        snake->dying = false;
+        marks[head].left = tick;
+        marks[head].leaver = (uint16_t) i;
+        ArenaMark * mark = &marks[snake->next];
+        if (mark->claimed == tick) {
+            snake->dying = true;
+            snakes[mark->claimer].dying = true;
+        } else {
+            mark->claimed = tick;
+            mark->claimer = (uint16_t) i;
+        }
+    }
+    // The tails leave before the heads arrive
+    for (size_t i = 0; i < count; i++) {
+        if (snakes[i].alive && !snakes[i].eating)
+            cells[snakes[i].body[snakes[i].tail]] = ARENA_EMPTY;
+    }
+    // Heads hitting a wall or a body, or swapping blocks with another head
+    for (size_t i = 0; i < count; i++) {
+        ArenaSnake * snake = &snakes[i];
+        if (!snake->alive || snake->dying)
+            continue;
+        uint16_t cell = cells[snake->next];
+        if (cell != ARENA_EMPTY && cell != ARENA_FOOD) {
+            snake->dying = true;
+            continue;
+        }
+        const ArenaMark * mark = &marks[snake->next];
+        if (mark->left == tick && mark->leaver != i && snakes[mark->leaver].next == getArenaHead(snake)) {
+            snake->dying = true;
+            snakes[mark->leaver].dying = true;
+        }
+    }
+    // Moving the survivors and removing the dead
+    int died = 0;
+    for (size_t i = 0; i < count; i++) {
+        ArenaSnake * snake = &snakes[i];
+        if (!snake->alive)
+            continue;
+        if (snake->dying) {
+            killArenaSnake(arena, i);
+            died++;
+            continue;
+        }
+        if (!snake->eating) {
+            snake->tail = (snake->tail + 1) & (snake->capacity - 1);
+            snake->length--;
+        }
+        if (!pushArenaHead(snake, snake->next)) {
+            TRACE_END("stepArena");
+            return -1;
+        }
+        cells[snake->next] = (uint16_t) (i + 1);
+        if (snake->eating) {
+            snake->score++;
+            snake->food_eaten++;
+            arena->food_count--;
+            arena->food_tiles[tileOfCell(arena, snake->next)]--;
+            placeArenaFood(arena);
+        }
+    }
+    TRACE_END("stepArena");
+    return died;
+}
+
+void steerArenaSnake(Arena * arena, size_t index, Direction direction) {
+    ArenaSnake * snake = &arena->snakes[index];
+    if (snake->alive && direction != opposite[snake->moved])
+        snake->direction = direction;
+}
+
+void steerArenaBot(Arena * arena, size_t index) {
+    ArenaSnake * snake = &arena->snakes[index];
+    if (!snake->alive)
+        return;
+    uint32_t head = getArenaHead(snake);
+    if (snake->target == ARENA_NO_CELL || arena->cells[snake->target] != ARENA_FOOD)
+        snake->target = findNearestFood(arena, head);
+    Direction preferred[4];
+    if (snake->target != ARENA_NO_CELL) {
+        Point from = getArenaPoint(arena, head);
+        Point to = getArenaPoint(arena, snake->target);
+        int dx = to.x - from.x;
+        int dy = to.y - from.y;
+        Direction horizontal = dx < 0 ? LEFT : RIGHT;
+        Direction vertical = dy < 0 ? UP : DOWN;
+        if (abs(dx) >= abs(dy)) {
+            preferred[0] = horizontal;
+            preferred[1] = vertical;
+        } else {
+            preferred[0] = vertical;
+            preferred[1] = horizontal;
+        }
+        // The directions away from the food, if nothing better is free
+        preferred[2] = opposite[preferred[1]];
+        preferred[3] = opposite[preferred[0]];
+    } else {
+        // Straight on, or turning if something is in the way
+        preferred[0] = snake->direction;
+        preferred[1] = snake->direction == UP || snake->direction == DOWN ? LEFT : UP;
+        preferred[2] = opposite[preferred[1]];
+        preferred[3] = opposite[preferred[0]];
+    }
+    // A free block another head may also move to is only taken if no other is free
+    int contested = -1;
+    for (int i = 0; i < 4; i++) {
+        // Turning back is not allowed to the players either
+        if (preferred[i] == opposite[snake->moved])
+            continue;
+        uint32_t next = neighbourCell(arena, head, preferred[i]);
+        uint16_t cell = arena->cells[next];
+        if (cell != ARENA_EMPTY && cell != ARENA_FOOD)
+            continue;
+        if (!isNearOtherHead(arena, next, index)) {
+            snake->direction = preferred[i];
+            return;
+        }
+        if (contested < 0)
+            contested = i;
+    }
+    if (contested >= 0)
+        snake->direction = preferred[contested];
+}
+
+bool respawnArenaSnake(Arena * arena, size_t index) {
+    ArenaSnake * snake = &arena->snakes[index];
+    if (snake->alive)
+        return true;
+    uint32_t cell = findFreeCell(arena);
+    if (cell == ARENA_NO_CELL)
+        return false;
+    snake->tail = 0;
+    snake->length = 1;
+    snake->body[0] = cell;
+    snake->direction = (Direction) (nextRandom(arena) % 4);
+    snake->moved = snake->direction;
+    snake->alive = true;
+    snake->dying = false;
+    snake->eating = false;
+    snake->target = ARENA_NO_CELL;
+    snake->score = 1;
+    snake->food_eaten = 0;
+    arena->cells[cell] = (uint16_t) (index + 1);
+    arena->alive++;
+    return true;
+}
+
+Point getArenaPoint(const Arena * arena, uint32_t cell) {
+    Point point = {(int) (cell % (uint32_t) arena->size.x), (int) (cell / (uint32_t) arena->size.x)};
+    return point;
+}
+
+uint32_t getArenaHead(const ArenaSnake * snake) {
+    return snake->body[(snake->tail + snake->length - 1) & (snake->capacity - 1)];
+}
+
+static bool isNearOtherHead(const Arena * arena, uint32_t cell, size_t index) {
+    for (Direction direction = UP; direction <= RIGHT; direction++) {
+        uint32_t neighbour = neighbourCell(arena, cell, direction);
+        uint16_t value = arena->cells[neighbour];
+        if (value == ARENA_EMPTY || value >= ARENA_WALL || value == index + 1)
+            continue;
+        const ArenaSnake * other = &arena->snakes[value - 1];
+        if (other->alive && getArenaHead(other) == neighbour)
+            return true;
+    }
+    return false;
+}
+
+static unsigned long long nextRandom(Arena * arena) {
+    // xorshift64, like the levels of the leaderboard
+    unsigned long long x = arena->seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    arena->seed = x;
+    return x;
+}
+
+static uint32_t findFreeCell(Arena * arena) {
+    uint32_t columns = (uint32_t) arena->size.x - 2;
+    uint32_t rows = (uint32_t) arena->size.y - 3;
+    for (int i = 0; i < ARENA_RANDOM_TRIES; i++) {
+        unsigned long long random = nextRandom(arena);
+        uint32_t x = (uint32_t) (random % columns) + 1;
+        uint32_t y = (uint32_t) ((random >> 32) % rows) + 2;
+        uint32_t cell = y * (uint32_t) arena->size.x + x;
+        if (arena->cells[cell] == ARENA_EMPTY)
+            return cell;
+    }
+    uint32_t cell_count = (uint32_t) arena->size.x * (uint32_t) arena->size.y;
+    uint32_t start = (uint32_t) (nextRandom(arena) % cell_count);
+    for (uint32_t i = 0; i < cell_count; i++) {
+        uint32_t cell = (start + i) % cell_count;
+        if (arena->cells[cell] == ARENA_EMPTY)
+            return cell;
+    }
+    return ARENA_NO_CELL;
+}
+
+static void placeArenaFood(Arena * arena) {
+    uint32_t cell = findFreeCell(arena);
+    if (cell == ARENA_NO_CELL)
+        return;
+    arena->cells[cell] = ARENA_FOOD;
+    arena->food_tiles[tileOfCell(arena, cell)]++;
+    arena->food_count++;
+}
+
+static size_t tileOfCell(const Arena * arena, uint32_t cell) {
+    Point point = getArenaPoint(arena, cell);
+    return (size_t) (point.y / ARENA_TILE) * (size_t) arena->tile_columns + (size_t) (point.x / ARENA_TILE);
+}
+
+static uint32_t neighbourCell(const Arena * arena, uint32_t cell, Direction direction) {
+    switch (direction) {
+        case UP:
+            return cell - (uint32_t) arena->size.x;
+        case DOWN:
+            return cell + (uint32_t) arena->size.x;
+        case LEFT:
+            return cell - 1;
+        case RIGHT:
+        default:
+            return cell + 1;
+    }
+}
+
+static bool pushArenaHead(ArenaSnake * snake, uint32_t cell) {
+    if (snake->length == snake->capacity) {
+        uint32_t * body = malloc(2 * snake->capacity * sizeof(uint32_t));
+        if (body == NULL)
+            return false;
+        // Unrolling the ring, so the tail is the first item again
+        size_t first = snake->capacity - snake->tail;
+        memcpy(body, snake->body + snake->tail, first * sizeof(uint32_t));
+        memcpy(body + first, snake->body, snake->tail * sizeof(uint32_t));
+        free(snake->body);
+        snake->body = body;
+        snake->tail = 0;
+        snake->capacity *= 2;
+    }
+    snake->body[(snake->tail + snake->length) & (snake->capacity - 1)] = cell;
+    snake->length++;
+    return true;
+}
+
+static void killArenaSnake(Arena * arena, size_t index) {
+    ArenaSnake * snake = &arena->snakes[index];
+    uint16_t number = (uint16_t) (index + 1);
+    // The block the tail has left may already hold the head of another snake
+    for (size_t i = 0; i < snake->length; i++) {
+        uint32_t cell = snake->body[(snake->tail + i) & (snake->capacity - 1)];
+        if (arena->cells[cell] == number)
+            arena->cells[cell] = ARENA_EMPTY;
+    }
+    snake->alive = false;
+    snake->dying = false;
+    arena->alive--;
+}
+
+static uint32_t findNearestFood(const Arena * arena, uint32_t cell) {
+    if (arena->food_count == 0)
+        return ARENA_NO_CELL;
+    Point from = getArenaPoint(arena, cell);
+    int tile_x = from.x / ARENA_TILE;
+    int tile_y = from.y / ARENA_TILE;
+    int max_radius = arena->tile_columns > arena->tile_rows ? arena->tile_columns : arena->tile_rows;
+    uint32_t nearest = ARENA_NO_CELL;
+    int best = 0;
+    for (int radius = 0; radius < max_radius && nearest == ARENA_NO_CELL; radius++) {
+        for (int ty = tile_y - radius; ty <= tile_y + radius; ty++) {
+            if (ty < 0 || ty >= arena->tile_rows)
+                continue;
+            // Only the edge of the square, the inside has been searched already
+            int step = ty == tile_y - radius || ty == tile_y + radius ? 1 : 2 * radius;
+            for (int tx = tile_x - radius; tx <= tile_x + radius; tx += step) {
+                if (tx < 0 || tx >= arena->tile_columns || arena->food_tiles[ty * arena->tile_columns + tx] == 0)
+                    continue;
+                int last_x = (tx + 1) * ARENA_TILE < arena->size.x ? (tx + 1) * ARENA_TILE : arena->size.x;
+                int last_y = (ty + 1) * ARENA_TILE < arena->size.y ? (ty + 1) * ARENA_TILE : arena->size.y;
+                for (int y = ty * ARENA_TILE; y < last_y; y++) {
+                    const uint16_t * row = &arena->cells[(size_t) y * arena->size.x];
+                    for (int x = tx * ARENA_TILE; x < last_x; x++) {
+                        if (row[x] != ARENA_FOOD)
+                            continue;
+                        int distance = abs(x - from.x) + abs(y - from.y);
+                        if (nearest == ARENA_NO_CELL || distance < best) {
+                            nearest = (uint32_t) y * (uint32_t) arena->size.x + (uint32_t) x;
+                            best = distance;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return nearest;
+}
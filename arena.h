@@ -0,0 +1,185 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_ARENA_H
+#define SNEK_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "snek.h"
+
+/** @brief Value of an empty block of \p Arena::cells */
+#define ARENA_EMPTY 0
+
+/** @brief Value of a block of \p Arena::cells holding food */
+#define ARENA_FOOD UINT16_MAX
+
+/** @brief Value of the blocks of \p Arena::cells outside the game area */
+#define ARENA_WALL (UINT16_MAX - 1)
+
+/** @brief Most snakes an arena can have, the other values of a block are snake numbers */
+#define ARENA_MAX_SNAKES (UINT16_MAX - 2)
+
+/** @brief Width and height of a tile of \p Arena::food_tiles, in blocks */
+#define ARENA_TILE 8
+
+/**
+ * The segments are block numbers (y * columns + x) in a ring, that grows
+ * by doubling when the snake eats, so a step only allocates on growth.
+ * @brief A snake of an \p Arena
+ */
+typedef struct ArenaSnake {
+    /** @brief Ring of the block numbers of the segments, the tail first */
+    uint32_t * body;
+    /** @brief Number of items of \p body, a power of two */
+    size_t capacity;
+    /** @brief Index of the tail in \p body */
+    size_t tail;
+    /** @brief Number of segments */
+    size_t length;
+    /** @brief Direction of the next step */
+    Direction direction;
+    /** @brief Direction of the last step, turning back is checked against it */
+    Direction moved;
+    /** @brief \p false after the snake has died */
+    bool alive;
+    /** @brief Set by \p stepArena for the snakes dying in the current step */
+    bool dying;
+    /** @brief Set by \p stepArena for the snakes eating in the current step */
+    bool eating;
+    /** @brief Block the head moves to in the current step */
+    uint32_t next;
+    /** @brief Food block the bot is heading for, see \p steerArenaBot */
+    uint32_t target;
+    /** @brief Score of the snake, its length as in the single player game, kept when it dies */
+    int score;
+    /** @brief Number of food eaten */
+    int food_eaten;
+} ArenaSnake;
+
+/**
+ * @brief Step stamps of a block, see \p stepArena
+ */
+typedef struct ArenaMark {
+    /** @brief Step a head has moved to the block in */
+    uint32_t claimed;
+    /** @brief Step a head has left the block in */
+    uint32_t left;
+    /** @brief Index of the snake of \p claimed */
+    uint16_t claimer;
+    /** @brief Index of the snake of \p left */
+    uint16_t leaver;
+} ArenaMark;
+
+/**
+ * Every block of the board is an item of \p cells, holding the number of the
+ * snake on it (index plus one), food, wall or nothing, so every collision check
+ * of a step is a single lookup, whatever the number of snakes. The game area is the
+ * same as in the single player game, the frame and the status line are walls.
+ * @brief A board shared by many snakes
+ */
+typedef struct Arena {
+    /** @brief Size of the board, including the frame and the status line */
+    Point size;
+    /** @brief Occupancy of every block, row by row */
+    uint16_t * cells;
+    /** @brief Step stamps of every block, row by row */
+    ArenaMark * marks;
+    /** @brief The snakes */
+    ArenaSnake * snakes;
+    /** @brief Number of items of \p snakes */
+    size_t snake_count;
+    /** @brief Number of living snakes */
+    size_t alive;
+    /** @brief Number of food on the board, a new one is placed for every food eaten */
+    size_t food_count;
+    /**
+     * Lets the bots find a near food without walking the whole board or a list of the food.
+     * @brief Number of food in every tile of \p ARENA_TILE x \p ARENA_TILE blocks, row by row
+     */
+    uint16_t * food_tiles;
+    /** @brief Number of tiles in a row of \p food_tiles */
+    int tile_columns;
+    /** @brief Number of rows of \p food_tiles */
+    int tile_rows;
+    /** @brief Number of steps made */
+    uint32_t ticks;
+    /** @brief State of the random generator of the positions */
+    unsigned long long seed;
+} Arena;
+
+/**
+ * The snakes start as a single segment at random free blocks, moving in random directions.
+ * @brief Creates an arena
+ * @param size size of the board, including the frame and the status line
+ * @param snakes number of snakes, at most \p ARENA_MAX_SNAKES
+ * @param foods number of food on the board at the same time
+ * @param seed seed of the random positions, not 0
+ * @return dynamically allocated arena, \p NULL on allocation failure or if the snakes and the food do not fit
+ */
+Arena * createArena(Point, size_t, size_t, unsigned long long);
+
+/**
+ * @brief Frees the memory used by the arena
+ * @param arena arena to free, can be \p NULL
+ */
+void freeArena(Arena *);
+
+/**
+ * Every living snake moves at the same time. A head moving out of the game area,
+ * to a block of a snake that stays there, to the block another head moves to, or
+ * swapping blocks with another head kills the snake. A tail leaving a block frees
+ * it for a head in the same step, except for the snakes that eat and keep their tail.
+ * The bodies of the dying snakes are removed from the board after the step.
+ * @brief Moves every living snake by one block
+ * @param arena the arena
+ * @return number of snakes died in the step, -1 if a growing snake couldn't get memory
+ */
+int stepArena(Arena *);
+
+/**
+ * Turning back is ignored, as in the single player game. The direction can be
+ * changed many times between two steps, only the last one is taken.
+ * @brief Changes the direction of a snake
+ * @param arena the arena
+ * @param index index of the snake
+ * @param direction new direction
+ */
+void steerArenaSnake(Arena *, size_t, Direction);
+
+/**
+ * Heads for the nearest food, and avoids the walls and the snakes if it can.
+ * The food is chosen again only when it is eaten, in the nearest tiles holding
+ * food, so a step of a bot does not depend on the number of food or snakes.
+ * @brief Chooses the direction of a snake played by the computer
+ * @param arena the arena
+ * @param index index of the snake
+ */
+void steerArenaBot(Arena *, size_t);
+
+/**
+ * @brief Puts a dead snake back to a random free block, as a new snake
+ * @param arena the arena
+ * @param index index of the snake
+ * @return \p true on success, \p false if there is no free block found
+ */
+bool respawnArenaSnake(Arena *, size_t);
+
+/**
+ * @brief Position of a block of the board
+ * @param arena the arena
+ * @param cell block number
+ * @return position of the block
+ */
+Point getArenaPoint(const Arena *, uint32_t);
+
+/**
+ * @brief Block number of the head of a snake
+ * @param snake the snake, with at least one segment
+ * @return block number of the head
+ */
+uint32_t getArenaHead(const ArenaSnake *);
+
+#endif //SNEK_ARENA_H
@@ -0,0 +1,802 @@
+/**
+ * Microbenchmarks of the hot paths of the game, the containers, the score file
+ * reader and the renderer. Every benchmark is warmed up, then timed in samples,
+ * each sample being a batch of calls long enough for the clock. The median and
+ * the 99th percentile of the time per call are reported as JSON, so the results
+ * of two releases can be compared. With \p --perf the hardware events of the
+ * timed samples are counted as well, and reported per call next to the times.
+ * The score files are generated into a temporary directory, which is removed at exit.
+ * \file bench.c
+ * \author hexadec
+ * \brief This file contains the microbenchmark suite
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "snek.h"
+#include "game.h"
+#include "arena.h"
+#include "screen.h"
+#include "fileio.h"
+#include "nickdict.h"
+#include "perfcounters.h"
+#include "allocator.h"
+
+/** @brief Default number of timed samples of a benchmark */
+#define BENCH_SAMPLES 101
+
+/** @brief Time a sample is aimed to take, long enough for the resolution of the clock */
+#define BENCH_SAMPLE_NS 200000LL
+
+/** @brief Time spent warming up before the samples are taken */
+#define BENCH_WARMUP_NS 50000000LL
+
+/** @brief Time the samples of a benchmark may take, slower benchmarks take fewer samples */
+#define BENCH_BUDGET_NS 2000000000LL
+
+/** @brief Fewest samples taken of a benchmark, even if it exceeds the budget */
+#define BENCH_MIN_SAMPLES 5
+
+/** @brief Size of the game area of the benchmarks, a common terminal size */
+#define BENCH_COLUMNS 80
+/** @brief Size of the game area of the benchmarks, a common terminal size */
+#define BENCH_ROWS 24
+
+/** @brief Size of the board of the arena benchmarks, a large one for many snakes */
+#define BENCH_ARENA_COLUMNS 512
+/** @brief Size of the board of the arena benchmarks, a large one for many snakes */
+#define BENCH_ARENA_ROWS 256
+
+/** @brief Default largest score file generated, in lines */
+#define BENCH_DEFAULT_MAX_LINES 1000000L
+
+/** @brief Number of different players in the generated score files */
+#define BENCH_PLAYERS 10000
+
+/** @brief Number of nodes of the list in the \p LinkedList benchmarks */
+#define BENCH_LIST_MAX 65536
+
+/**
+ * @brief Settings and output of a benchmark run
+ */
+typedef struct Bench {
+    /** @brief Number of timed samples per benchmark */
+    int samples;
+    /** @brief Largest score file generated, in lines */
+    long max_lines;
+    /** @brief Only benchmarks with names containing this are run, \p NULL for all */
+    const char * filter;
+    /** @brief Stream the JSON report is written to */
+    FILE * output;
+    /** @brief Number of results written so far */
+    int results;
+    /** @brief Time per call of each sample of the running benchmark */
+    double * times;
+    /** @brief Hardware event counters of the samples, \p NULL if they are not counted */
+    PerfCounters * counters;
+} Bench;
+
+/**
+ * A closed path through every block of the game area, in which every block is
+ * next to the one after it. A snake following it can grow to fill the game
+ * area without ever biting itself.
+ * @brief Cycle through every block of the game area
+ */
+typedef struct Cycle {
+    /** @brief Blocks of the cycle, in order */
+    Point * points;
+    /** @brief Number of blocks, the size of the game area */
+    size_t length;
+} Cycle;
+
+/**
+ * @brief State of the game benchmarks: a snake following a \p Cycle
+ */
+typedef struct GameBench {
+    /** @brief The game, its food is placed where the snake never goes unless stated otherwise */
+    Snek snek;
+    /** @brief The path the snake follows */
+    const Cycle * cycle;
+    /** @brief Index of the block of the head of the snake in the cycle */
+    size_t head;
+    /** @brief Index of the queried block in the cycle, used by \p benchPointInSnake */
+    size_t query;
+    /** @brief Length of the snake */
+    size_t length;
+} GameBench;
+
+/**
+ * @brief State of the \p LinkedList benchmarks
+ */
+typedef struct ListBench {
+    /** @brief The list, holding pointers into \p values */
+    LinkedList * list;
+    /** @brief Data of the nodes, never freed by the list */
+    int * values;
+    /** @brief Number of nodes */
+    int length;
+} ListBench;
+
+/**
+ * @brief State of the \p strlenUTF8 benchmark
+ */
+typedef struct StringBench {
+    /** @brief String to measure */
+    char * string;
+} StringBench;
+
+/**
+ * @brief State of the \p stepArena benchmark
+ */
+typedef struct ArenaBench {
+    /** @brief The arena, every snake is a bot */
+    Arena * arena;
+    /** @brief Set if a growing snake couldn't get memory */
+    bool failed;
+} ArenaBench;
+
+/** @brief Path of the temporary directory holding the generated score files */
+static char work_directory[] = "/tmp/snek_bench_XXXXXX";
+
+/** @brief Sink of the results of the benchmarked calls, so they are not optimised away */
+static volatile long long sink;
+
+/**
+ * Runs \p body in batches: first until \p BENCH_WARMUP_NS has passed, then in
+ * \p Bench.samples samples, fewer if they would exceed \p BENCH_BUDGET_NS.
+ * Writes the median, the 99th percentile and the extremes of the time per call.
+ * @brief Times a benchmark and writes its result
+ * @param bench settings and output of the run
+ * @param name name of the benchmark
+ * @param parameter name of the parameter of the benchmark, \p NULL if it has none
+ * @param value value of the parameter
+ * @param body function calling the benchmarked code once
+ * @param context state passed to \p body
+ */
+static void measure(Bench *, const char *, const char *, long long, void (*)(void *), void *);
+
+/**
+ * @brief Reads the monotonic clock
+ * @return the time in nanoseconds
+ */
+static long long now();
+
+/**
+ * @brief Compares two doubles for \p qsort
+ */
+static int compareTimes(const void *, const void *);
+
+/**
+ * The columns of the game area are walked alternately downwards and upwards,
+ * apart from the top row, which leads back from the last column to the first.
+ * @brief Builds the cycle through the game area of a game
+ * @param cycle cycle to fill
+ * @param game_size size of the game area, its width has to be even
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool createCycle(Cycle *, Point);
+
+/**
+ * The tail of the snake is placed at the start of the cycle, and its head
+ * \p length - 1 blocks further along it. The food is placed outside of the game area.
+ * @brief Creates a snake of the given length along the cycle
+ * @param state state of the game benchmark to set up, its \p game_size has to be set
+ * @param cycle path to place the snake on
+ * @param length length of the snake
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool createGameBench(GameBench *, const Cycle *, size_t);
+
+/**
+ * @brief Frees the snake and the food of a game benchmark
+ * @param state state of the game benchmark
+ */
+static void freeGameBench(GameBench *);
+
+/**
+ * @brief Turns the snake towards the next block of the cycle and steps the game
+ * @param context \p GameBench
+ */
+static void benchStepGame(void *);
+
+/**
+ * The whole snake is walked, as the block is not found.
+ * @brief Looks up the block right behind the tail of the snake, which it does not occupy
+ * @param context \p GameBench
+ */
+static void benchPointInSnake(void *);
+
+/**
+ * @brief Places the food on one of the blocks the snake does not occupy
+ * @param context \p GameBench
+ */
+static void benchPlaceNewFood(void *);
+
+/**
+ * @brief Adds a node to the start of the list, and detaches the last one
+ * @param context \p ListBench
+ */
+static void benchListAddRemove(void *);
+
+/**
+ * @brief Seeks to the middle of the list from its start
+ * @param context \p ListBench
+ */
+static void benchListSeek(void *);
+
+/**
+ * @brief Reads the highscore of a player from the score file
+ * @param context unused
+ */
+static void benchGetHighscore(void *);
+
+/**
+ * @brief Reads the toplist from the score file, into a new dictionary
+ * @param context unused
+ */
+static void benchGetToplist(void *);
+
+/**
+ * @brief Counts the characters of a string
+ * @param context \p StringBench
+ */
+static void benchStrlenUTF8(void *);
+
+/**
+ * @brief Steps the game and draws a frame, as the game loop does
+ * @param context \p GameBench
+ */
+static void benchRenderFrame(void *);
+
+/**
+ * @brief Runs the benchmarks of the game logic at snake lengths from 1 to the full game area
+ * @param bench settings and output of the run
+ * @param cycle path the snakes follow
+ * @param game_size size of the game area
+ * @return \p false if there is not enough memory
+ */
+static bool runGameBenchmarks(Bench *, const Cycle *, Point);
+
+/**
+ * @brief Steers every bot, steps the arena, and brings the dead snakes back, so the number of snakes stays the same
+ * @param context \p ArenaBench
+ */
+static void benchStepArena(void *);
+
+/**
+ * @brief Runs the benchmarks of the arena at different numbers of snakes on a large board
+ * @param bench settings and output of the run
+ * @return \p false if there is not enough memory
+ */
+static bool runArenaBenchmarks(Bench *);
+
+/**
+ * @brief Runs the benchmarks of \p LinkedList
+ * @param bench settings and output of the run
+ * @return \p false if there is not enough memory
+ */
+static bool runListBenchmarks(Bench *);
+
+/**
+ * The files grow tenfold from 10 thousand lines up to \p Bench.max_lines.
+ * @brief Runs the benchmarks of the score file reader over generated score files
+ * @param bench settings and output of the run
+ * @return \p false if a score file cannot be written
+ */
+static bool runScoreFileBenchmarks(Bench *);
+
+/**
+ * @brief Runs the benchmark of \p strlenUTF8 on ASCII, accented and long strings
+ * @param bench settings and output of the run
+ */
+static void runStringBenchmarks(Bench *);
+
+/**
+ * Skipped if there is no terminal description for the \p TERM environment variable.
+ * @brief Runs the benchmarks of drawing a frame at different snake lengths
+ * @param bench settings and output of the run
+ * @param cycle path the snakes follow
+ * @return \p false if there is not enough memory
+ */
+static bool runRenderBenchmarks(Bench *, const Cycle *);
+
+/**
+ * Players are picked by a fixed pseudo-random sequence, so the files are the same on every run.
+ * @brief Writes a score file of the given number of lines into the working directory
+ * @param lines number of records
+ * @return \p true on success, \p false otherwise
+ */
+static bool generateScoreFile(long);
+
+/**
+ * @brief Checks if a benchmark is selected by the filter of the run
+ * @param bench settings and output of the run
+ * @param name name of the benchmark
+ * @return \p true if the benchmark has to be run
+ */
+static bool selected(const Bench *, const char *);
+
+/**
+ * @brief Prints the usage of the program
+ * @param program name of the executable
+ */
+static void printUsage(const char *);
+
+/**
+ * Benchmarks are written as a JSON object to the standard output, or to the file
+ * given with \p --json. \p --samples sets the number of timed samples,
+ * \p --max-lines the largest score file, and \p --filter selects the benchmarks
+ * whose names contain the given string. \p --perf counts hardware events, if the
+ * system allows it, otherwise the times are reported alone.
+ * @brief Entry point of the benchmarks
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @return 0 on success, 1 on wrong arguments, -3 if there is not enough memory
+ */
+int main(int argc, char ** argv) {
+    Bench bench = {BENCH_SAMPLES, BENCH_DEFAULT_MAX_LINES, NULL, stdout, 0, NULL, NULL};
+    const char * json_path = NULL;
+    PerfCounters counters;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            bench.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-lines") == 0 && i + 1 < argc) {
+            bench.max_lines = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            bench.filter = argv[++i];
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            bench.counters = &counters;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench.samples < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (json_path != NULL) {
+        bench.output = fopen(json_path, "w");
+        if (bench.output == NULL) {
+            perror(json_path);
+            return 1;
+        }
+    }
+    if (bench.counters != NULL && !openPerfCounters(bench.counters)) {
+        fprintf(stderr, "Hardware performance counters are not available, measuring time only\n");
+        bench.counters = NULL;
+    }
+    bench.times = malloc(bench.samples * sizeof(double));
+    Point game_size = {BENCH_COLUMNS, BENCH_ROWS};
+    Cycle cycle;
+    if (bench.times == NULL || !createCycle(&cycle, game_size)) {
+        fprintf(stderr, "Couldn't allocate memory\n");
+        return -3;
+    }
+
+    fprintf(bench.output, "{\n  \"columns\": %d,\n  \"rows\": %d,\n  \"samples\": %d,\n  \"perf\": %s,\n  \"results\": [",
+            BENCH_COLUMNS, BENCH_ROWS, bench.samples, bench.counters != NULL ? "true" : "false");
+    bool success = runGameBenchmarks(&bench, &cycle, game_size)
+                   && runArenaBenchmarks(&bench)
+                   && runListBenchmarks(&bench)
+                   && runScoreFileBenchmarks(&bench);
+    if (success) {
+        runStringBenchmarks(&bench);
+        success = runRenderBenchmarks(&bench, &cycle);
+    }
+    fprintf(bench.output, "\n  ]\n}\n");
+
+    if (bench.counters != NULL)
+        closePerfCounters(bench.counters);
+    if (bench.output != stdout)
+        fclose(bench.output);
+    free(cycle.points);
+    free(bench.times);
+    if (!success) {
+        fprintf(stderr, "Benchmarks aborted\n");
+        return -3;
+    }
+    return 0;
+}
+
+void endGame(const Snek * snek) {
+    (void) snek;
+    closeScreen();
+}
+
+static void measure(Bench * bench, const char * name, const char * parameter, long long value,
+                    void (*body)(void *), void * context) {
+    // Warm up, and find a batch size that makes a sample long enough for the clock
+    long long batch = 1;
+    long long calls = 0;
+    long long start = now();
+    long long elapsed;
+    do {
+        long long batch_start = now();
+        for (long long i = 0; i < batch; i++)
+            body(context);
+        calls += batch;
+        if (now() - batch_start < BENCH_SAMPLE_NS)
+            batch *= 2;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_WARMUP_NS);
+    double per_call = (double) elapsed / (double) calls;
+
+    int samples = bench->samples;
+    if (per_call * (double) batch * samples > (double) BENCH_BUDGET_NS) {
+        samples = (int) ((double) BENCH_BUDGET_NS / (per_call * (double) batch));
+        if (samples < BENCH_MIN_SAMPLES)
+            samples = BENCH_MIN_SAMPLES < bench->samples ? BENCH_MIN_SAMPLES : bench->samples;
+    }
+    // The counters cover all samples, the time spent reading the clock between them is negligible
+    PerfCounts counts;
+    if (bench->counters != NULL)
+        startPerfCounters(bench->counters);
+    for (int sample = 0; sample < samples; sample++) {
+        long long sample_start = now();
+        for (long long i = 0; i < batch; i++)
+            body(context);
+        bench->times[sample] = (double) (now() - sample_start) / (double) batch;
+    }
+    if (bench->counters != NULL)
+        stopPerfCounters(bench->counters, &counts);
+    qsort(bench->times, samples, sizeof(double), compareTimes);
+    int p99 = (samples * 99 + 99) / 100 - 1;
+
+    fprintf(bench->output, "%s\n    {\"name\": \"%s\", ", bench->results++ == 0 ? "" : ",", name);
+    if (parameter != NULL)
+        fprintf(bench->output, "\"parameter\": \"%s\", \"value\": %lld, ", parameter, value);
+    fprintf(bench->output, "\"calls_per_sample\": %lld, \"samples\": %d, "
+                           "\"median_ns\": %.1f, \"p99_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f",
+            batch, samples, bench->times[samples / 2], bench->times[p99], bench->times[0], bench->times[samples - 1]);
+    if (bench->counters != NULL) {
+        // Events per call, unavailable events are left out
+        double calls_measured = (double) batch * samples;
+        fprintf(bench->output, ", \"perf\": {");
+        bool first = true;
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            if (!counts.available[i])
+                continue;
+            fprintf(bench->output, "%s\"%s\": %.2f", first ? "" : ", ", perfEventName((PerfEvent) i),
+                    counts.value[i] / calls_measured);
+            first = false;
+        }
+        fprintf(bench->output, "}");
+    }
+    fprintf(bench->output, "}");
+    fflush(bench->output);
+}
+
+static long long now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static int compareTimes(const void * a, const void * b) {
+    double first = *(const double *) a;
+    double second = *(const double *) b;
+    return (first > second) - (first < second);
+}
+
+static bool createCycle(Cycle * cycle, Point game_size) {
+    // The game area is the same as checked by isGameOver
+    int left = 1, right = game_size.x - 2, top = 2, bottom = game_size.y - 2;
+    cycle->length = (size_t) (right - left + 1) * (size_t) (bottom - top + 1);
+    cycle->points = malloc(cycle->length * sizeof(Point));
+    if (cycle->points == NULL)
+        return false;
+    size_t index = 0;
+    for (int x = left; x <= right; x++) {
+        bool downwards = (x - left) % 2 == 0;
+        for (int i = 0; i < bottom - top; i++)
+            cycle->points[index++] = (Point) {x, downwards ? top + 1 + i : bottom - i};
+    }
+    for (int x = right; x >= left; x--)
+        cycle->points[index++] = (Point) {x, top};
+    return true;
+}
+
+static bool createGameBench(GameBench * state, const Cycle * cycle, size_t length) {
+    Point game_size = state->snek.game_size;
+    memset(state, 0, sizeof(GameBench));
+    state->snek.game_size = game_size;
+    state->snek.direction = UP;
+    state->cycle = cycle;
+    state->snek.food = malloc(sizeof(Point));
+    if (state->snek.food == NULL || !createSnake(&state->snek))
+        return false;
+    *state->snek.food = (Point) {-1, -1};
+    LinkedList * snake = state->snek.snake;
+    // The single segment of a new snake becomes the tail
+    snake->toStart(snake);
+    *(Point *) snake->node->data = cycle->points[0];
+    for (size_t i = 1; i < length; i++) {
+        Point * segment = &state->snek.segments[state->snek.segment_count++];
+        *segment = cycle->points[i];
+        if (!snake->addFirst(snake, segment))
+            return false;
+    }
+    state->head = length - 1;
+    state->length = length;
+    return true;
+}
+
+static void freeGameBench(GameBench * state) {
+    freeSnake(&state->snek);
+    free(state->snek.food);
+}
+
+static void benchStepGame(void * context) {
+    GameBench * state = context;
+    size_t next = (state->head + 1) % state->cycle->length;
+    Point from = state->cycle->points[state->head];
+    Point to = state->cycle->points[next];
+    if (to.x > from.x)
+        state->snek.direction = RIGHT;
+    else if (to.x < from.x)
+        state->snek.direction = LEFT;
+    else
+        state->snek.direction = to.y > from.y ? DOWN : UP;
+    if (!stepGame(&state->snek)) {
+        fprintf(stderr, "The snake has died while following the cycle\n");
+        abort();
+    }
+    state->head = next;
+}
+
+static void benchPointInSnake(void * context) {
+    GameBench * state = context;
+    Point point = state->cycle->points[state->query];
+    sink += isPointInSnake(&state->snek, point.x, point.y, false);
+}
+
+static void benchPlaceNewFood(void * context) {
+    GameBench * state = context;
+    placeNewFood(&state->snek);
+    sink += state->snek.food->x;
+}
+
+static void benchListAddRemove(void * context) {
+    ListBench * state = context;
+    LinkedList * list = state->list;
+    list->addFirst(list, &state->values[0]);
+    list->toEnd(list);
+    sink += *(int *) list->detachItem(list);
+}
+
+static void benchListSeek(void * context) {
+    ListBench * state = context;
+    LinkedList * list = state->list;
+    list->seek(list, state->length / 2, BEGIN);
+    sink += *(int *) list->node->data;
+}
+
+static void benchGetHighscore(void * context) {
+    (void) context;
+    sink += getHighscore("player42");
+}
+
+static void benchGetToplist(void * context) {
+    (void) context;
+    NickDictionary * names = createNickDictionary();
+    Nick_Score * toplist = getToplist(TOPLIST_SIZE, names);
+    if (toplist == NULL) {
+        fprintf(stderr, "Couldn't read the toplist\n");
+        abort();
+    }
+    sink += toplist[0].score;
+    free(toplist);
+    freeNickDictionary(names);
+}
+
+static void benchStrlenUTF8(void * context) {
+    StringBench * state = context;
+    sink += (long long) strlenUTF8(state->string);
+}
+
+static void benchRenderFrame(void * context) {
+    GameBench * state = context;
+    benchStepGame(state);
+    drawGame();
+}
+
+static bool runGameBenchmarks(Bench * bench, const Cycle * cycle, Point game_size) {
+    // The snake needs a free block to step into
+    size_t lengths[] = {1, 16, 256, cycle->length / 2, cycle->length - 1};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        GameBench state;
+        state.snek.game_size = game_size;
+        if (!createGameBench(&state, cycle, lengths[i])) {
+            freeGameBench(&state);
+            return false;
+        }
+        if (selected(bench, "stepGame"))
+            measure(bench, "stepGame", "length", (long long) lengths[i], benchStepGame, &state);
+        // The block behind the tail, wherever the steps above have moved the snake
+        state.query = (state.head + cycle->length - state.length) % cycle->length;
+        if (selected(bench, "isPointInSnake"))
+            measure(bench, "isPointInSnake", "length", (long long) lengths[i], benchPointInSnake, &state);
+        freeGameBench(&state);
+    }
+    // Near a full game area most random blocks are taken by the snake
+    size_t free_blocks[] = {cycle->length / 2, 64, 8, 1};
+    if (!selected(bench, "placeNewFood"))
+        return true;
+    for (size_t i = 0; i < sizeof(free_blocks) / sizeof(free_blocks[0]); i++) {
+        GameBench state;
+        state.snek.game_size = game_size;
+        if (!createGameBench(&state, cycle, cycle->length - free_blocks[i])) {
+            freeGameBench(&state);
+            return false;
+        }
+        measure(bench, "placeNewFood", "free_blocks", (long long) free_blocks[i], benchPlaceNewFood, &state);
+        freeGameBench(&state);
+    }
+    return true;
+}
+
+static void benchStepArena(void * context) {
+    ArenaBench * state = context;
+    Arena * arena = state->arena;
+    for (size_t i = 0; i < arena->snake_count; i++)
+        steerArenaBot(arena, i);
+    if (stepArena(arena) < 0)
+        state->failed = true;
+    for (size_t i = 0; arena->alive < arena->snake_count && i < arena->snake_count; i++)
+        respawnArenaSnake(arena, i);
+}
+
+static bool runArenaBenchmarks(Bench * bench) {
+    if (!selected(bench, "stepArena"))
+        return true;
+    size_t snakes[] = {16, 128, 1024};
+    Point size = {BENCH_ARENA_COLUMNS, BENCH_ARENA_ROWS};
+    for (size_t i = 0; i < sizeof(snakes) / sizeof(snakes[0]); i++) {
+        // As much food as snakes, so the bots keep growing and dying
+        ArenaBench state = {createArena(size, snakes[i], snakes[i], 0x9E3779B97F4A7C15ULL), false};
+        if (state.arena == NULL)
+            return false;
+        measure(bench, "stepArena", "snakes", (long long) snakes[i], benchStepArena, &state);
+        freeArena(state.arena);
+        if (state.failed)
+            return false;
+    }
+    return true;
+}
+
+static bool runListBenchmarks(Bench * bench) {
+    int lengths[] = {16, 1024, BENCH_LIST_MAX};
+    ListBench state;
+    state.values = malloc(BENCH_LIST_MAX * sizeof(int));
+    state.list = createLinkedList();
+    if (state.values == NULL || state.list == NULL) {
+        free(state.values);
+        dumpLinkedList(state.list);
+        return false;
+    }
+    bool success = true;
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]) && success; i++) {
+        state.length = lengths[i];
+        for (int j = (int) state.list->size(state.list); j < state.length && success; j++) {
+            state.values[j] = j;
+            success = state.list->addFirst(state.list, &state.values[j]);
+        }
+        if (!success)
+            break;
+        if (selected(bench, "linkedlist_add_remove"))
+            measure(bench, "linkedlist_add_remove", "length", state.length, benchListAddRemove, &state);
+        if (selected(bench, "linkedlist_seek"))
+            measure(bench, "linkedlist_seek", "length", state.length, benchListSeek, &state);
+    }
+    // The values are owned by the benchmark
+    while (state.list->node != NULL)
+        state.list->detachItem(state.list);
+    dumpLinkedList(state.list);
+    free(state.values);
+    return success;
+}
+
+static bool runScoreFileBenchmarks(Bench * bench) {
+    if (!selected(bench, "getHighscore") && !selected(bench, "getToplist"))
+        return true;
+    char original[4096];
+    if (getcwd(original, sizeof(original)) == NULL || mkdtemp(work_directory) == NULL || chdir(work_directory) != 0) {
+        perror("Couldn't create the working directory");
+        return false;
+    }
+    bool success = true;
+    for (long lines = 10000; lines <= bench->max_lines && success; lines *= 10) {
+        success = generateScoreFile(lines);
+        if (!success)
+            break;
+        if (selected(bench, "getHighscore"))
+            measure(bench, "getHighscore", "lines", lines, benchGetHighscore, NULL);
+        if (selected(bench, "getToplist"))
+            measure(bench, "getToplist", "lines", lines, benchGetToplist, NULL);
+    }
+    unlink("scores.txt");
+    if (chdir(original) != 0 || rmdir(work_directory) != 0)
+        perror("Couldn't remove the working directory");
+    return success;
+}
+
+static void runStringBenchmarks(Bench * bench) {
+    if (!selected(bench, "strlenUTF8"))
+        return;
+    char ascii[] = "snek_player_15";
+    char accented[] = "\xc3\x81rv\xc3\xadzt\xc5\xb1r\xc5\x91 t\xc3\xbck\xc3\xb6rf\xc3\xbar\xc3\xb3g\xc3\xa9p";
+    // A long line of mixed characters, like a long message on the screen
+    char mixed[4096];
+    size_t length = 0;
+    while (length + sizeof(accented) < sizeof(mixed)) {
+        memcpy(mixed + length, accented, sizeof(accented) - 1);
+        length += sizeof(accented) - 1;
+    }
+    mixed[length] = '\0';
+    StringBench state = {ascii};
+    measure(bench, "strlenUTF8", "bytes", (long long) strlen(ascii), benchStrlenUTF8, &state);
+    state.string = accented;
+    measure(bench, "strlenUTF8", "bytes", (long long) strlen(accented), benchStrlenUTF8, &state);
+    state.string = mixed;
+    measure(bench, "strlenUTF8", "bytes", (long long) length, benchStrlenUTF8, &state);
+}
+
+static bool runRenderBenchmarks(Bench * bench, const Cycle * cycle) {
+    if (!selected(bench, "render_frame"))
+        return true;
+    size_t lengths[] = {1, 256, cycle->length - 1};
+    GameBench state;
+    memset(&state, 0, sizeof(GameBench));
+    if (!initializeHeadlessScreen(&state.snek, BENCH_COLUMNS, BENCH_ROWS)) {
+        fprintf(stderr, "Couldn't open a screen for TERM, skipping the render benchmarks\n");
+        return true;
+    }
+    bool success = true;
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]) && success; i++) {
+        success = createGameBench(&state, cycle, lengths[i]);
+        if (success) {
+            state.snek.score = (int) lengths[i];
+            state.snek.highscore = (int) lengths[i];
+            measure(bench, "render_frame", "length", (long long) lengths[i], benchRenderFrame, &state);
+        }
+        freeGameBench(&state);
+    }
+    closeScreen();
+    return success;
+}
+
+static bool generateScoreFile(long lines) {
+    FILE * file = fopen("scores.txt", "w");
+    if (file == NULL) {
+        perror("Couldn't write the score file");
+        return false;
+    }
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    for (long i = 0; i < lines; i++) {
+        // xorshift64
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        fprintf(file, "player%u,%u\n", (unsigned) (random % BENCH_PLAYERS), (unsigned) (random >> 40) % 2000);
+    }
+    if (fclose(file) != 0) {
+        perror("Couldn't write the score file");
+        return false;
+    }
+    return true;
+}
+
+static bool selected(const Bench * bench, const char * name) {
+    return bench->filter == NULL || strstr(name, bench->filter) != NULL;
+}
+
+static void printUsage(const char * program) {
+    fprintf(stderr, "Usage: %s [--json PATH] [--samples N] [--max-lines N] [--filter NAME] [--perf]\n", program);
+}
@@ -11,6 +11,8 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
 
 
 enum {
@@ -21,8 +23,12 @@ enum {
     /* canary byte */
     debugmalloc_canary_char = 'C',
 
-    /* hash table size for allocated entries */
-    debugmalloc_tablesize = 256,
+    /* number of independently locked shards of the allocation table, a power of two */
+    debugmalloc_shards = 64,
+
+    /* initial size of the hash table of a shard, a power of two.
+     * the table is doubled whenever it would become more than half full */
+    debugmalloc_tablesize = 64,
 
     /* max block size for allocation, can be modified with debugmalloc_max_block_size() */
     debugmalloc_max_block_size_default = 1048576
@@ -48,32 +54,66 @@ enum {
 #endif
 
 
-/* linked list entry for allocated blocks */
+/* entry for allocated blocks. the strings come from the macros below,
+ * they are literals, so only their addresses are stored. */
 typedef struct DebugmallocEntry {
     void *real_mem;     /* the address of the real allocation */
     void *user_mem;     /* address shown to the user */
     size_t size;        /* size of block requested by user */
 
-    char file[64];      /* malloc called in this file */
+    char const *file;   /* malloc called in this file */
+    char const *func;   /* allocation function called (malloc, calloc, realloc) */
+    char const *expr;   /* expression calculating the size of allocation */
     unsigned line;      /* malloc called at this line in file */
-    char func[32];      /* allocation function called (malloc, calloc, realloc) */
-    char expr[128];     /* expression calculating the size of allocation */
-
-    struct DebugmallocEntry *prev, *next;  /* for doubly linked list */
 } DebugmallocEntry;
 
 
+/* one shard of the allocation table. blocks are assigned to shards by
+ * their address, so threads working on different blocks rarely contend.
+ * aligned to a cache line to keep the locks of neighbours apart. */
+typedef struct DebugmallocShard {
+    pthread_mutex_t lock; /* protects the hash table and the counters of the shard */
+    DebugmallocEntry **table;  /* open addressing hash table of the allocated entries, null for empty slots */
+    size_t table_size;    /* number of slots in table, a power of two */
+    unsigned table_shift; /* 64 - log2(table_size), selects the hash bits below the shard bits */
+    long alloc_count;     /* currently allocated in the shard, sizes the table */
+} __attribute__((aligned(64))) DebugmallocShard;
+
+
+/* counters only ever modified by their own thread, merged when read. */
+typedef struct DebugmallocThreadStats {
+    long long all_alloc_count; /* all allocations, never decreased */
+    long long all_alloc_bytes;
+    long long all_free_count; /* all frees, never decreased */
+    struct DebugmallocThreadStats *next; /* next registered thread */
+} DebugmallocThreadStats;
+
+
+/* merged statistics of all shards and threads */
+typedef struct DebugmallocStats {
+    long alloc_count;     /* currently allocated */
+    long long alloc_bytes;
+    long long max_alloc_bytes; /* max memory used at one time */
+    long long max_alloc_count;
+    long long all_alloc_count; /* all allocations */
+    long long all_alloc_bytes;
+} DebugmallocStats;
+
+
 /* debugmalloc singleton, storing all state */
 typedef struct DebugmallocData {
+    DebugmallocShard shards[debugmalloc_shards]; /* the allocation table */
     char logfile[256];    /* log file name or empty string */
     long max_block_size;  /* max size of a single block allocated */
+    pthread_key_t thread_key;  /* DebugmallocThreadStats of the calling thread */
+    pthread_mutex_t threads_lock; /* protects the list of threads */
+    DebugmallocThreadStats *threads; /* every thread that has allocated, kept after it exits */
+    /* live counters of all shards, atomic. the maxima are raised with compare-and-swap,
+     * the maxima of the shards would add up to more than was ever used at once. */
     long alloc_count;     /* currently allocated; decreased with free */
     long long alloc_bytes;
-    long long max_alloc_bytes; /* max total memory used at one time */
-    long long max_alloc_count; /* max total blocks used at one time */
-    long all_alloc_count; /* all allocations, never decreased */
-    long long all_alloc_bytes;
-    DebugmallocEntry head[debugmalloc_tablesize], tail[debugmalloc_tablesize];  /* head and tail elements of allocation lists */
+    long long max_alloc_bytes; /* max memory used at one time */
+    long long max_alloc_count; /* max blocks used at one time */
 } DebugmallocData;
 
 
@@ -86,7 +126,9 @@ static DebugmallocData * debugmalloc_create(void);
  * to make sure it is really a singleton, these instances must know each other
  * somethow. an environment variable is used for that purpose, ie. the address
  * of the singleton allocated is stored by the operating system.
- * this implementation is not thread-safe. */
+ * creating the singleton is not thread-safe, the first allocation should
+ * happen before any other thread is started. once it exists, any thread
+ * may look it up. */
 static DebugmallocData * debugmalloc_singleton(void) {
     static char envstr[100];
     static void *instance = NULL;
@@ -94,26 +136,28 @@ static DebugmallocData * debugmalloc_singleton(void) {
     /* if we do not know the address of the singleton:
      * - maybe we are the one to create it (env variable also does not exist)
      * - or it is already created, and stored in the env variable. */
-    if (instance == NULL) {
+    void *known = __atomic_load_n(&instance, __ATOMIC_ACQUIRE);
+    if (known == NULL) {
         char envvarname[100] = "";
         sprintf(envvarname, "%s%d", "debugmallocsingleton", (int) getpid());
         char *envptr = getenv(envvarname);
         if (envptr == NULL) {
             /* no env variable: create singleton. */
-            instance = debugmalloc_create();
-            sprintf(envstr, "%s=%p", envvarname, instance);
+            known = debugmalloc_create();
+            sprintf(envstr, "%s=%p", envvarname, known);
             putenv(envstr);
         } else {
             /* another copy of this function already created it. */
-            int ok = sscanf(envptr, "%p", &instance);
+            int ok = sscanf(envptr, "%p", &known);
             if (ok != 1) {
                 fprintf(stderr, "debugmalloc: failed to interpret: %s!\n", envptr);
                 abort();
             }
         }
+        __atomic_store_n(&instance, known, __ATOMIC_RELEASE);
     }
 
-    return (DebugmallocData *) instance;
+    return (DebugmallocData *) known;
 }
 
 
@@ -253,18 +297,41 @@ static void debugmalloc_dump_elem(DebugmallocEntry const *elem) {
 }
 
 
+/* read the live counters and merge the counters of every thread. */
+static void debugmalloc_stats(DebugmallocStats *stats) {
+    DebugmallocData *instance = debugmalloc_singleton();
+    memset(stats, 0, sizeof(DebugmallocStats));
+    stats->alloc_count = __atomic_load_n(&instance->alloc_count, __ATOMIC_RELAXED);
+    stats->alloc_bytes = __atomic_load_n(&instance->alloc_bytes, __ATOMIC_RELAXED);
+    stats->max_alloc_bytes = __atomic_load_n(&instance->max_alloc_bytes, __ATOMIC_RELAXED);
+    stats->max_alloc_count = __atomic_load_n(&instance->max_alloc_count, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&instance->threads_lock);
+    for (DebugmallocThreadStats *iter = instance->threads; iter != NULL; iter = iter->next) {
+        stats->all_alloc_count += __atomic_load_n(&iter->all_alloc_count, __ATOMIC_RELAXED);
+        stats->all_alloc_bytes += __atomic_load_n(&iter->all_alloc_bytes, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&instance->threads_lock);
+}
+
+
 /* dump data of all memory blocks allocated. */
 static void debugmalloc_dump(void) {
     DebugmallocData *instance = debugmalloc_singleton();
+    DebugmallocStats stats;
+    debugmalloc_stats(&stats);
     debugmalloc_log("** DEBUGMALLOC DUMP ************************************\n");
     int cnt = 0;
-    for (size_t i = 0; i < debugmalloc_tablesize; i++) {
-        DebugmallocEntry *head = &instance->head[i];
-        for (DebugmallocEntry *iter = head->next; iter->next != NULL; iter = iter->next) {
-            ++cnt;
-            debugmalloc_log("** %d/%d. record:\n", cnt, instance->alloc_count);
-            debugmalloc_dump_elem(iter);
+    for (size_t i = 0; i < debugmalloc_shards; i++) {
+        DebugmallocShard *shard = &instance->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        for (size_t j = 0; j < shard->table_size; j++) {
+            if (shard->table[j] != NULL) {
+                ++cnt;
+                debugmalloc_log("** %d/%ld. record:\n", cnt, stats.alloc_count);
+                debugmalloc_dump_elem(shard->table[j]);
+            }
         }
+        pthread_mutex_unlock(&shard->lock);
     }
     debugmalloc_log("** DEBUGMALLOC DUMP END *******************************\n");
 }
@@ -273,9 +340,10 @@ static void debugmalloc_dump(void) {
 /* called at program exit to dump data if there is a leak,
  * ie. allocated block remained. */
 static void debugmalloc_atexit_dump(void) {
-    DebugmallocData *instance = debugmalloc_singleton();
+    DebugmallocStats stats;
+    debugmalloc_stats(&stats);
 
-    if (instance->alloc_count > 0) {
+    if (stats.alloc_count > 0) {
         debugmalloc_log("\n"
                         "********************************************************\n"
                         "* MEMORY LEAK FOUND!!!\n"
@@ -285,64 +353,147 @@ static void debugmalloc_atexit_dump(void) {
     } else {
         debugmalloc_log("****************************************************\n"
                         "* Debugmalloc: no memory leaks were found.\n"
-                        "* Allocated: %d blocks, %d bytes.\n"
-                        "* Maximum memory used: %d blocks, %d bytes.\n"
+                        "* Allocated: %lld blocks, %lld bytes.\n"
+                        "* Maximum memory used: %lld blocks, %lld bytes.\n"
                         "****************************************************\n",
-                        instance->all_alloc_count, instance->all_alloc_bytes,
-                        instance->max_alloc_count, instance->max_alloc_bytes);
+                        stats.all_alloc_count, stats.all_alloc_bytes,
+                        stats.max_alloc_count, stats.max_alloc_bytes);
     }
 }
 
 
-/* hash function for bucket hash. */
-static size_t debugmalloc_hash(void *address) {
-    /* the last few bits are ignored, as they are usually zero for
-     * alignment purposes. all tested architectures used 16 byte allocation. */
-    size_t cut = (size_t)address >> 4;
-    return cut % debugmalloc_tablesize;
+/* hash function for the table. the last few bits of the address are
+ * usually zero for alignment purposes, so they are shifted out, then the
+ * rest is mixed by fibonacci hashing. the top bits select the shard,
+ * the bits below them the slot. */
+static uint64_t debugmalloc_hash(void *address) {
+    uint64_t cut = (uint64_t) (uintptr_t) address >> 4;
+    return cut * 0x9E3779B97F4A7C15ULL;
+}
+
+
+/* find the shard of an address. */
+static DebugmallocShard *debugmalloc_shard(void *address) {
+    DebugmallocData *instance = debugmalloc_singleton();
+    return &instance->shards[debugmalloc_hash(address) >> 58 & (debugmalloc_shards - 1)];
+}
+
+
+/* home slot of an address in its shard. */
+static size_t debugmalloc_home(DebugmallocShard const *shard, void *address) {
+    return (size_t) ((debugmalloc_hash(address) << 6) >> shard->table_shift);
+}
+
+
+/* find the slot of an address, or the empty slot where it belongs.
+ * linear probing, the table is never more than half full. */
+static size_t debugmalloc_slot(DebugmallocShard const *shard, void *mem) {
+    size_t mask = shard->table_size - 1;
+    size_t idx = debugmalloc_home(shard, mem);
+    while (shard->table[idx] != NULL && shard->table[idx]->user_mem != mem)
+        idx = (idx + 1) & mask;
+    return idx;
+}
+
+
+/* double the size of the hash table of a shard. must be called with its lock held. */
+static void debugmalloc_grow(DebugmallocShard *shard) {
+    DebugmallocEntry **old_table = shard->table;
+    size_t old_size = shard->table_size;
+    DebugmallocEntry **table = (DebugmallocEntry **) calloc(old_size * 2, sizeof(DebugmallocEntry *));
+    if (table == NULL) {
+        debugmalloc_log("debugmalloc: failed to grow the allocation table\n");
+        abort();
+    }
+    shard->table = table;
+    shard->table_size = old_size * 2;
+    shard->table_shift -= 1;
+    for (size_t i = 0; i < old_size; i++)
+        if (old_table[i] != NULL)
+            shard->table[debugmalloc_slot(shard, old_table[i]->user_mem)] = old_table[i];
+    free(old_table);
+}
+
+
+/* counters of the calling thread, registered on its first allocation. */
+static DebugmallocThreadStats *debugmalloc_thread_stats(void) {
+    DebugmallocData *instance = debugmalloc_singleton();
+    DebugmallocThreadStats *stats = (DebugmallocThreadStats *) pthread_getspecific(instance->thread_key);
+    if (stats != NULL)
+        return stats;
+    stats = (DebugmallocThreadStats *) calloc(1, sizeof(DebugmallocThreadStats));
+    if (stats == NULL) {
+        debugmalloc_log("debugmalloc: failed to register thread\n");
+        abort();
+    }
+    pthread_setspecific(instance->thread_key, stats);
+    pthread_mutex_lock(&instance->threads_lock);
+    stats->next = instance->threads;
+    instance->threads = stats;
+    pthread_mutex_unlock(&instance->threads_lock);
+    return stats;
 }
 
 
 /* insert element to hash table. */
 static void debugmalloc_insert(DebugmallocEntry *entry) {
+    DebugmallocShard *shard = debugmalloc_shard(entry->user_mem);
+    pthread_mutex_lock(&shard->lock);
+    if ((size_t) (shard->alloc_count + 1) * 2 > shard->table_size)
+        debugmalloc_grow(shard);
+    shard->table[debugmalloc_slot(shard, entry->user_mem)] = entry;
+    shard->alloc_count += 1;
+    pthread_mutex_unlock(&shard->lock);
     DebugmallocData *instance = debugmalloc_singleton();
-    size_t idx = debugmalloc_hash(entry->user_mem);
-    DebugmallocEntry *head = &instance->head[idx];
-    entry->prev = head;
-    entry->next = head->next;
-    head->next->prev = entry;
-    head->next = entry;
-    instance->alloc_count += 1;
-    instance->alloc_bytes += entry->size;
-    if (instance->alloc_bytes > instance->max_alloc_bytes)
-        instance->max_alloc_bytes = instance->alloc_bytes;
-    if (instance->alloc_count > instance->max_alloc_count)
-        instance->max_alloc_count = instance->alloc_count;
-    instance->all_alloc_count += 1;
-    instance->all_alloc_bytes += entry->size;
+    long long bytes = __atomic_add_fetch(&instance->alloc_bytes, (long long) entry->size, __ATOMIC_RELAXED);
+    long long max_bytes = __atomic_load_n(&instance->max_alloc_bytes, __ATOMIC_RELAXED);
+    while (bytes > max_bytes && !__atomic_compare_exchange_n(&instance->max_alloc_bytes, &max_bytes, bytes, true,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    long long count = __atomic_add_fetch(&instance->alloc_count, 1, __ATOMIC_RELAXED);
+    long long max_count = __atomic_load_n(&instance->max_alloc_count, __ATOMIC_RELAXED);
+    while (count > max_count && !__atomic_compare_exchange_n(&instance->max_alloc_count, &max_count, count, true,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    /* only this thread writes its counters, the atomics are for the readers */
+    DebugmallocThreadStats *stats = debugmalloc_thread_stats();
+    __atomic_store_n(&stats->all_alloc_count, stats->all_alloc_count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->all_alloc_bytes, stats->all_alloc_bytes + (long long) entry->size, __ATOMIC_RELAXED);
 }
 
 
-/* remove element from hash table */
+/* remove element from hash table. the entries after it in its probe
+ * sequence are shifted back, so no tombstones are needed. */
 static void debugmalloc_remove(DebugmallocEntry *entry) {
+    DebugmallocShard *shard = debugmalloc_shard(entry->user_mem);
+    pthread_mutex_lock(&shard->lock);
+    size_t mask = shard->table_size - 1;
+    size_t hole = debugmalloc_slot(shard, entry->user_mem);
+    for (size_t idx = (hole + 1) & mask; shard->table[idx] != NULL; idx = (idx + 1) & mask) {
+        size_t home = debugmalloc_home(shard, shard->table[idx]->user_mem);
+        /* move the entry into the hole if its home slot is not between the hole and itself */
+        if (((idx - home) & mask) >= ((idx - hole) & mask)) {
+            shard->table[hole] = shard->table[idx];
+            hole = idx;
+        }
+    }
+    shard->table[hole] = NULL;
+    shard->alloc_count -= 1;
+    pthread_mutex_unlock(&shard->lock);
     DebugmallocData *instance = debugmalloc_singleton();
-    entry->next->prev = entry->prev;
-    entry->prev->next = entry->next;
-    instance->alloc_count -= 1;
-    instance->alloc_bytes -= entry->size;
+    __atomic_sub_fetch(&instance->alloc_bytes, (long long) entry->size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&instance->alloc_count, 1, __ATOMIC_RELAXED);
+    DebugmallocThreadStats *stats = debugmalloc_thread_stats();
+    __atomic_store_n(&stats->all_free_count, stats->all_free_count + 1, __ATOMIC_RELAXED);
 }
 
 
 /* find element in hash table, given with the memory address that the user sees.
- * @return the linked list entry, or null if not found. */
+ * @return the entry, or null if not found. */
 static DebugmallocEntry *debugmalloc_find(void *mem) {
-    DebugmallocData *instance = debugmalloc_singleton();
-    size_t idx = debugmalloc_hash(mem);
-    DebugmallocEntry *head = &instance->head[idx];
-    for (DebugmallocEntry *iter = head->next; iter->next != NULL; iter = iter->next)
-        if (iter->user_mem == mem)
-            return iter;
-    return NULL;
+    DebugmallocShard *shard = debugmalloc_shard(mem);
+    pthread_mutex_lock(&shard->lock);
+    DebugmallocEntry *found = shard->table[debugmalloc_slot(shard, mem)];
+    pthread_mutex_unlock(&shard->lock);
+    return found;
 }
 
 
@@ -367,7 +518,7 @@ static void *debugmalloc_malloc_full(size_t size, char const *func, char const *
         return NULL;
     }
 
-    /* allocate memory for linked list element */
+    /* allocate memory for the table entry */
     DebugmallocEntry *newentry = (DebugmallocEntry *) malloc(sizeof(DebugmallocEntry));
     if (newentry == NULL) {
         free(real_mem);
@@ -376,9 +527,9 @@ static void *debugmalloc_malloc_full(size_t size, char const *func, char const *
     }
 
     /* metadata of allocation: caller function, code line etc. */
-    debugmalloc_strlcpy(newentry->func, func, sizeof(newentry->func));
-    debugmalloc_strlcpy(newentry->expr, expr, sizeof(newentry->expr));
-    debugmalloc_strlcpy(newentry->file, file, sizeof(newentry->file));
+    newentry->func = func;
+    newentry->expr = expr;
+    newentry->file = file;
     newentry->line = line;
 
     /* address of allocated memory chunk */
@@ -399,7 +550,7 @@ static void *debugmalloc_malloc_full(size_t size, char const *func, char const *
 static void debugmalloc_free_inner(DebugmallocEntry *deleted) {
     debugmalloc_remove(deleted);
 
-    /* fill with garbage, then remove from linked list */
+    /* fill with garbage, then free the block and its entry */
     memset(deleted->real_mem, debugmalloc_canary_char, deleted->size + 2 * debugmalloc_canary_size);
     free(deleted->real_mem);
     free(deleted);
@@ -479,25 +630,37 @@ static DebugmallocData * debugmalloc_create(void) {
     (void) debugmalloc_log_file;
     (void) debugmalloc_max_block_size;
 
-    /* create and initialize instance */
-    DebugmallocData *instance = (DebugmallocData *) malloc(sizeof(DebugmallocData));
+    /* create and initialize instance, aligned for the shards */
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(DebugmallocData)) != 0)
+        memory = NULL;
+    DebugmallocData *instance = (DebugmallocData *) memory;
     if (instance == NULL) {
         debugmalloc_log("debugmalloc: failed to start debugmalloc\n");
         abort();
     }
     debugmalloc_strlcpy(instance->logfile, "", sizeof(instance->logfile));
     instance->max_block_size = debugmalloc_max_block_size_default;
+    pthread_key_create(&instance->thread_key, NULL);
+    pthread_mutex_init(&instance->threads_lock, NULL);
+    instance->threads = NULL;
     instance->alloc_count = 0;
     instance->alloc_bytes = 0;
-    instance->all_alloc_count = 0;
-    instance->all_alloc_bytes = 0;
     instance->max_alloc_bytes = 0;
     instance->max_alloc_count = 0;
-    for (size_t i = 0; i < debugmalloc_tablesize; i++) {
-        instance->head[i].prev = NULL;
-        instance->head[i].next = &instance->tail[i];
-        instance->tail[i].next = NULL;
-        instance->tail[i].prev = &instance->head[i];
+    for (size_t i = 0; i < debugmalloc_shards; i++) {
+        DebugmallocShard *shard = &instance->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->alloc_count = 0;
+        shard->table_size = debugmalloc_tablesize;
+        shard->table_shift = 64;
+        for (size_t size = 1; size < shard->table_size; size *= 2)
+            shard->table_shift -= 1;
+        shard->table = (DebugmallocEntry **) calloc(shard->table_size, sizeof(DebugmallocEntry *));
+        if (shard->table == NULL) {
+            debugmalloc_log("debugmalloc: failed to start debugmalloc\n");
+            abort();
+        }
     }
 
     atexit(debugmalloc_atexit_dump);
@@ -9,12 +9,37 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include "fileio.h"
-#include "debugmalloc.h"
+#include "trace.h"
+#include "allocator.h"
 
 /** @brief Buffer size for reading from file (greater than max line length) */
 #define BUFFER_SIZE 100
 
+/** @brief Default number of records committed together in \p DURABILITY_GROUP mode */
+#define DEFAULT_GROUP_SIZE 16
+
+/**
+ * @brief State of the score writer, the descriptor is kept open between records
+ */
+typedef struct {
+    /** @brief Descriptor of the scores file, -1 if not open */
+    int fd;
+    /** @brief When to fsync the written records */
+    Durability durability;
+    /** @brief Number of records per fsync in \p DURABILITY_GROUP mode */
+    int group_size;
+    /** @brief Records written since the last fsync */
+    int pending;
+    /** @brief Take an exclusive \p flock around each write */
+    bool use_flock;
+    /** @brief \p true once the configuration has been set or read from the environment */
+    bool configured;
+} ScoreWriter;
+
 /**
  * Returns a pointer to the Nick_Score item containing the minimum score.
  * If there are multiple, it will return the one with the smallest index.
@@ -32,21 +57,151 @@ static Nick_Score * getMinimumScore(Nick_Score * toplist, int size);
  */
 static void sortToplist(Nick_Score * toplist, int size);
 
+/**
+ * @brief Reads the writer configuration from the environment, unless it has already been set
+ */
+static void loadWriterConfiguration();
+
+/**
+ * @brief Writes a complete record with a single write call
+ * @param record bytes to write
+ * @param length number of bytes in \p record
+ * @return number of bytes written, -1 on failure (including short writes)
+ */
+static int writeRecord(const char * record, size_t length);
+
+/**
+ * @brief Saves player's score, see \p saveScore
+ * @param game the finished game
+ * @return number of bytes written to the scores file, -1 on failure
+ */
+static int writeScore(const GameRecord * game);
+
+/**
+ * @brief Reads the highscore of a player, see \p getHighscore
+ * @param name player name
+ * @return highscore of player, 0 if not found, -1 * (error code) on error
+ */
+static int readHighscore(char * name);
+
+/**
+ * @brief Reads the toplist, see \p getToplist
+ * @param toplist_size how many items the toplist should contain
+ * @param names dictionary to intern the names into
+ * @return dynamically allocated toplist, \p NULL on error
+ */
+static Nick_Score * readToplist(int toplist_size, NickDictionary * names);
+
 static const char scores_file[] = "scores.txt";
 
-int saveScore(char * name, int score) {
-    FILE * file = fopen(scores_file, "a");
-    if (file == NULL)
+static ScoreWriter writer = {-1, DURABILITY_NONE, DEFAULT_GROUP_SIZE, 0, false, false};
+
+void configureScoreWriter(Durability durability, int group_size, bool use_flock) {
+    writer.durability = durability;
+    writer.group_size = group_size > 0 ? group_size : DEFAULT_GROUP_SIZE;
+    writer.use_flock = use_flock;
+    writer.configured = true;
+}
+
+static void loadWriterConfiguration() {
+    if (writer.configured)
+        return;
+    Durability durability = DURABILITY_NONE;
+    int group_size = DEFAULT_GROUP_SIZE;
+    const char * mode = getenv("SNEK_SCORE_DURABILITY");
+    if (mode != NULL) {
+        if (strcmp(mode, "record") == 0) {
+            durability = DURABILITY_RECORD;
+        } else if (strncmp(mode, "group", 5) == 0) {
+            durability = DURABILITY_GROUP;
+            if (mode[5] == ':')
+                group_size = atoi(mode + 6);
+        }
+    }
+    const char * lock = getenv("SNEK_SCORE_LOCK");
+    configureScoreWriter(durability, group_size, lock != NULL && strcmp(lock, "flock") == 0);
+}
+
+static int writeRecord(const char * record, size_t length) {
+    if (writer.use_flock) {
+        while (flock(writer.fd, LOCK_EX) != 0)
+            if (errno != EINTR)
+                return -1;
+    }
+    ssize_t written;
+    do {
+        written = write(writer.fd, record, length);
+    } while (written < 0 && errno == EINTR);
+    if (writer.use_flock)
+        flock(writer.fd, LOCK_UN);
+    // A partial append cannot be completed without risking interleaving with other writers
+    if (written != (ssize_t) length)
         return -1;
-    if (strlen(name) > 80)
-        name[81] = '\0';
-    int result = fprintf(file, "%s,%d\n", name, score);
-    if (fclose(file) != 0)
+    return (int) written;
+}
+
+int saveScore(const GameRecord * game) {
+    TRACE_BEGIN("saveScore");
+    int result = writeScore(game);
+    TRACE_END("saveScore");
+    return result;
+}
+
+static int writeScore(const GameRecord * game) {
+    loadWriterConfiguration();
+    if (writer.fd < 0) {
+        writer.fd = open(scores_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (writer.fd < 0)
+            return -1;
+    }
+    char record[BUFFER_SIZE];
+    int length = snprintf(record, BUFFER_SIZE, "%.80s,%d\n", game->nick, game->score);
+    if (length < 0 || length >= BUFFER_SIZE)
+        return -1;
+    int result = writeRecord(record, (size_t) length);
+    if (result < 0)
         return -1;
+    // The archive is secondary, the scores file stays the record of truth
+    appendArchiveRecord(game);
+    switch (writer.durability) {
+        case DURABILITY_RECORD:
+            if (fdatasync(writer.fd) != 0)
+                return -1;
+            break;
+        case DURABILITY_GROUP:
+            if (++writer.pending >= writer.group_size) {
+                writer.pending = 0;
+                if (fdatasync(writer.fd) != 0)
+                    return -1;
+            }
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+int closeScoreWriter() {
+    if (writer.fd < 0)
+        return 0;
+    int result = 0;
+    if (writer.pending > 0 && fdatasync(writer.fd) != 0)
+        result = -1;
+    writer.pending = 0;
+    if (close(writer.fd) != 0)
+        result = -1;
+    writer.fd = -1;
     return result;
 }
 
 int getHighscore(char * name) {
+    TRACE_BEGIN("getHighscore");
+    int score = readHighscore(name);
+    TRACE_END("getHighscore");
+    return score;
+}
+
+static int readHighscore(char * name) {
     FILE * file = fopen(scores_file, "r");
     if (file == NULL)
         return 0;
@@ -54,8 +209,10 @@ int getHighscore(char * name) {
     int score = 0;
     while (fgets(buffer, BUFFER_SIZE, file) != NULL) {
         char * separator = strchr(buffer, ',');
-        if (separator == NULL)
+        if (separator == NULL) {
+            fclose(file);
             return -EBADF;
+        }
         *separator = '\0';
         if (strcmp(buffer, name) == 0) {
             int line_score;
@@ -64,22 +221,36 @@ int getHighscore(char * name) {
                 score = line_score;
         }
     }
+    fclose(file);
     return score;
 }
 
-Nick_Score * getToplist(int toplist_size) {
+Nick_Score * getToplist(int toplist_size, NickDictionary * names) {
+    TRACE_BEGIN("getToplist");
+    Nick_Score * toplist = readToplist(toplist_size, names);
+    TRACE_END("getToplist");
+    return toplist;
+}
+
+static Nick_Score * readToplist(int toplist_size, NickDictionary * names) {
     const int nick_max_size = NICK_MAX_LENGTH;
     FILE * file = fopen(scores_file, "r");
-    Nick_Score * toplist = calloc(toplist_size, sizeof(Nick_Score));
     if (file == NULL) {
         errno = ENOENT;
         return NULL;
     }
+    Nick_Score * toplist = calloc(toplist_size, sizeof(Nick_Score));
+    if (toplist == NULL) {
+        fclose(file);
+        return NULL;
+    }
     char buffer[BUFFER_SIZE];
     while (fgets(buffer, BUFFER_SIZE, file) != NULL) {
         int score = 0;
         char * separator = strchr(buffer, ',');
         if (separator == NULL) {
+            fclose(file);
+            free(toplist);
             errno = EBADF;
             return NULL;
         } else if (separator - buffer > nick_max_size) {
@@ -93,12 +264,18 @@ Nick_Score * getToplist(int toplist_size) {
         Nick_Score * min = getMinimumScore(toplist, toplist_size);
         if (min->score <= score) {
             // Not the most efficient way, but good enough for us
-            free(min->nick);
-            min->nick = malloc((strlen(buffer) + 1) * sizeof(char));
-            strcpy(min->nick, buffer);
+            PlayerId player = internNick(names, buffer, separator - buffer);
+            if (player == PLAYER_NONE) {
+                fclose(file);
+                free(toplist);
+                return NULL;
+            }
+            min->nick = (char *) getNick(names, player);
             min->score = score;
+            min->player = player;
         }
     }
+    fclose(file);
     sortToplist(toplist, toplist_size);
     return toplist;
 }
@@ -123,13 +300,9 @@ static void sortToplist(Nick_Score * toplist, int size) {
                 rangeMaximum = j;
         }
         if (rangeMaximum != i) {
-            int temp_score = toplist[i].score;
-            toplist[i].score = toplist[rangeMaximum].score;
-            toplist[rangeMaximum].score = temp_score;
-
-            char * temp_string = toplist[i].nick;
-            toplist[i].nick = toplist[rangeMaximum].nick;
-            toplist[rangeMaximum].nick = temp_string;
+            Nick_Score temp = toplist[i];
+            toplist[i] = toplist[rangeMaximum];
+            toplist[rangeMaximum] = temp;
         }
     }
 }
@@ -6,14 +6,51 @@
 #define SNEK_FILEIO_H
 
 #include "snek.h"
+#include "archive.h"
+#include "nickdict.h"
 
 /**
+ * @brief Durability guarantee of the records written by \p saveScore
+ */
+typedef enum Durability {
+    /** @brief Leave flushing to the operating system */
+    DURABILITY_NONE,
+    /** @brief Call fsync after every record */
+    DURABILITY_RECORD,
+    /** @brief Call fsync once per group of records (group commit) */
+    DURABILITY_GROUP
+} Durability;
+
+/**
+ * Configures the score writer. Records are always emitted with a single
+ * \p O_APPEND write, \p use_flock additionally serializes writers with \p flock,
+ * which is useful on file systems that do not honour \p O_APPEND atomically (e.g. NFS).
+ * If never called, the configuration is read from the \p SNEK_SCORE_DURABILITY
+ * ("none", "record" or "group[:size]") and \p SNEK_SCORE_LOCK ("flock") environment variables.
+ * @brief Configures the score writer
+ * @param durability when to fsync the written records
+ * @param group_size number of records per fsync in \p DURABILITY_GROUP mode
+ * @param use_flock take an exclusive \p flock around each write
+ */
+void configureScoreWriter(Durability durability, int group_size, bool use_flock);
+
+/**
+ * Saves player's score. The whole record is written with one \p write(2) call
+ * on a descriptor opened with \p O_APPEND, so concurrent games never interleave records.
+ * The game is also added to the score archive with all of its metadata.
  * @brief Saves player's score
- * @param name player name
- * @param score score achieved in this round
- * @return result of fprintf, -1 on failure
+ * @param game the finished game
+ * @return number of bytes written to the scores file, -1 on failure
+ */
+int saveScore(const GameRecord *);
+
+/**
+ * Commits records pending in \p DURABILITY_GROUP mode and closes the scores file.
+ * Safe to call multiple times, and also if nothing has been saved.
+ * @brief Flushes and closes the score writer
+ * @return 0 on success, -1 if the pending records could not be synced
  */
-int saveScore(char *, int);
+int closeScoreWriter();
 
 /**
  * @brief Retrieves the highscore of a given player from the scores file
@@ -25,11 +62,12 @@ int getHighscore(char *);
 /**
  * Reads the toplist from the scores file. This method creates a \p dynamically allocated
  * Nick_Score list of the desired size (set by \p toplist_size ).
- * Names in the array are also dynamically allocated.
+ * Names in the array are interned into \p names and are freed with the dictionary.
  * @brief Returns a toplist containing the highest scores
  * @param toplist_size how many items should the toplist contain
+ * @param names dictionary to intern the names into
  * @return toplist pointer to the toplist of desired size
  */
-Nick_Score * getToplist(int);
+Nick_Score * getToplist(int, NickDictionary *);
 
 #endif //SNEK_FILEIO_H
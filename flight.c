@@ -0,0 +1,143 @@
+/**
+ * Decoder of the flight recordings of the game. Prints how the game ended,
+ * then the recorded ticks from the oldest to the newest, or only the last ones.
+ * A recording can be decoded while the game is still running, or after it has
+ * crashed, as the records are complete once they are counted.
+ * \file flight.c
+ * \author hexadec
+ * \brief This file contains the flight recording decoder
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flightrec.h"
+#include "allocator.h"
+
+/**
+ * @brief Describes how a recorded game has ended
+ * @param end \p FlightEnd of the recording
+ * @return description of the ending
+ */
+static const char * describeEnd(int32_t);
+
+/**
+ * @brief Prints a recorded tick
+ * @param record the tick
+ */
+static void printRecord(const FlightRecord *);
+
+/**
+ * @brief Prints the usage of the program
+ * @param program name of the executable
+ */
+static void printUsage(const char *);
+
+/**
+ * \p --last limits the output to the given number of the newest ticks.
+ * @brief Entry point of the decoder
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @return 0 on success, 1 on wrong arguments, 2 if the recording cannot be read, -3 if there is not enough memory
+ */
+int main(int argc, char ** argv) {
+    long last = -1;
+    const char * path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--last") == 0 && i + 1 < argc) {
+            last = atol(argv[++i]);
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (path == NULL || (last < 0 && last != -1)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 2;
+    }
+    FlightHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, FLIGHT_MAGIC, sizeof(header.magic)) != 0
+        || header.record_size != sizeof(FlightRecord) || header.capacity == 0) {
+        fprintf(stderr, "%s is not a flight recording of this version\n", path);
+        fclose(file);
+        return 2;
+    }
+    FlightRecord * records = malloc(header.capacity * sizeof(FlightRecord));
+    if (records == NULL) {
+        fclose(file);
+        fprintf(stderr, "Couldn't allocate memory\n");
+        return -3;
+    }
+    if (fread(records, sizeof(FlightRecord), header.capacity, file) != header.capacity) {
+        fprintf(stderr, "%s is truncated\n", path);
+        free(records);
+        fclose(file);
+        return 2;
+    }
+    fclose(file);
+
+    char started[32];
+    time_t start_time = (time_t) header.started;
+    strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", localtime(&start_time));
+    // After the ring has wrapped, the oldest slot is the next one written, it may be torn by a crash
+    uint64_t kept = header.written < header.capacity ? header.written : header.capacity - 1;
+    uint64_t shown = last >= 0 && (uint64_t) last < kept ? (uint64_t) last : kept;
+    printf("pid %d, started %s, game area %dx%d\n", header.pid, started, header.columns, header.rows);
+    printf("end: %s\n", describeEnd(header.end));
+    printf("ticks: %llu recorded, %llu kept, %llu shown\n",
+           (unsigned long long) header.written, (unsigned long long) kept, (unsigned long long) shown);
+    printf("%8s %12s %10s %5s %5s %9s %9s %6s %5s\n", "tick", "time_ms", "busy_us", "key", "dir", "head", "food", "score", "alive");
+    for (uint64_t i = header.written - shown; i < header.written; i++)
+        printRecord(&records[i % header.capacity]);
+    free(records);
+    return 0;
+}
+
+static const char * describeEnd(int32_t end) {
+    switch (end) {
+        case FLIGHT_RUNNING:
+            return "none, the game is running or has crashed";
+        case FLIGHT_FINISHED:
+            return "finished";
+        case FLIGHT_MALLOC_ERROR:
+            return "aborted, out of memory";
+        case FLIGHT_RESIZED:
+            return "aborted, terminal resized";
+        case FLIGHT_TOO_SMALL:
+            return "aborted, terminal too small";
+        case FLIGHT_ALLOCATION_ERROR:
+            return "aborted, a tick allocated memory";
+        default:
+            return "unknown";
+    }
+}
+
+static void printRecord(const FlightRecord * record) {
+    static const char * directions[] = {[UP] = "up", [DOWN] = "down", [LEFT] = "left", [RIGHT] = "right"};
+    char key[8];
+    if (record->key == -1)
+        strcpy(key, "-");
+    else if (record->key > ' ' && record->key < 127)
+        sprintf(key, "%c", record->key);
+    else
+        sprintf(key, "%d", record->key);
+    char head[16];
+    char food[16];
+    sprintf(head, "%d,%d", record->head_x, record->head_y);
+    sprintf(food, "%d,%d", record->food_x, record->food_y);
+    printf("%8u %12.3f %10.1f %5s %5s %9s %9s %6d %5s\n", record->tick, (double) record->time_ns / 1E6,
+           (double) record->busy_ns / 1E3, key, record->direction <= RIGHT ? directions[record->direction] : "?",
+           head, food, record->score, record->alive ? "yes" : "no");
+}
+
+static void printUsage(const char * program) {
+    fprintf(stderr, "Usage: %s [--last N] RECORDING\n", program);
+}
@@ -0,0 +1,96 @@
+/**
+ * The recording is a \p FlightHeader followed by a ring of \p FlightRecord -s,
+ * in a file mapped shared, so the stores reach the page cache and survive the
+ * process. A record is written before \p written is advanced with a release
+ * store, so a torn record of a crash is never counted. Once the ring has wrapped,
+ * the record being written overwrites the oldest one, which is not shown then.
+ * \file flightrec.c
+ * \author hexadec
+ * \brief This file contains the flight recorder of the game
+ */
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "flightrec.h"
+#include "allocator.h"
+
+/** @brief The mapped recording, \p NULL if the flight recorder is not running */
+static FlightHeader * recording;
+
+/** @brief Records of the mapped recording */
+static FlightRecord * records;
+
+/** @brief Start of the recording, the times of the records are relative to it */
+static struct timespec started;
+
+bool startFlightRecorder(const Snek * snek) {
+    const char * path = getenv("SNEK_FLIGHT_RECORDER");
+    if (recording != NULL || path == NULL || path[0] == '\0')
+        return recording != NULL;
+    size_t size = sizeof(FlightHeader) + FLIGHT_RECORDER_TICKS * sizeof(FlightRecord);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        return false;
+    }
+    void * mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    // The file is truncated, so everything not set here is zero
+    FlightHeader * header = mapping;
+    memcpy(header->magic, FLIGHT_MAGIC, sizeof(header->magic));
+    header->capacity = FLIGHT_RECORDER_TICKS;
+    header->record_size = sizeof(FlightRecord);
+    header->pid = (int32_t) getpid();
+    header->end = FLIGHT_RUNNING;
+    header->started = (int64_t) time(NULL);
+    header->columns = (int16_t) snek->game_size.x;
+    header->rows = (int16_t) snek->game_size.y;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &started);
+    records = (FlightRecord *) (header + 1);
+    recording = header;
+    return true;
+}
+
+void recordFlightTick(Snek * snek, int key, bool alive, long long busy_ns) {
+    if (recording == NULL)
+        return;
+    struct timespec now;
+    // Answered by the vDSO, without entering the kernel
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    uint64_t written = recording->written;
+    FlightRecord * record = &records[written % FLIGHT_RECORDER_TICKS];
+    snek->snake->toStart(snek->snake);
+    const Point * head = snek->snake->node->data;
+    record->tick = (uint32_t) snek->ticks;
+    record->key = (int16_t) key;
+    record->direction = (uint8_t) snek->direction;
+    record->alive = alive;
+    record->time_ns = (now.tv_sec - started.tv_sec) * 1000000000LL + (now.tv_nsec - started.tv_nsec);
+    record->busy_ns = busy_ns > UINT32_MAX ? UINT32_MAX : (uint32_t) busy_ns;
+    record->score = snek->score;
+    record->head_x = (int16_t) head->x;
+    record->head_y = (int16_t) head->y;
+    record->food_x = (int16_t) snek->food->x;
+    record->food_y = (int16_t) snek->food->y;
+    __atomic_store_n(&recording->written, written + 1, __ATOMIC_RELEASE);
+}
+
+void markFlightEnd(FlightEnd end) {
+    if (recording != NULL)
+        __atomic_store_n(&recording->end, (int32_t) end, __ATOMIC_RELEASE);
+}
+
+void stopFlightRecorder() {
+    if (recording == NULL)
+        return;
+    munmap(recording, sizeof(FlightHeader) + FLIGHT_RECORDER_TICKS * sizeof(FlightRecord));
+    recording = NULL;
+    records = NULL;
+}
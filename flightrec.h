@@ -0,0 +1,135 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_FLIGHTREC_H
+#define SNEK_FLIGHTREC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "snek.h"
+
+/*
+ * Flight recorder of the last ticks of the game, for diagnosing crashes.
+ * Enabled by the SNEK_FLIGHT_RECORDER environment variable, holding the path
+ * of the recording. The recording is a file mapped into memory, so it keeps
+ * what was written even if the process is killed, and can be decoded by
+ * snek_flight afterwards.
+ */
+
+/** @brief Identifies a flight recording, the version is the last character */
+#define FLIGHT_MAGIC "SNEKFLT1"
+
+/** @brief Number of ticks kept by the flight recorder */
+#define FLIGHT_RECORDER_TICKS 4096
+
+/**
+ * @brief How the recorded game ended
+ */
+typedef enum FlightEnd {
+    /** @brief The game has not ended, if the process is gone, it has crashed */
+    FLIGHT_RUNNING = 0,
+    /** @brief The game has ended normally */
+    FLIGHT_FINISHED,
+    /** @brief Aborted, there was not enough memory */
+    FLIGHT_MALLOC_ERROR,
+    /** @brief Aborted, the terminal has been resized */
+    FLIGHT_RESIZED,
+    /** @brief Aborted, the terminal is too small */
+    FLIGHT_TOO_SMALL,
+    /** @brief Aborted, a tick has allocated memory in strict mode */
+    FLIGHT_ALLOCATION_ERROR
+} FlightEnd;
+
+/**
+ * @brief Beginning of a flight recording, followed by the records
+ */
+typedef struct FlightHeader {
+    /** @brief \p FLIGHT_MAGIC without the terminating zero */
+    char magic[8];
+    /** @brief Number of records the file has room for */
+    uint32_t capacity;
+    /** @brief Size of a record, to detect incompatible builds */
+    uint32_t record_size;
+    /** @brief Process that recorded the game */
+    int32_t pid;
+    /** @brief \p FlightEnd of the game */
+    int32_t end;
+    /** @brief Start of the recording, in seconds since the epoch */
+    int64_t started;
+    /** @brief Size of the game area */
+    int16_t columns;
+    /** @brief Size of the game area */
+    int16_t rows;
+    /** @brief Reserved, zero */
+    int32_t reserved;
+    /**
+     * The slot at this index is not part of the recording once the ring has wrapped,
+     * it is overwritten by the next record, so at most \p capacity - 1 records are kept.
+     * @brief Number of records written, the next one goes to the index of this modulo \p capacity
+     */
+    uint64_t written;
+} FlightHeader;
+
+/**
+ * @brief State of the game after a tick
+ */
+typedef struct FlightRecord {
+    /** @brief Number of the tick */
+    uint32_t tick;
+    /** @brief Key that was pressed in the tick, -1 if none */
+    int16_t key;
+    /** @brief \p Direction of the snake */
+    uint8_t direction;
+    /** @brief Whether the snake survived the tick */
+    uint8_t alive;
+    /** @brief Time of the end of the tick, in nanoseconds since the start of the recording */
+    int64_t time_ns;
+    /** @brief Time the tick took to draw and step, in nanoseconds */
+    uint32_t busy_ns;
+    /** @brief Score after the tick */
+    int32_t score;
+    /** @brief Position of the head of the snake */
+    int16_t head_x;
+    /** @brief Position of the head of the snake */
+    int16_t head_y;
+    /** @brief Position of the food */
+    int16_t food_x;
+    /** @brief Position of the food */
+    int16_t food_y;
+} FlightRecord;
+
+/**
+ * Creates the recording at the path in SNEK_FLIGHT_RECORDER, replacing an earlier one.
+ * Does nothing if the variable is not set.
+ * @brief Starts the flight recorder
+ * @param snek holds all important game parameters, its game area has to be known
+ * @return \p true if the ticks are recorded, \p false otherwise
+ */
+bool startFlightRecorder(const Snek *);
+
+/**
+ * A few stores into the mapped file, no system calls.
+ * Does nothing if the flight recorder has not been started.
+ * @brief Records the state of the game after a tick
+ * @param snek holds all important game parameters
+ * @param key key pressed in the tick, -1 if none
+ * @param alive whether the snake survived the tick
+ * @param busy_ns time the tick took, without waiting for the player
+ */
+void recordFlightTick(Snek *, int, bool, long long);
+
+/**
+ * Safe to call from a signal handler.
+ * Does nothing if the flight recorder has not been started.
+ * @brief Records how the game has ended
+ * @param end how the game has ended
+ */
+void markFlightEnd(FlightEnd);
+
+/**
+ * @brief Unmaps the recording, it is kept on the disk
+ */
+void stopFlightRecorder();
+
+#endif //SNEK_FLIGHTREC_H
@@ -0,0 +1,133 @@
+/**
+ * The rules of the game, independent of the terminal front end: moving and
+ * growing the snake, placing the food and checking for the end of the game.
+ * \file game.c
+ * \author hexadec
+ * \brief This file contains the rules of the game
+ */
+
+#include <stdlib.h>
+#include <sys/random.h>
+#include "game.h"
+#include "trace.h"
+#include "allocator.h"
+
+bool createSnake(Snek * snek) {
+    snek->snake = createLinkedList();
+    if (snek->snake == NULL) return false;
+
+    // The snake cannot be longer than the game area, plus the head that has hit something
+    snek->segment_capacity = (size_t) (snek->game_size.x - 2) * (size_t) (snek->game_size.y - 3) + 1;
+    snek->segment_count = 0;
+    snek->spare_segment = NULL;
+    snek->segments = malloc(snek->segment_capacity * sizeof(Point));
+    if (snek->segments == NULL) return false;
+    if (!snek->snake->reserve(snek->snake, snek->segment_capacity)) return false;
+
+    Point * first = &snek->segments[snek->segment_count++];
+    first->x = snek->game_size.x / 2;
+    first->y = snek->game_size.y / 2;
+    return snek->snake->addFirst(snek->snake, first);
+}
+
+void freeSnake(const Snek * snek) {
+    // The positions are owned by the segments block, only the nodes are freed
+    while (snek->snake != NULL && snek->snake->node != NULL)
+        snek->snake->detachItem(snek->snake);
+    dumpLinkedList(snek->snake);
+    free(snek->segments);
+}
+
+bool stepGame(Snek * snek) {
+    TRACE_BEGIN("stepGame");
+    bool alive = addNewHead(snek) && !isGameOver(snek);
+    if (alive) {
+        LinkedList * snake = snek->snake;
+        snake->toStart(snake);
+        Point * head = snake->node->data;
+        if (head->x == snek->food->x && head->y == snek->food->y) {
+            snek->score++;
+            snek->food_eaten++;
+            placeNewFood(snek);
+        } else {
+            snake->toEnd(snake);
+            snek->spare_segment = snake->detachItem(snake);
+        }
+    }
+    TRACE_END("stepGame");
+    return alive;
+}
+
+bool addNewHead(Snek * snek) {
+    LinkedList * snake = snek->snake;
+    snake->toStart(snake);
+    Point * head = snake->node->data;
+    Point * new = snek->spare_segment;
+    snek->spare_segment = NULL;
+    if (new == NULL) {
+        // The snake is over before this happens, unless it fills the whole game area
+        if (snek->segment_count == snek->segment_capacity) return false;
+        new = &snek->segments[snek->segment_count++];
+    }
+    switch (snek->direction) {
+        case UP:
+            new->x = head->x;
+            new->y = head->y - 1;
+            break;
+        case DOWN:
+            new->x = head->x;
+            new->y = head->y + 1;
+            break;
+        case LEFT:
+            new->x = head->x - 1;
+            new->y = head->y;
+            break;
+        case RIGHT:
+            new->x = head->x + 1;
+            new->y = head->y;
+            break;
+    }
+    // The nodes have been reserved, adding one does not allocate
+    return snake->addFirst(snake, new);
+}
+
+void placeNewFood(Snek * snek) {
+    TRACE_BEGIN("placeNewFood");
+    int x, y;
+    unsigned int coords[2];
+    do {
+        //Generate cryptographically secure random numbers (for fun) (syscall!)
+        getrandom(&coords, 2 * sizeof(unsigned int), GRND_RANDOM);
+        x = (int) (coords[0] % (snek->game_size.x - 2) + 1);
+        y = (int) (coords[1] % (snek->game_size.y - 3) + 2);
+    } while (isPointInSnake(snek, x, y, false));
+    snek->food->x = x;
+    snek->food->y = y;
+    TRACE_END("placeNewFood");
+}
+
+bool isGameOver(const Snek * snek) {
+    LinkedList * snake = snek->snake;
+    snake->toStart(snake);
+    Point * head = snake->node->data;
+    if (head->x < 1 || head->y < 2)
+        return true;
+    if (head->x > snek->game_size.x - 2 || head->y > snek->game_size.y - 2)
+        return true;
+    return isPointInSnake(snek, head->x, head->y, true);
+}
+
+bool isPointInSnake(const Snek * snek, int x, int y, bool ignore_head) {
+    LinkedList * snake = snek->snake;
+    snake->toStart(snake);
+    if (ignore_head) {
+        if (!snake->hasNext(snake)) return false;
+        else snake->next(snake);
+    }
+    do {
+        Point * point = snake->node->data;
+        if (point->x == x && point->y == y)
+            return true;
+    } while (snake->next(snake));
+    return false;
+}
@@ -0,0 +1,70 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_GAME_H
+#define SNEK_GAME_H
+
+#include <stdbool.h>
+#include "snek.h"
+
+/**
+ * Reserves the positions and the list nodes of every segment the snake can have,
+ * so the game can be stepped without allocating memory.
+ * @brief Creates the snake with a single segment in the middle of the game area
+ * @param snek holds all important game parameters, \p game_size has to be set
+ * @return \p true on success, \p false if there is not enough memory
+ */
+bool createSnake(Snek *);
+
+/**
+ * Does nothing if the snake has not been created, and frees what has been
+ * created if \p createSnake has failed.
+ * @brief Frees the snake and its reserved memory
+ * @param snek holds all important game parameters
+ */
+void freeSnake(const Snek *);
+
+/**
+ * Steps the game to its next state. This includes moving the snake and placing a new food
+ * @brief Steps the game to its next state
+ * @param snek holds all important game parameters
+ * @return \p false if an exit condition has been met, \p true otherwise
+ */
+bool stepGame(Snek *);
+
+/**
+ * @brief Adds a new head to the snake to the direction specified
+ * @param snek holds all important game parameters
+ * @return \p false if the snake has filled the game area, \p true otherwise
+ */
+bool addNewHead(Snek *);
+
+/**
+ * Places a new food in the game in a random position, on a block that is not occupied by the snake
+ * @brief Places a new food in the game
+ * @param snek holds all important game parameters
+ */
+void placeNewFood(Snek *);
+
+/**
+ * Checks if an end-of-game condition has been met.
+ * This includes the snake biting on its tail and hitting a wall.
+ * @brief Checks if an end-of-game condition has been met.
+ * @param snek holds all important game parameters
+ * @return \p true if an end-of-game condition has been met, \p false otherwise
+ */
+bool isGameOver(const Snek *);
+
+/**
+ * @brief Checks if a given point is occupied by the snake
+ * @param snek holds all important game parameters
+ * @param x column index
+ * @param y row index
+ * @param ignore_head do not check for x, y point in the head of the snake
+ * @return \p true if the point is inside the snake, \p false otherwise
+ */
+bool isPointInSnake(const Snek *, int, int, bool);
+
+
+#endif //SNEK_GAME_H
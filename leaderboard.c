@@ -0,0 +1,204 @@
+/**
+ * The leaderboard is an indexable skip list, as described by William Pugh
+ * in his "Skip List Cookbook". Every link also stores its span, the number
+ * of nodes it jumps over, so the rank of a node can be summed up while it is
+ * searched, and the node at a given rank can be found the same way.
+ * \file leaderboard.c
+ * \author hexadec
+ * \brief This file contains the order-statistics index of the best scores
+ */
+
+#include <stdlib.h>
+#include "leaderboard.h"
+#include "allocator.h"
+
+/**
+ * @brief Allocates a node with the given number of levels
+ * @param level number of links in the node
+ * @param player ID of the player
+ * @param score best score of the player
+ * @return the new node, \p NULL on allocation failure
+ */
+static LeaderboardNode * createNode(int level, PlayerId player, int score);
+
+/**
+ * @brief Chooses the level of a new node, each further level with probability 1/4
+ * @param leaderboard leaderboard holding the random generator state
+ * @return level between 1 and \p LEADERBOARD_MAX_LEVEL
+ */
+static int randomLevel(Leaderboard * leaderboard);
+
+/**
+ * @brief Compares a node with a key in leaderboard order
+ * @param node node to compare
+ * @param player player ID in the key
+ * @param score score in the key
+ * @return negative if \p node comes first, 0 if equal, positive if \p node comes later
+ */
+static int compareEntry(const LeaderboardNode * node, PlayerId player, int score);
+
+Leaderboard * createLeaderboard(const NickDictionary * nicks) {
+    Leaderboard * leaderboard = malloc(sizeof(Leaderboard));
+    if (leaderboard == NULL)
+        return NULL;
+    leaderboard->head = createNode(LEADERBOARD_MAX_LEVEL, PLAYER_NONE, 0);
+    if (leaderboard->head == NULL) {
+        free(leaderboard);
+        return NULL;
+    }
+    leaderboard->level = 1;
+    leaderboard->size = 0;
+    leaderboard->seed = 0x9E3779B97F4A7C15ULL;
+    leaderboard->nicks = nicks;
+    return leaderboard;
+}
+
+static LeaderboardNode * createNode(int level, PlayerId player, int score) {
+    LeaderboardNode * node = malloc(sizeof(LeaderboardNode) + level * sizeof(LeaderboardLink));
+    if (node == NULL)
+        return NULL;
+    node->player = player;
+    node->score = score;
+    for (int i = 0; i < level; i++) {
+        node->links[i].next = NULL;
+        node->links[i].span = 0;
+    }
+    return node;
+}
+
+static int randomLevel(Leaderboard * leaderboard) {
+    // xorshift64, a syscall per insertion would be far too slow here
+    unsigned long long x = leaderboard->seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    leaderboard->seed = x;
+    int level = 1;
+    while (level < LEADERBOARD_MAX_LEVEL && (x & 3u) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+static int compareEntry(const LeaderboardNode * node, PlayerId player, int score) {
+    if (node->score != score)
+        return node->score > score ? -1 : 1;
+    return node->player < player ? -1 : node->player > player;
+}
+
+bool insertLeaderboardEntry(Leaderboard * leaderboard, PlayerId player, int score) {
+    LeaderboardNode * update[LEADERBOARD_MAX_LEVEL];
+    size_t rank[LEADERBOARD_MAX_LEVEL];
+    LeaderboardNode * node = leaderboard->head;
+    for (int i = leaderboard->level - 1; i >= 0; i--) {
+        rank[i] = i == leaderboard->level - 1 ? 0 : rank[i + 1];
+        while (node->links[i].next != NULL && compareEntry(node->links[i].next, player, score) < 0) {
+            rank[i] += node->links[i].span;
+            node = node->links[i].next;
+        }
+        update[i] = node;
+    }
+    int level = randomLevel(leaderboard);
+    if (level > leaderboard->level) {
+        for (int i = leaderboard->level; i < level; i++) {
+            rank[i] = 0;
+            update[i] = leaderboard->head;
+            update[i]->links[i].span = leaderboard->size;
+        }
+        leaderboard->level = level;
+    }
+    node = createNode(level, player, score);
+    if (node == NULL)
+        return false;
+    for (int i = 0; i < level; i++) {
+        node->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = node;
+        node->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+        update[i]->links[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = level; i < leaderboard->level; i++)
+        update[i]->links[i].span++;
+    leaderboard->size++;
+    return true;
+}
+
+bool removeLeaderboardEntry(Leaderboard * leaderboard, PlayerId player, int score) {
+    LeaderboardNode * update[LEADERBOARD_MAX_LEVEL];
+    LeaderboardNode * node = leaderboard->head;
+    for (int i = leaderboard->level - 1; i >= 0; i--) {
+        while (node->links[i].next != NULL && compareEntry(node->links[i].next, player, score) < 0)
+            node = node->links[i].next;
+        update[i] = node;
+    }
+    node = node->links[0].next;
+    if (node == NULL || compareEntry(node, player, score) != 0)
+        return false;
+    for (int i = 0; i < leaderboard->level; i++) {
+        if (update[i]->links[i].next == node) {
+            update[i]->links[i].span += node->links[i].span - 1;
+            update[i]->links[i].next = node->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    while (leaderboard->level > 1 && leaderboard->head->links[leaderboard->level - 1].next == NULL)
+        leaderboard->level--;
+    leaderboard->size--;
+    free(node);
+    return true;
+}
+
+size_t getLeaderboardRank(const Leaderboard * leaderboard, PlayerId player, int score) {
+    size_t rank = 0;
+    const LeaderboardNode * node = leaderboard->head;
+    for (int i = leaderboard->level - 1; i >= 0; i--) {
+        while (node->links[i].next != NULL && compareEntry(node->links[i].next, player, score) <= 0) {
+            rank += node->links[i].span;
+            node = node->links[i].next;
+        }
+        if (node != leaderboard->head && compareEntry(node, player, score) == 0)
+            return rank;
+    }
+    return 0;
+}
+
+size_t getLeaderboardRange(const Leaderboard * leaderboard, size_t first_rank, size_t count, Nick_Score * entries) {
+    if (first_rank < 1 || first_rank > leaderboard->size)
+        return 0;
+    size_t traversed = 0;
+    const LeaderboardNode * node = leaderboard->head;
+    for (int i = leaderboard->level - 1; i >= 0 && traversed < first_rank; i--) {
+        while (node->links[i].next != NULL && traversed + node->links[i].span <= first_rank) {
+            traversed += node->links[i].span;
+            node = node->links[i].next;
+        }
+    }
+    size_t read = 0;
+    for (; node != NULL && read < count; node = node->links[0].next) {
+        // The names are only borrowed, Nick_Score has no const qualifier
+        entries[read].nick = (char *) getNick(leaderboard->nicks, node->player);
+        entries[read].score = node->score;
+        entries[read].player = node->player;
+        read++;
+    }
+    return read;
+}
+
+double getLeaderboardPercentile(const Leaderboard * leaderboard, size_t rank) {
+    if (leaderboard->size == 0)
+        return 0;
+    return 100.0 * (double) rank / (double) leaderboard->size;
+}
+
+void freeLeaderboard(Leaderboard * leaderboard) {
+    if (leaderboard == NULL)
+        return;
+    LeaderboardNode * node = leaderboard->head;
+    while (node != NULL) {
+        LeaderboardNode * next = node->links[0].next;
+        free(node);
+        node = next;
+    }
+    free(leaderboard);
+}
@@ -0,0 +1,118 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_LEADERBOARD_H
+#define SNEK_LEADERBOARD_H
+
+#include <stddef.h>
+#include "snek.h"
+#include "nickdict.h"
+
+/** @brief Maximum number of levels in the skip list */
+#define LEADERBOARD_MAX_LEVEL 32
+
+/**
+ * @brief Link to the next node on one level of the skip list
+ */
+typedef struct LeaderboardLink {
+    /** @brief Next node on this level, \p NULL at the end of the list */
+    struct LeaderboardNode * next;
+    /** @brief Number of level 0 steps this link skips */
+    size_t span;
+} LeaderboardLink;
+
+/**
+ * @brief Node of the leaderboard skip list, holding the best score of one player
+ */
+typedef struct LeaderboardNode {
+    /** @brief ID of the player */
+    PlayerId player;
+    /** @brief Best score of the player */
+    int score;
+    /** @brief Links of the node, one for each of its levels */
+    LeaderboardLink links[];
+} LeaderboardNode;
+
+/**
+ * An indexable skip list ordered by descending score, then by ascending player ID,
+ * so players reaching the same score rank in order of their first appearance.
+ * Every link stores how many nodes it skips, which makes rank and
+ * select-by-rank queries O(log n) as well.
+ * @brief Order-statistics index over the best score of every player
+ */
+typedef struct Leaderboard {
+    /** @brief Sentinel node with \p LEADERBOARD_MAX_LEVEL links */
+    LeaderboardNode * head;
+    /** @brief Number of levels currently in use */
+    int level;
+    /** @brief Number of players on the leaderboard */
+    size_t size;
+    /** @brief State of the random generator choosing node levels */
+    unsigned long long seed;
+    /** @brief Dictionary the player IDs belong to, used to resolve names */
+    const NickDictionary * nicks;
+} Leaderboard;
+
+/**
+ * @brief Creates an empty leaderboard
+ * @param nicks dictionary of the player IDs, must outlive the leaderboard
+ * @return dynamically allocated leaderboard, \p NULL on allocation failure
+ */
+Leaderboard * createLeaderboard(const NickDictionary * nicks);
+
+/**
+ * @brief Adds a player to the leaderboard
+ * @param leaderboard leaderboard to work with
+ * @param player ID of the player
+ * @param score best score of the player
+ * @return \p true on success, \p false on allocation failure
+ */
+bool insertLeaderboardEntry(Leaderboard * leaderboard, PlayerId player, int score);
+
+/**
+ * @brief Removes a player from the leaderboard
+ * @param leaderboard leaderboard to work with
+ * @param player ID of the player
+ * @param score score the player has been inserted with
+ * @return \p true if the player was found and removed, \p false otherwise
+ */
+bool removeLeaderboardEntry(Leaderboard * leaderboard, PlayerId player, int score);
+
+/**
+ * @brief Calculates the rank of a player in O(log n)
+ * @param leaderboard leaderboard to work with
+ * @param player ID of the player
+ * @param score score the player has been inserted with
+ * @return rank of the player starting from 1, 0 if the player is not on the leaderboard
+ */
+size_t getLeaderboardRank(const Leaderboard * leaderboard, PlayerId player, int score);
+
+/**
+ * Fills \p entries with the players ranked from \p first_rank on.
+ * Finding the first entry is O(log n), each further entry is O(1).
+ * The names in \p entries belong to the dictionary, they must not be freed.
+ * @brief Reads a window of consecutive ranks
+ * @param leaderboard leaderboard to work with
+ * @param first_rank rank of the first entry to read, starting from 1
+ * @param count maximum number of entries to read
+ * @param entries array of at least \p count items to fill
+ * @return number of entries read
+ */
+size_t getLeaderboardRange(const Leaderboard * leaderboard, size_t first_rank, size_t count, Nick_Score * entries);
+
+/**
+ * @brief Calculates which top percentage of the leaderboard a rank belongs to
+ * @param leaderboard leaderboard to work with
+ * @param rank rank starting from 1
+ * @return percentage of players ranked at or above \p rank, 0 for an empty leaderboard
+ */
+double getLeaderboardPercentile(const Leaderboard * leaderboard, size_t rank);
+
+/**
+ * @brief Frees all memory used by the leaderboard, \p NULL is ignored
+ * @param leaderboard leaderboard to free
+ */
+void freeLeaderboard(Leaderboard * leaderboard);
+
+#endif //SNEK_LEADERBOARD_H
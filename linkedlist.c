@@ -13,7 +13,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "linkedlist.h"
-#include "debugmalloc.h"
+#include "allocator.h"
 
 /** @private */
 static bool next(LinkedList *);
@@ -32,6 +32,10 @@ static bool addLast(LinkedList *, void * data);
 /** @private */
 static void removeItem(LinkedList *);
 /** @private */
+static void * detachItem(LinkedList *);
+/** @private */
+static bool reserve(LinkedList *, size_t count);
+/** @private */
 static void seek(LinkedList *, int offset, Flags whence);
 /** @private */
 static bool hasNext(LinkedList *);
@@ -42,11 +46,19 @@ static size_t size(LinkedList *);
 /** @private */
 static void swap(LinkedList *, int, int);
 
+/**
+ * @brief Takes a spare node of the list, or allocates a new one if there is none
+ * @param linkedList LinkedList instance to work with
+ * @return the node, NULL if the allocation failed
+ */
+static Node * newNode(LinkedList *);
+
 
 LinkedList * createLinkedList() {
     LinkedList * new = malloc(sizeof (LinkedList));
     if (new == NULL) return NULL;
     new->node = NULL;
+    new->spare = NULL;
     new->next = &next;
     new->prev = &prev;
     new->toStart = &toStart;
@@ -55,6 +67,8 @@ LinkedList * createLinkedList() {
     new->addFirst = &addFirst;
     new->addLast = &addLast;
     new->removeItem = &removeItem;
+    new->detachItem = &detachItem;
+    new->reserve = &reserve;
     new->seek = &seek;
     new->hasNext = &hasNext;
     new->hasPrevious = &hasPrevious;
@@ -125,13 +139,13 @@ static void seek(LinkedList * linkedList, int offset, Flags whence) {
 static bool add(LinkedList * linkedList, void * data) {
     if (linkedList == NULL) return false;
     if (linkedList->node == NULL) {
-        linkedList->node = (Node *) malloc(sizeof(Node));
+        linkedList->node = newNode(linkedList);
         if (linkedList->node == NULL) return false;
         linkedList->node->data = data;
         linkedList->node->next = NULL;
         linkedList->node->prev = NULL;
     } else {
-        Node * new = (Node *) malloc(sizeof(Node));
+        Node * new = newNode(linkedList);
         if (new == NULL) return false;
         new->data = data;
         new->prev = linkedList->node;
@@ -149,13 +163,13 @@ static bool addFirst(LinkedList * linkedList, void * data) {
     if (linkedList == NULL) return false;
     linkedList->toStart(linkedList);
     if (linkedList->node == NULL) {
-        linkedList->node = (Node *) malloc(sizeof(Node));
+        linkedList->node = newNode(linkedList);
         if (linkedList->node == NULL) return false;
         linkedList->node->data = data;
         linkedList->node->next = NULL;
         linkedList->node->prev = NULL;
     } else {
-        Node * new = (Node *) malloc(sizeof(Node));
+        Node * new = newNode(linkedList);
         if (new == NULL) return false;
         new->data = data;
         new->prev = NULL;
@@ -172,20 +186,56 @@ static bool addLast(LinkedList * linkedList, void * data) {
 }
 
 static void removeItem(LinkedList * linkedList) {
-    if (linkedList != NULL && linkedList->node != NULL) {
-        Node * old = linkedList->node;
-        if (old->next == NULL) {
-            linkedList->node = old->prev;
-            if (linkedList->node != NULL) {
-                linkedList->node->next = NULL;
-            }
-        } else {
-            linkedList->node = old->next;
-            linkedList->node->prev = old->prev;
+    if (linkedList != NULL && linkedList->node != NULL)
+        free(detachItem(linkedList));
+}
+
+static void * detachItem(LinkedList * linkedList) {
+    if (linkedList == NULL || linkedList->node == NULL) return NULL;
+    Node * old = linkedList->node;
+    if (old->next == NULL) {
+        linkedList->node = old->prev;
+        if (linkedList->node != NULL) {
+            linkedList->node->next = NULL;
+        }
+    } else {
+        linkedList->node = old->next;
+        linkedList->node->prev = old->prev;
+        // The node is reused, nothing may point to it anymore
+        if (old->prev != NULL) {
+            old->prev->next = old->next;
         }
-        free(old->data);
-        free(old);
     }
+    void * data = old->data;
+    old->data = NULL;
+    old->prev = NULL;
+    old->next = linkedList->spare;
+    linkedList->spare = old;
+    return data;
+}
+
+static bool reserve(LinkedList * linkedList, size_t count) {
+    if (linkedList == NULL) return false;
+    size_t ready = 0;
+    for (Node * spare = linkedList->spare; spare != NULL && ready < count; spare = spare->next)
+        ready++;
+    for (; ready < count; ready++) {
+        Node * new = (Node *) malloc(sizeof(Node));
+        if (new == NULL) return false;
+        new->data = NULL;
+        new->prev = NULL;
+        new->next = linkedList->spare;
+        linkedList->spare = new;
+    }
+    return true;
+}
+
+static Node * newNode(LinkedList * linkedList) {
+    Node * node = linkedList->spare;
+    if (node == NULL)
+        return (Node *) malloc(sizeof(Node));
+    linkedList->spare = node->next;
+    return node;
 }
 
 static bool hasPrevious(LinkedList * linkedList) {
@@ -220,5 +270,10 @@ static size_t size(LinkedList * linkedList) {
 void dumpLinkedList(LinkedList * linkedList) {
     while (linkedList != NULL && linkedList->node != NULL)
         removeItem(linkedList);
+    while (linkedList != NULL && linkedList->spare != NULL) {
+        Node * spare = linkedList->spare;
+        linkedList->spare = spare->next;
+        free(spare);
+    }
     free(linkedList);
 }
@@ -56,6 +56,13 @@ typedef struct LinkedList {
      */
     Node * node;
 
+    /**
+     * Nodes removed from the list are kept here and reused by the next insertions,
+     * linked through their \p next pointers.
+     * @brief Nodes ready to be reused
+     */
+    Node * spare;
+
     /**
     * Sets the node of the linked list to the next position, if there is one.
     * @brief Steps the linked list to its next node
@@ -131,6 +138,26 @@ typedef struct LinkedList {
     */
     void (*removeItem)(struct LinkedList *);
 
+    /**
+    * Removes current node from the linked list like \p removeItem,
+    * but hands its data back instead of freeing it.
+    * The node is kept for reuse, so no memory is freed.
+    * @brief Removes current node from the linked list, keeping its data
+    * @param linkedList LinkedList instance to work with
+    * @return the data of the removed node, NULL if the list is empty
+    */
+    void * (*detachItem)(struct LinkedList *);
+
+    /**
+    * Allocates spare nodes, so that inserting up to \p count nodes
+    * does not allocate memory until nodes are freed by \p dumpLinkedList.
+    * @brief Preallocates nodes for later insertions
+    * @param linkedList LinkedList instance to work with
+    * @param count number of nodes to have ready
+    * @return true on success, false otherwise
+    */
+    bool (*reserve)(struct LinkedList *, size_t count);
+
     /**
     * Moves the node of the linked list by a given offset, in a given direction.
     * Over-indexing will not cause any errors, the node will set to the first/last one.
@@ -185,7 +212,7 @@ LinkedList * createLinkedList();
 
 /**
  * Frees all memory used by \p linkedList
- * Uses removeItem to remove all items and then frees the memory used by the instance as well
+ * Uses removeItem to remove all items, then frees the spare nodes and the memory used by the instance as well
  * @brief Frees all memory used by the \p LinkedList instance
  * @param linkedList LinkedList instance to work with
  */
@@ -0,0 +1,289 @@
+/**
+ * The counters are plain variables of the thread running the game, except for
+ * the score file reads, which are made by the prefetch thread as well, and are
+ * updated with relaxed atomics. The file is formatted into a static buffer and
+ * written with system calls, so exporting does not allocate memory in the game loop.
+ * The terminal output is measured with the write counter of the thread in
+ * /proc/thread-self/io, as ncurses writes to the terminal directly.
+ * \file metrics.c
+ * \author hexadec
+ * \brief This file contains the Prometheus metrics exporter
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "allocator.h"
+
+/** @brief Most bytes of the metrics file */
+#define METRICS_BUFFER_SIZE 8192
+
+/** @brief Longest path of the metrics file, with the suffix of the temporary file */
+#define METRICS_PATH_MAX 4096
+
+/**
+ * @brief State of the exporter
+ */
+static struct {
+    /** @brief Whether the metrics are exported */
+    bool enabled;
+    /** @brief Path of the metrics file */
+    char path[METRICS_PATH_MAX];
+    /** @brief Path of the file written before renaming it to \p path */
+    char temporary[METRICS_PATH_MAX];
+    /** @brief Interval of writing the file */
+    long long interval_ns;
+    /** @brief Time the file is written next */
+    struct timespec next_write;
+    /** @brief /proc/thread-self/io of the drawing thread, -1 if it cannot be read */
+    int io;
+    /** @brief Bytes written by the drawing thread when the frame was started */
+    long long frame_start;
+    /** @brief Games finished */
+    long long games;
+    /** @brief Steps of all games */
+    long long ticks;
+    /** @brief Ticks in each latency bucket, see \p latencyBucket */
+    long long latency[METRICS_LATENCY_BUCKETS];
+    /** @brief Sum of the tick latencies */
+    long long latency_sum_ns;
+    /** @brief Frames drawn */
+    long long frames;
+    /** @brief Bytes of terminal output of the frames */
+    long long render_bytes;
+    /** @brief Reads of the score file of each \p ScoreScan kind */
+    long long scans[2];
+    /** @brief Time spent reading the score file, for each \p ScoreScan kind */
+    long long scan_ns[2];
+    /** @brief Metrics file being formatted */
+    char buffer[METRICS_BUFFER_SIZE];
+    /** @brief Bytes used in \p buffer */
+    size_t length;
+} metrics = {.io = -1};
+
+/**
+ * Bucket \p i holds the latencies from 2^(i+shift) ns to 2^(i+shift+1) ns,
+ * except for the first, which starts at 0, and the last, which has no end.
+ * @brief Finds the bucket of a tick latency
+ * @param ns the latency
+ * @return index of the bucket
+ */
+static int latencyBucket(long long);
+
+/**
+ * @brief Estimates a quantile of the tick latency from the buckets
+ * @param quantile the quantile, between 0 and 1
+ * @return the latency in seconds, interpolated within its bucket
+ */
+static double latencyQuantile(double);
+
+/**
+ * @brief Reads the number of bytes the drawing thread has written
+ * @return the bytes written, -1 if they cannot be read
+ */
+static long long writtenBytes();
+
+/**
+ * Formatted like \p printf, the output is cut if the buffer is full.
+ * @brief Appends to the metrics file being formatted
+ * @param format format string
+ */
+static void append(const char *, ...);
+
+/**
+ * @brief Appends the help and the type lines of a metric
+ * @param name name of the metric
+ * @param type Prometheus type of the metric
+ * @param help description of the metric
+ */
+static void appendHeader(const char *, const char *, const char *);
+
+/**
+ * @brief Writes the metrics at exit
+ */
+static void writeMetricsAtExit();
+
+bool startMetrics() {
+    const char * path = getenv("SNEK_METRICS");
+    if (metrics.enabled || path == NULL || path[0] == '\0')
+        return metrics.enabled;
+    if (snprintf(metrics.path, sizeof(metrics.path), "%s", path) >= (int) sizeof(metrics.path)
+        || snprintf(metrics.temporary, sizeof(metrics.temporary), "%s.%d.tmp", path, (int) getpid()) >= (int) sizeof(metrics.temporary))
+        return false;
+    const char * interval = getenv("SNEK_METRICS_INTERVAL");
+    long seconds = interval != NULL ? atol(interval) : METRICS_DEFAULT_INTERVAL;
+    metrics.interval_ns = (seconds > 0 ? seconds : METRICS_DEFAULT_INTERVAL) * 1000000000LL;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &metrics.next_write);
+    metrics.next_write.tv_sec += metrics.interval_ns / 1000000000LL;
+    // Opened by the drawing thread, so it counts the writes of that thread only
+    metrics.io = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    metrics.enabled = true;
+    atexit(writeMetricsAtExit);
+    return true;
+}
+
+bool metricsEnabled() {
+    return metrics.enabled;
+}
+
+void recordTick(long long busy_ns) {
+    if (!metrics.enabled)
+        return;
+    metrics.ticks++;
+    metrics.latency[latencyBucket(busy_ns)]++;
+    metrics.latency_sum_ns += busy_ns;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    if (elapsedNanoseconds(&metrics.next_write, &now) >= 0) {
+        writeMetrics();
+        metrics.next_write = now;
+        metrics.next_write.tv_sec += metrics.interval_ns / 1000000000LL;
+    }
+}
+
+void recordGame() {
+    if (metrics.enabled)
+        metrics.games++;
+}
+
+void startFrameMetrics() {
+    if (metrics.enabled && metrics.io >= 0)
+        metrics.frame_start = writtenBytes();
+}
+
+void finishFrameMetrics() {
+    if (!metrics.enabled)
+        return;
+    long long written = metrics.io >= 0 ? writtenBytes() : -1;
+    recordFrame(written >= 0 && metrics.frame_start >= 0 ? written - metrics.frame_start : 0);
+}
+
+void recordFrame(long long bytes) {
+    if (!metrics.enabled)
+        return;
+    metrics.frames++;
+    metrics.render_bytes += bytes;
+}
+
+void recordScoreScan(ScoreScan kind, long long duration_ns) {
+    if (!metrics.enabled)
+        return;
+    __atomic_fetch_add(&metrics.scans[kind], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics.scan_ns[kind], duration_ns, __ATOMIC_RELAXED);
+}
+
+bool writeMetrics() {
+    if (!metrics.enabled)
+        return false;
+    int pid = (int) getpid();
+    metrics.length = 0;
+    appendHeader("snek_games_total", "counter", "Games finished.");
+    append("snek_games_total{pid=\"%d\"} %lld\n", pid, metrics.games);
+    appendHeader("snek_ticks_total", "counter", "Steps of all games.");
+    append("snek_ticks_total{pid=\"%d\"} %lld\n", pid, metrics.ticks);
+    appendHeader("snek_tick_latency_seconds", "summary", "Time a tick takes to draw and step, without waiting for input.");
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+        append("snek_tick_latency_seconds{pid=\"%d\",quantile=\"%g\"} %.9f\n", pid, quantiles[i], latencyQuantile(quantiles[i]));
+    append("snek_tick_latency_seconds_sum{pid=\"%d\"} %.9f\n", pid, (double) metrics.latency_sum_ns / 1E9);
+    append("snek_tick_latency_seconds_count{pid=\"%d\"} %lld\n", pid, metrics.ticks);
+    appendHeader("snek_frames_total", "counter", "Frames drawn.");
+    append("snek_frames_total{pid=\"%d\"} %lld\n", pid, metrics.frames);
+    appendHeader("snek_render_bytes_total", "counter", "Bytes written to the terminal by drawing the frames.");
+    append("snek_render_bytes_total{pid=\"%d\"} %lld\n", pid, metrics.render_bytes);
+    static const char * kinds[] = {[SCAN_FULL] = "full", [SCAN_INCREMENTAL] = "incremental"};
+    appendHeader("snek_score_scans_total", "counter", "Reads of the score file.");
+    for (int i = 0; i < 2; i++)
+        append("snek_score_scans_total{pid=\"%d\",kind=\"%s\"} %lld\n", pid, kinds[i],
+               __atomic_load_n(&metrics.scans[i], __ATOMIC_RELAXED));
+    appendHeader("snek_score_scan_seconds_total", "counter", "Time spent reading the score file.");
+    for (int i = 0; i < 2; i++)
+        append("snek_score_scan_seconds_total{pid=\"%d\",kind=\"%s\"} %.9f\n", pid, kinds[i],
+               (double) __atomic_load_n(&metrics.scan_ns[i], __ATOMIC_RELAXED) / 1E9);
+    AllocatorStats stats;
+    getAllocatorStats(&stats);
+    appendHeader("snek_allocated_blocks", "gauge", "Blocks currently allocated.");
+    append("snek_allocated_blocks{pid=\"%d\"} %ld\n", pid, stats.live_count);
+    appendHeader("snek_allocated_bytes", "gauge", "Bytes currently allocated.");
+    append("snek_allocated_bytes{pid=\"%d\"} %lld\n", pid, stats.live_bytes);
+    appendHeader("snek_allocated_bytes_peak", "gauge", "Most bytes allocated at the same time.");
+    append("snek_allocated_bytes_peak{pid=\"%d\"} %lld\n", pid, stats.peak_bytes);
+    appendHeader("snek_allocations_total", "counter", "Allocations made.");
+    append("snek_allocations_total{pid=\"%d\"} %lld\n", pid, stats.total_count);
+    if (metrics.length >= sizeof(metrics.buffer))
+        return false;
+
+    int fd = open(metrics.temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    bool success = write(fd, metrics.buffer, metrics.length) == (ssize_t) metrics.length;
+    success = close(fd) == 0 && success;
+    if (!success || rename(metrics.temporary, metrics.path) != 0) {
+        unlink(metrics.temporary);
+        return false;
+    }
+    return true;
+}
+
+long long elapsedNanoseconds(const struct timespec * start, const struct timespec * end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+static int latencyBucket(long long ns) {
+    int bucket = 0;
+    for (long long units = ns >> METRICS_LATENCY_SHIFT; units > 1 && bucket < METRICS_LATENCY_BUCKETS - 1; units >>= 1)
+        bucket++;
+    return bucket;
+}
+
+static double latencyQuantile(double quantile) {
+    if (metrics.ticks == 0)
+        return 0;
+    double rank = quantile * (double) metrics.ticks;
+    long long below = 0;
+    for (int i = 0; i < METRICS_LATENCY_BUCKETS; i++) {
+        if (below + metrics.latency[i] >= rank && metrics.latency[i] > 0) {
+            double lower = i == 0 ? 0 : (double) (1LL << (i + METRICS_LATENCY_SHIFT)) * 1E-9;
+            // The last bucket has no end, its lower bound is reported
+            if (i == METRICS_LATENCY_BUCKETS - 1)
+                return lower;
+            double upper = (double) (1LL << (i + 1 + METRICS_LATENCY_SHIFT)) * 1E-9;
+            return lower + (upper - lower) * (rank - (double) below) / (double) metrics.latency[i];
+        }
+        below += metrics.latency[i];
+    }
+    return (double) (1LL << (METRICS_LATENCY_BUCKETS - 1 + METRICS_LATENCY_SHIFT)) * 1E-9;
+}
+
+static long long writtenBytes() {
+    char io[512];
+    ssize_t length = pread(metrics.io, io, sizeof(io) - 1, 0);
+    if (length <= 0)
+        return -1;
+    io[length] = '\0';
+    const char * written = strstr(io, "wchar: ");
+    return written != NULL ? atoll(written + strlen("wchar: ")) : -1;
+}
+
+static void append(const char * format, ...) {
+    if (metrics.length >= sizeof(metrics.buffer))
+        return;
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(metrics.buffer + metrics.length, sizeof(metrics.buffer) - metrics.length, format, arguments);
+    va_end(arguments);
+    metrics.length += length > 0 ? (size_t) length : 0;
+}
+
+static void appendHeader(const char * name, const char * type, const char * help) {
+    append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void writeMetricsAtExit() {
+    writeMetrics();
+    if (metrics.io >= 0)
+        close(metrics.io);
+}
@@ -0,0 +1,113 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_METRICS_H
+#define SNEK_METRICS_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * Runtime metrics, written as a Prometheus text exposition file, so a
+ * node-exporter textfile collector can scrape every instance on the host.
+ * Exporting is enabled by the SNEK_METRICS environment variable, holding the
+ * path of the file. Every sample is labelled with the pid, so instances can
+ * write into the same collector directory under different names.
+ */
+
+/** @brief Default interval of writing the metrics file, in seconds */
+#define METRICS_DEFAULT_INTERVAL 10
+
+/** @brief Number of power of two buckets of the tick latency, see \p METRICS_LATENCY_SHIFT */
+#define METRICS_LATENCY_BUCKETS 24
+
+/** @brief The first latency bucket ends at 2^(this + 1) ns, the last one begins at about 1 s */
+#define METRICS_LATENCY_SHIFT 7
+
+/**
+ * @brief Kinds of reading the score file
+ */
+typedef enum ScoreScan {
+    /** @brief Reading the whole file at startup */
+    SCAN_FULL = 0,
+    /** @brief Reading the records appended since the last read */
+    SCAN_INCREMENTAL
+} ScoreScan;
+
+/**
+ * Reads the path from SNEK_METRICS, and the interval of writing the file in
+ * seconds from SNEK_METRICS_INTERVAL. The file is also written at exit.
+ * Has to be called by the thread that draws the frames.
+ * @brief Starts exporting the metrics, if enabled by the environment
+ * @return \p true if the metrics are exported, \p false otherwise
+ */
+bool startMetrics();
+
+/**
+ * @brief Checks if the metrics are exported
+ * @return \p true after a successful \p startMetrics, \p false otherwise
+ */
+bool metricsEnabled();
+
+/**
+ * The file is written by the first tick after the interval has passed,
+ * so it is never written in the middle of a tick.
+ * Does not allocate memory, and does nothing if the metrics are not exported.
+ * @brief Counts a step of a game
+ * @param busy_ns time the tick took, without waiting for the player
+ */
+void recordTick(long long);
+
+/**
+ * @brief Counts a finished game
+ */
+void recordGame();
+
+/**
+ * @brief Starts measuring the output of a frame, see \p finishFrameMetrics
+ */
+void startFrameMetrics();
+
+/**
+ * Counts the bytes the calling thread has written since \p startFrameMetrics,
+ * which are the bytes of the terminal output of the frame. Does nothing if
+ * the metrics are not exported.
+ * @brief Finishes measuring the output of a frame
+ */
+void finishFrameMetrics();
+
+/**
+ * For renderers that know the size of their output, instead of measuring it
+ * with \p startFrameMetrics and \p finishFrameMetrics.
+ * Does nothing if the metrics are not exported.
+ * @brief Counts a drawn frame
+ * @param bytes bytes of output of the frame
+ */
+void recordFrame(long long);
+
+/**
+ * Safe to call from any thread.
+ * @brief Counts a read of the score file
+ * @param kind full or incremental read
+ * @param duration_ns time the read took
+ */
+void recordScoreScan(ScoreScan, long long);
+
+/**
+ * The file is written next to its final path, then renamed over it,
+ * so the collector never reads a half written file.
+ * @brief Writes the metrics file now
+ * @return \p true on success, \p false if it could not be written
+ */
+bool writeMetrics();
+
+/**
+ * @brief Elapsed time between two points in time
+ * @param start earlier point in time
+ * @param end later point in time
+ * @return nanoseconds from \p start to \p end
+ */
+long long elapsedNanoseconds(const struct timespec *, const struct timespec *);
+
+#endif //SNEK_METRICS_H
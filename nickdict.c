@@ -0,0 +1,183 @@
+/**
+ * Nicknames are stored once per dictionary in a chunked string arena, and are
+ * referred to by their \p PlayerId everywhere else, so comparing two players
+ * is an integer compare and freeing every name is a walk over a few chunks.
+ * \file nickdict.c
+ * \author hexadec
+ * \brief This file contains the nickname interning dictionary
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "nickdict.h"
+#include "allocator.h"
+
+/** @brief Size of the storage in an arena chunk */
+#define ARENA_CHUNK_SIZE 65536
+
+/** @brief Initial number of names and slots */
+#define INITIAL_CAPACITY 64
+
+/**
+ * @brief FNV-1a hash of a name
+ * @param nick name to hash
+ * @param length length of \p nick
+ * @return hash value
+ */
+static unsigned hashNick(const char * nick, size_t length);
+
+/**
+ * @brief Finds the slot of a name, or the empty slot where it belongs
+ * @param dictionary dictionary to search in
+ * @param nick name to find
+ * @param length length of \p nick
+ * @param hash hash of \p nick
+ * @return index of the slot
+ */
+static PlayerId findSlot(const NickDictionary * dictionary, const char * nick, size_t length, unsigned hash);
+
+/**
+ * @brief Copies a name into the arena
+ * @param dictionary dictionary owning the arena
+ * @param nick name to copy
+ * @param length length of \p nick
+ * @return the terminated copy, \p NULL on allocation failure
+ */
+static char * copyToArena(NickDictionary * dictionary, const char * nick, size_t length);
+
+/**
+ * @brief Doubles the capacity of the name arrays and the slot table
+ * @param dictionary dictionary to grow
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool growDictionary(NickDictionary * dictionary);
+
+NickDictionary * createNickDictionary() {
+    NickDictionary * dictionary = malloc(sizeof(NickDictionary));
+    if (dictionary == NULL)
+        return NULL;
+    dictionary->arena = NULL;
+    dictionary->count = 0;
+    dictionary->capacity = INITIAL_CAPACITY;
+    dictionary->slot_count = 2 * INITIAL_CAPACITY;
+    dictionary->names = malloc(INITIAL_CAPACITY * sizeof(char *));
+    dictionary->hashes = malloc(INITIAL_CAPACITY * sizeof(unsigned));
+    dictionary->slots = calloc(dictionary->slot_count, sizeof(PlayerId));
+    if (dictionary->names == NULL || dictionary->hashes == NULL || dictionary->slots == NULL) {
+        freeNickDictionary(dictionary);
+        return NULL;
+    }
+    return dictionary;
+}
+
+static unsigned hashNick(const char * nick, size_t length) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) nick[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static PlayerId findSlot(const NickDictionary * dictionary, const char * nick, size_t length, unsigned hash) {
+    PlayerId mask = dictionary->slot_count - 1;
+    PlayerId slot = hash & mask;
+    while (dictionary->slots[slot] != 0) {
+        PlayerId player = dictionary->slots[slot] - 1;
+        // Compare hashes first, the names are only touched on a likely match
+        if (dictionary->hashes[player] == hash && strncmp(dictionary->names[player], nick, length) == 0
+            && dictionary->names[player][length] == '\0')
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static char * copyToArena(NickDictionary * dictionary, const char * nick, size_t length) {
+    ArenaChunk * chunk = dictionary->arena;
+    if (chunk == NULL || chunk->size - chunk->used < length + 1) {
+        size_t size = length + 1 > ARENA_CHUNK_SIZE ? length + 1 : ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(ArenaChunk) + size);
+        if (chunk == NULL)
+            return NULL;
+        chunk->next = dictionary->arena;
+        chunk->used = 0;
+        chunk->size = size;
+        dictionary->arena = chunk;
+    }
+    char * copy = chunk->data + chunk->used;
+    memcpy(copy, nick, length);
+    copy[length] = '\0';
+    chunk->used += length + 1;
+    return copy;
+}
+
+static bool growDictionary(NickDictionary * dictionary) {
+    PlayerId capacity = dictionary->capacity * 2;
+    const char ** names = realloc(dictionary->names, capacity * sizeof(char *));
+    if (names == NULL)
+        return false;
+    dictionary->names = names;
+    unsigned * hashes = realloc(dictionary->hashes, capacity * sizeof(unsigned));
+    if (hashes == NULL)
+        return false;
+    dictionary->hashes = hashes;
+    PlayerId * slots = calloc(2 * capacity, sizeof(PlayerId));
+    if (slots == NULL)
+        return false;
+    free(dictionary->slots);
+    dictionary->slots = slots;
+    dictionary->slot_count = 2 * capacity;
+    dictionary->capacity = capacity;
+    PlayerId mask = dictionary->slot_count - 1;
+    for (PlayerId player = 0; player < dictionary->count; player++) {
+        PlayerId slot = dictionary->hashes[player] & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = player + 1;
+    }
+    return true;
+}
+
+PlayerId internNick(NickDictionary * dictionary, const char * nick, size_t length) {
+    unsigned hash = hashNick(nick, length);
+    PlayerId slot = findSlot(dictionary, nick, length, hash);
+    if (dictionary->slots[slot] != 0)
+        return dictionary->slots[slot] - 1;
+    if (dictionary->count == dictionary->capacity) {
+        if (!growDictionary(dictionary))
+            return PLAYER_NONE;
+        slot = findSlot(dictionary, nick, length, hash);
+    }
+    char * copy = copyToArena(dictionary, nick, length);
+    if (copy == NULL)
+        return PLAYER_NONE;
+    PlayerId player = dictionary->count++;
+    dictionary->names[player] = copy;
+    dictionary->hashes[player] = hash;
+    dictionary->slots[slot] = player + 1;
+    return player;
+}
+
+PlayerId findNick(const NickDictionary * dictionary, const char * nick, size_t length) {
+    PlayerId slot = findSlot(dictionary, nick, length, hashNick(nick, length));
+    return dictionary->slots[slot] != 0 ? dictionary->slots[slot] - 1 : PLAYER_NONE;
+}
+
+const char * getNick(const NickDictionary * dictionary, PlayerId player) {
+    return dictionary->names[player];
+}
+
+void freeNickDictionary(NickDictionary * dictionary) {
+    if (dictionary == NULL)
+        return;
+    while (dictionary->arena != NULL) {
+        ArenaChunk * next = dictionary->arena->next;
+        free(dictionary->arena);
+        dictionary->arena = next;
+    }
+    free(dictionary->names);
+    free(dictionary->hashes);
+    free(dictionary->slots);
+    free(dictionary);
+}
@@ -0,0 +1,87 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_NICKDICT_H
+#define SNEK_NICKDICT_H
+
+#include <stddef.h>
+#include "snek.h"
+
+/**
+ * @brief Block of the string arena, names are allocated from it by bumping \p used
+ */
+typedef struct ArenaChunk {
+    /** @brief Previously filled chunk, \p NULL for the first one */
+    struct ArenaChunk * next;
+    /** @brief Number of bytes used in \p data */
+    size_t used;
+    /** @brief Number of bytes in \p data */
+    size_t size;
+    /** @brief Storage of the names */
+    char data[];
+} ArenaChunk;
+
+/**
+ * Interns nicknames: every distinct name is stored once in a string arena
+ * and gets a dense integer \p PlayerId in order of first appearance.
+ * Names never move, so pointers to them stay valid until the dictionary is freed,
+ * which releases every name at once.
+ * @brief Dictionary mapping nicknames to player IDs
+ */
+typedef struct NickDictionary {
+    /** @brief Chunk names are currently allocated from */
+    ArenaChunk * arena;
+    /** @brief Name of each player, indexed by \p PlayerId */
+    const char ** names;
+    /** @brief Hash of each name, indexed by \p PlayerId, kept for rehashing */
+    unsigned * hashes;
+    /** @brief Number of interned names */
+    PlayerId count;
+    /** @brief Number of items allocated in \p names and \p hashes */
+    PlayerId capacity;
+    /** @brief Open addressing table of player IDs plus one, 0 for empty slots */
+    PlayerId * slots;
+    /** @brief Number of items in \p slots (power of two) */
+    PlayerId slot_count;
+} NickDictionary;
+
+/**
+ * @brief Creates an empty dictionary
+ * @return dynamically allocated dictionary, \p NULL on allocation failure
+ */
+NickDictionary * createNickDictionary();
+
+/**
+ * @brief Returns the ID of a name, adding the name if it is new
+ * @param dictionary dictionary to work with
+ * @param nick name to intern, does not need to be terminated
+ * @param length length of \p nick in bytes
+ * @return ID of the name, \p PLAYER_NONE on allocation failure
+ */
+PlayerId internNick(NickDictionary * dictionary, const char * nick, size_t length);
+
+/**
+ * @brief Returns the ID of a name without adding it
+ * @param dictionary dictionary to work with
+ * @param nick name to look up, does not need to be terminated
+ * @param length length of \p nick in bytes
+ * @return ID of the name, \p PLAYER_NONE if it has not been interned
+ */
+PlayerId findNick(const NickDictionary * dictionary, const char * nick, size_t length);
+
+/**
+ * @brief Returns the name of a player
+ * @param dictionary dictionary to work with
+ * @param player ID of the player
+ * @return the name, owned by the dictionary
+ */
+const char * getNick(const NickDictionary * dictionary, PlayerId player);
+
+/**
+ * @brief Frees the dictionary and every name in it, \p NULL is ignored
+ * @param dictionary dictionary to free
+ */
+void freeNickDictionary(NickDictionary * dictionary);
+
+#endif //SNEK_NICKDICT_H
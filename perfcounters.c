@@ -0,0 +1,91 @@
+/**
+ * There is no libc wrapper of perf_event_open, it is called through \p syscall.
+ * The events are not grouped, so an unsupported event does not prevent the
+ * others from counting. The price is that the kernel may multiplex them,
+ * which is corrected by scaling with the enabled and running times.
+ * \file perfcounters.c
+ * \author hexadec
+ * \brief This file contains the hardware performance counters of the benchmarks
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfcounters.h"
+#include "allocator.h"
+
+/** @brief perf_event_attr type and config of each event, indexed by \p PerfEvent */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char * name;
+} events[PERF_EVENTS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "l1d_misses"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "llc_misses"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"}
+};
+
+bool openPerfCounters(PerfCounters * counters) {
+    bool any = false;
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // Calling thread, any CPU, no group, close on exec
+        counters->fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (counters->fd[i] >= 0)
+            any = true;
+        else
+            counters->fd[i] = -1;
+    }
+    return any;
+}
+
+void startPerfCounters(PerfCounters * counters) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (counters->fd[i] < 0)
+            continue;
+        ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void stopPerfCounters(PerfCounters * counters, PerfCounts * counts) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (counters->fd[i] >= 0)
+            ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        counts->available[i] = false;
+        counts->value[i] = 0;
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (counters->fd[i] < 0 || read(counters->fd[i], data, sizeof(data)) != (ssize_t) sizeof(data) || data[2] == 0)
+            continue;
+        counts->available[i] = true;
+        counts->value[i] = (double) data[0] * ((double) data[1] / (double) data[2]);
+    }
+}
+
+void closePerfCounters(PerfCounters * counters) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (counters->fd[i] >= 0)
+            close(counters->fd[i]);
+        counters->fd[i] = -1;
+    }
+}
+
+const char * perfEventName(PerfEvent event) {
+    return events[event].name;
+}
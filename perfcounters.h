@@ -0,0 +1,84 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_PERFCOUNTERS_H
+#define SNEK_PERFCOUNTERS_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Hardware events counted by \p PerfCounters
+ */
+typedef enum PerfEvent {
+    /** @brief CPU cycles */
+    PERF_CYCLES = 0,
+    /** @brief Retired instructions */
+    PERF_INSTRUCTIONS,
+    /** @brief Level 1 data cache read misses */
+    PERF_L1D_MISSES,
+    /** @brief Last level cache misses */
+    PERF_LLC_MISSES,
+    /** @brief Mispredicted branches */
+    PERF_BRANCH_MISSES
+} PerfEvent;
+
+/** @brief Number of events in \p PerfEvent */
+#define PERF_EVENTS 5
+
+/**
+ * @brief Hardware event counters of the calling thread
+ */
+typedef struct PerfCounters {
+    /** @brief perf_event_open descriptor of each event, -1 if the event is not available */
+    int fd[PERF_EVENTS];
+} PerfCounters;
+
+/**
+ * @brief Counts read from \p PerfCounters
+ */
+typedef struct PerfCounts {
+    /** @brief Count of each event, scaled up if the kernel has multiplexed the counter */
+    double value[PERF_EVENTS];
+    /** @brief Whether each event has been counted */
+    bool available[PERF_EVENTS];
+} PerfCounts;
+
+/**
+ * Every event is opened on its own, so the ones the CPU or the kernel does not
+ * support are left out, and the others still count. In containers and virtual
+ * machines usually none of them is available, or perf_event_paranoid forbids them.
+ * Only user space is counted.
+ * @brief Opens the counters of the calling thread, stopped
+ * @param counters counters to open
+ * @return \p true if at least one event is available, \p false otherwise
+ */
+bool openPerfCounters(PerfCounters *);
+
+/**
+ * @brief Resets and starts the available counters
+ * @param counters opened counters
+ */
+void startPerfCounters(PerfCounters *);
+
+/**
+ * @brief Stops the counters and reads them
+ * @param counters started counters
+ * @param counts counts to fill, events that could not be read are marked unavailable
+ */
+void stopPerfCounters(PerfCounters *, PerfCounts *);
+
+/**
+ * @brief Closes the counters, does nothing for unavailable ones
+ * @param counters counters to close
+ */
+void closePerfCounters(PerfCounters *);
+
+/**
+ * @brief Name of an event, as written in the reports
+ * @param event the event
+ * @return name of the event in snake case
+ */
+const char * perfEventName(PerfEvent);
+
+#endif //SNEK_PERFCOUNTERS_H
@@ -0,0 +1,135 @@
+/**
+ * The scores file is read by a worker thread that is started at launch,
+ * while the player types their nickname. The main thread only ever polls
+ * the worker, or waits for it after the game is over, when the toplist is needed.
+ * \file prefetch.c
+ * \author hexadec
+ * \brief This file loads the scores on a background thread
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "prefetch.h"
+#include "shmboard.h"
+#include "allocator.h"
+
+/**
+ * @brief States of the background load
+ */
+typedef enum {
+    /** @brief Nothing has been started */
+    PREFETCH_IDLE,
+    /** @brief The worker is reading the scores file */
+    PREFETCH_RUNNING,
+    /** @brief The cache is ready to be claimed */
+    PREFETCH_READY,
+    /** @brief Loading failed due to an allocation error */
+    PREFETCH_FAILED,
+    /** @brief The result has been handed over (or discarded) */
+    PREFETCH_CLAIMED
+} PrefetchState;
+
+/**
+ * @brief State shared between the main thread and the worker
+ */
+static struct {
+    /** @brief Protects \p state */
+    pthread_mutex_t lock;
+    /** @brief Signalled when the worker has finished */
+    pthread_cond_t finished;
+    /** @brief The worker thread */
+    pthread_t thread;
+    /** @brief \p true if \p thread has to be joined */
+    bool joinable;
+    /** @brief Set to non-zero to stop the worker early */
+    int cancelled;
+    /** @brief Current state of the load */
+    PrefetchState state;
+    /** @brief Cache filled by the worker */
+    ScoreCache * cache;
+    /** @brief Path of the shared leaderboard opened by the worker, \p NULL if none */
+    const char * shared_board;
+} prefetch = {.lock = PTHREAD_MUTEX_INITIALIZER, .finished = PTHREAD_COND_INITIALIZER};
+
+/**
+ * @brief Entry point of the worker thread, fills the cache and publishes the result
+ * @param argument unused
+ * @return \p NULL
+ */
+static void * prefetchWorker(void *);
+
+/**
+ * @brief Takes the result of a finished load, must be called with the lock held
+ * @return the loaded cache, \p NULL if loading failed or the cache has already been claimed
+ */
+static ScoreCache * claimResult();
+
+bool startScorePrefetch(int toplist_size, const char * shared_board) {
+    if (prefetch.state != PREFETCH_IDLE)
+        return true;
+    // Allocating here also creates the debugmalloc instance before a second thread exists
+    prefetch.cache = createScoreCache(toplist_size);
+    if (prefetch.cache == NULL)
+        return false;
+    prefetch.shared_board = shared_board;
+    prefetch.state = PREFETCH_RUNNING;
+    if (pthread_create(&prefetch.thread, NULL, prefetchWorker, NULL) == 0) {
+        prefetch.joinable = true;
+    } else {
+        // No thread available, fall back to loading the scores right now
+        prefetchWorker(NULL);
+    }
+    return true;
+}
+
+static void * prefetchWorker(void * argument) {
+    (void) argument;
+    bool success = loadScoreCache(prefetch.cache, &prefetch.cancelled);
+    // The claim of the cache publishes the mapping to the main thread
+    if (success && prefetch.shared_board != NULL && !__atomic_load_n(&prefetch.cancelled, __ATOMIC_RELAXED))
+        openSharedBoard(prefetch.shared_board, prefetch.cache);
+    pthread_mutex_lock(&prefetch.lock);
+    prefetch.state = success ? PREFETCH_READY : PREFETCH_FAILED;
+    pthread_cond_broadcast(&prefetch.finished);
+    pthread_mutex_unlock(&prefetch.lock);
+    return NULL;
+}
+
+static ScoreCache * claimResult() {
+    ScoreCache * cache = NULL;
+    if (prefetch.state == PREFETCH_READY) {
+        cache = prefetch.cache;
+    } else if (prefetch.state == PREFETCH_FAILED) {
+        freeScoreCache(prefetch.cache);
+    }
+    prefetch.cache = NULL;
+    prefetch.state = PREFETCH_CLAIMED;
+    return cache;
+}
+
+bool pollScorePrefetch(ScoreCache ** cache) {
+    pthread_mutex_lock(&prefetch.lock);
+    bool finished = prefetch.state != PREFETCH_RUNNING;
+    if (finished)
+        *cache = claimResult();
+    pthread_mutex_unlock(&prefetch.lock);
+    return finished;
+}
+
+ScoreCache * awaitScorePrefetch() {
+    pthread_mutex_lock(&prefetch.lock);
+    while (prefetch.state == PREFETCH_RUNNING)
+        pthread_cond_wait(&prefetch.finished, &prefetch.lock);
+    ScoreCache * cache = claimResult();
+    pthread_mutex_unlock(&prefetch.lock);
+    return cache;
+}
+
+void cancelScorePrefetch() {
+    __atomic_store_n(&prefetch.cancelled, 1, __ATOMIC_RELAXED);
+    if (prefetch.joinable) {
+        pthread_join(prefetch.thread, NULL);
+        prefetch.joinable = false;
+    }
+    freeScoreCache(awaitScorePrefetch());
+}
@@ -0,0 +1,48 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_PREFETCH_H
+#define SNEK_PREFETCH_H
+
+#include "scorecache.h"
+
+/**
+ * Starts loading the scores file into a \p ScoreCache on a background thread,
+ * so that no file I/O happens while the player is typing or playing.
+ * If the thread cannot be started, the scores are loaded synchronously.
+ * The shared leaderboard is opened by the same thread once the scores are loaded,
+ * so a new segment is rebuilt from them instead of reading the scores file again.
+ * It must not be used before the cache has been claimed.
+ * @brief Starts loading the scores in the background
+ * @param toplist_size how many items should the toplist contain
+ * @param shared_board path of the shared leaderboard, \p NULL to leave it closed
+ * @return \p true on success, \p false on allocation failure
+ */
+bool startScorePrefetch(int toplist_size, const char * shared_board);
+
+/**
+ * Checks whether the background load has finished, without blocking.
+ * Once it returns \p true, the ownership of the cache passes to the caller
+ * and later calls return \p true with a \p NULL cache.
+ * @brief Checks if the scores have been loaded
+ * @param cache set to the loaded cache, or to \p NULL if loading failed
+ * @return \p true if loading has finished, \p false if it is still in progress
+ */
+bool pollScorePrefetch(ScoreCache ** cache);
+
+/**
+ * Waits for the background load to finish. The ownership of the cache passes to the caller.
+ * @brief Waits for the scores to be loaded
+ * @return the loaded cache, \p NULL if loading failed or the cache has already been claimed
+ */
+ScoreCache * awaitScorePrefetch();
+
+/**
+ * Stops the background load if it is still running and frees the cache
+ * if it has not been claimed. Safe to call at any time, also multiple times.
+ * @brief Cancels the background load
+ */
+void cancelScorePrefetch();
+
+#endif //SNEK_PREFETCH_H
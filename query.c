@@ -0,0 +1,502 @@
+/**
+ * Reports are computed a block at a time: the requested columns of a block are decoded
+ * into arrays, group keys are computed for the whole batch, then the aggregates are
+ * updated in tight loops over the arrays, which the compiler can vectorize.
+ * Blocks are distributed between worker threads through an atomic counter,
+ * every worker aggregates into its own hash table, and the tables are merged at the end.
+ * \file query.c
+ * \author hexadec
+ * \brief This file contains the aggregate queries over the score archive
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "query.h"
+#include "archive.h"
+#include "allocator.h"
+
+/** @brief Maximum number of worker threads */
+#define MAX_THREADS 64
+
+/** @brief Size of a group key, large enough for a nickname */
+#define KEY_SIZE (NICK_MAX_LENGTH + 1)
+
+/**
+ * @brief Reports available in the query mode
+ */
+typedef enum {
+    /** @brief Totals over all games */
+    REPORT_SUMMARY,
+    /** @brief Aggregates grouped by nickname */
+    REPORT_PLAYERS,
+    /** @brief Aggregates grouped by day */
+    REPORT_DAYS,
+    /** @brief Number of games grouped by score range */
+    REPORT_HISTOGRAM
+} Report;
+
+/**
+ * @brief Aggregates of one group
+ */
+typedef struct {
+    /** @brief Group key: a nickname, or an integer in the first 8 bytes */
+    char key[KEY_SIZE];
+    /** @brief Number of games */
+    int64_t count;
+    /** @brief Sum of the scores */
+    int64_t sum;
+    /** @brief Smallest score */
+    int64_t min;
+    /** @brief Largest score */
+    int64_t max;
+    /** @brief Sum of the game durations in milliseconds */
+    int64_t duration;
+} Aggregate;
+
+/**
+ * @brief Hash aggregation table, groups are stored densely and found through open addressing
+ */
+typedef struct {
+    /** @brief Groups in order of their first appearance */
+    Aggregate * groups;
+    /** @brief Number of groups */
+    uint32_t count;
+    /** @brief Number of items allocated in \p groups */
+    uint32_t capacity;
+    /** @brief Index of the group in each slot, -1 for empty slots */
+    int32_t * slots;
+    /** @brief Number of slots (power of two) */
+    uint32_t slot_count;
+} AggregateTable;
+
+/**
+ * @brief Everything a worker thread needs
+ */
+typedef struct {
+    /** @brief Opened archive, shared by all workers */
+    const ArchiveReader * reader;
+    /** @brief Report to compute */
+    Report report;
+    /** @brief Score range of a histogram bucket */
+    int64_t bucket;
+    /** @brief Filters applied to every game */
+    const ArchiveFilter * filters;
+    /** @brief Number of items in \p filters */
+    int filter_count;
+    /** @brief Index of the next block to process, shared by all workers */
+    size_t * next_block;
+    /** @brief Aggregates collected by this worker */
+    AggregateTable table;
+    /** @brief Number of blocks skipped by their statistics */
+    size_t skipped;
+    /** @brief \p false if a block could not be read */
+    bool success;
+} Worker;
+
+/**
+ * @brief Initialises an empty aggregation table
+ * @param table table to initialise
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool createTable(AggregateTable * table);
+
+/**
+ * @brief Finds the group of a key, creating it if necessary
+ * @param table table to search in
+ * @param key group key of \p KEY_SIZE bytes
+ * @return index of the group, -1 on allocation failure
+ */
+static int32_t findGroup(AggregateTable * table, const char * key);
+
+/**
+ * @brief Frees the memory used by an aggregation table
+ * @param table table to free
+ */
+static void freeTable(AggregateTable * table);
+
+/**
+ * @brief Adds the aggregates of one table to another
+ * @param target table to add to
+ * @param source table to add
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool mergeTables(AggregateTable * target, const AggregateTable * source);
+
+/**
+ * @brief Updates the aggregates of a batch of games
+ * @param worker worker doing the aggregation
+ * @param batch games to aggregate
+ * @param ids buffer of at least \p batch->rows items for the group indices
+ * @param keys buffer of at least \p batch->rows items for the integer group keys
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool aggregateBatch(Worker * worker, const ArchiveBatch * batch, int32_t * ids, int64_t * keys);
+
+/**
+ * @brief Entry point of a worker thread, aggregates blocks until there are none left
+ * @param argument the \p Worker of the thread
+ * @return \p NULL
+ */
+static void * runWorker(void * argument);
+
+/**
+ * @brief Prints the aggregated report
+ * @param table merged aggregates
+ * @param report report to print
+ * @param bucket score range of a histogram bucket
+ */
+static void printReport(AggregateTable * table, Report report, int64_t bucket);
+
+/**
+ * @brief Orders groups by their key, nicknames alphabetically, integers ascending
+ */
+static int compareKeys(const void *, const void *);
+
+/**
+ * @brief Orders groups with names by their key as strings
+ */
+static int compareNames(const void *, const void *);
+
+static bool createTable(AggregateTable * table) {
+    table->count = 0;
+    table->capacity = 64;
+    table->slot_count = 128;
+    table->groups = malloc(table->capacity * sizeof(Aggregate));
+    table->slots = malloc(table->slot_count * sizeof(int32_t));
+    if (table->groups == NULL || table->slots == NULL) {
+        freeTable(table);
+        return false;
+    }
+    memset(table->slots, -1, table->slot_count * sizeof(int32_t));
+    return true;
+}
+
+static void freeTable(AggregateTable * table) {
+    free(table->groups);
+    free(table->slots);
+    table->groups = NULL;
+    table->slots = NULL;
+}
+
+static uint32_t hashKey(const char * key) {
+    uint64_t first, second;
+    memcpy(&first, key, sizeof(uint64_t));
+    memcpy(&second, key + sizeof(uint64_t), sizeof(uint64_t));
+    uint64_t hash = (first ^ (second * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    return (uint32_t) (hash >> 32);
+}
+
+static int32_t findGroup(AggregateTable * table, const char * key) {
+    uint32_t slot = hashKey(key) & (table->slot_count - 1);
+    while (table->slots[slot] >= 0) {
+        if (memcmp(table->groups[table->slots[slot]].key, key, KEY_SIZE) == 0)
+            return table->slots[slot];
+        slot = (slot + 1) & (table->slot_count - 1);
+    }
+    if (table->count == table->capacity) {
+        Aggregate * groups = realloc(table->groups, table->capacity * 2 * sizeof(Aggregate));
+        if (groups == NULL)
+            return -1;
+        table->groups = groups;
+        table->capacity *= 2;
+    }
+    // Rehash at half load, the slots only hold group indices so this is cheap
+    if ((table->count + 1) * 2 > table->slot_count) {
+        int32_t * slots = malloc(table->slot_count * 2 * sizeof(int32_t));
+        if (slots == NULL)
+            return -1;
+        free(table->slots);
+        table->slots = slots;
+        table->slot_count *= 2;
+        memset(table->slots, -1, table->slot_count * sizeof(int32_t));
+        for (uint32_t i = 0; i < table->count; i++) {
+            uint32_t position = hashKey(table->groups[i].key) & (table->slot_count - 1);
+            while (table->slots[position] >= 0)
+                position = (position + 1) & (table->slot_count - 1);
+            table->slots[position] = (int32_t) i;
+        }
+        slot = hashKey(key) & (table->slot_count - 1);
+        while (table->slots[slot] >= 0)
+            slot = (slot + 1) & (table->slot_count - 1);
+    }
+    Aggregate * group = &table->groups[table->count];
+    memcpy(group->key, key, KEY_SIZE);
+    group->count = group->sum = group->duration = 0;
+    group->min = INT64_MAX;
+    group->max = INT64_MIN;
+    table->slots[slot] = (int32_t) table->count;
+    return (int32_t) table->count++;
+}
+
+static bool mergeTables(AggregateTable * target, const AggregateTable * source) {
+    for (uint32_t i = 0; i < source->count; i++) {
+        const Aggregate * from = &source->groups[i];
+        int32_t id = findGroup(target, from->key);
+        if (id < 0)
+            return false;
+        Aggregate * to = &target->groups[id];
+        to->count += from->count;
+        to->sum += from->sum;
+        to->duration += from->duration;
+        if (from->min < to->min) to->min = from->min;
+        if (from->max > to->max) to->max = from->max;
+    }
+    return true;
+}
+
+static bool aggregateBatch(Worker * worker, const ArchiveBatch * batch, int32_t * ids, int64_t * keys) {
+    const uint32_t rows = batch->rows;
+    const int64_t * scores = batch->values[ARCHIVE_SCORE];
+    const int64_t * durations = batch->values[ARCHIVE_DURATION];
+    char key[KEY_SIZE];
+    memset(key, 0, KEY_SIZE);
+
+    // A block may pass its statistics and still lose every row to the filters
+    if (rows == 0)
+        return true;
+
+    if (worker->report == REPORT_SUMMARY) {
+        // Ungrouped: branch-free reductions over the columns
+        int64_t sum = 0, duration = 0, min = INT64_MAX, max = INT64_MIN;
+        for (uint32_t i = 0; i < rows; i++) {
+            sum += scores[i];
+            duration += durations[i];
+            min = scores[i] < min ? scores[i] : min;
+            max = scores[i] > max ? scores[i] : max;
+        }
+        int32_t id = findGroup(&worker->table, key);
+        if (id < 0)
+            return false;
+        Aggregate * group = &worker->table.groups[id];
+        group->count += rows;
+        group->sum += sum;
+        group->duration += duration;
+        if (min < group->min) group->min = min;
+        if (max > group->max) group->max = max;
+        return true;
+    }
+
+    // Compute the integer keys of the whole batch first
+    if (worker->report == REPORT_DAYS) {
+        const int64_t * timestamps = batch->values[ARCHIVE_TIMESTAMP];
+        for (uint32_t i = 0; i < rows; i++)
+            keys[i] = (timestamps[i] - (timestamps[i] < 0 ? 86399 : 0)) / 86400;
+    } else if (worker->report == REPORT_HISTOGRAM) {
+        const int64_t bucket = worker->bucket;
+        for (uint32_t i = 0; i < rows; i++)
+            keys[i] = scores[i] / bucket;
+    }
+    for (uint32_t i = 0; i < rows; i++) {
+        if (worker->report == REPORT_PLAYERS)
+            strncpy(key, batch->nicks[i], KEY_SIZE - 1);
+        else
+            memcpy(key, &keys[i], sizeof(int64_t));
+        ids[i] = findGroup(&worker->table, key);
+        if (ids[i] < 0)
+            return false;
+    }
+    Aggregate * groups = worker->table.groups;
+    for (uint32_t i = 0; i < rows; i++) {
+        Aggregate * group = &groups[ids[i]];
+        group->count++;
+        group->sum += scores[i];
+        group->duration += durations[i];
+        group->min = scores[i] < group->min ? scores[i] : group->min;
+        group->max = scores[i] > group->max ? scores[i] : group->max;
+    }
+    return true;
+}
+
+static void * runWorker(void * argument) {
+    Worker * worker = argument;
+    ArchiveBatch batch;
+    memset(&batch, 0, sizeof(ArchiveBatch));
+    int32_t * ids = malloc(ARCHIVE_BLOCK_ROWS * sizeof(int32_t));
+    int64_t * keys = malloc(ARCHIVE_BLOCK_ROWS * sizeof(int64_t));
+    worker->success = ids != NULL && keys != NULL;
+
+    unsigned columns = ARCHIVE_COLUMN_BIT(ARCHIVE_SCORE) | ARCHIVE_COLUMN_BIT(ARCHIVE_DURATION);
+    if (worker->report == REPORT_PLAYERS)
+        columns |= ARCHIVE_COLUMN_BIT(ARCHIVE_NICK);
+    if (worker->report == REPORT_DAYS)
+        columns |= ARCHIVE_COLUMN_BIT(ARCHIVE_TIMESTAMP);
+    for (int i = 0; i < worker->filter_count; i++)
+        columns |= ARCHIVE_COLUMN_BIT(worker->filters[i].column);
+
+    while (worker->success) {
+        size_t index = __atomic_fetch_add(worker->next_block, 1, __ATOMIC_RELAXED);
+        if (index >= worker->reader->block_count)
+            break;
+        if (!archiveBlockMayMatch(&worker->reader->blocks[index], worker->filters, worker->filter_count)) {
+            worker->skipped++;
+            continue;
+        }
+        if (readArchiveBlock(worker->reader, index, columns, &batch) != 0) {
+            worker->success = false;
+            break;
+        }
+        filterArchiveBatch(&batch, worker->filters, worker->filter_count);
+        worker->success = aggregateBatch(worker, &batch, ids, keys);
+    }
+    freeArchiveBatch(&batch);
+    free(ids);
+    free(keys);
+    return NULL;
+}
+
+static int compareKeys(const void * first, const void * second) {
+    int64_t a, b;
+    memcpy(&a, ((const Aggregate *) first)->key, sizeof(int64_t));
+    memcpy(&b, ((const Aggregate *) second)->key, sizeof(int64_t));
+    return a < b ? -1 : a > b;
+}
+
+static int compareNames(const void * first, const void * second) {
+    return strcmp(((const Aggregate *) first)->key, ((const Aggregate *) second)->key);
+}
+
+static void printReport(AggregateTable * table, Report report, int64_t bucket) {
+    qsort(table->groups, table->count, sizeof(Aggregate), report == REPORT_PLAYERS ? compareNames : compareKeys);
+    switch (report) {
+        case REPORT_SUMMARY:
+            printf("%12s %12s %8s %8s %10s %14s\n", "games", "total", "min", "max", "average", "avg duration");
+            break;
+        case REPORT_PLAYERS:
+            printf("%-*s %10s %8s %8s %10s\n", NICK_MAX_LENGTH, "nickname", "games", "min", "max", "average");
+            break;
+        case REPORT_DAYS:
+            printf("%-10s %10s %8s %10s\n", "day", "games", "max", "average");
+            break;
+        case REPORT_HISTOGRAM:
+            printf("%-15s %10s\n", "score", "games");
+            break;
+    }
+    for (uint32_t i = 0; i < table->count; i++) {
+        const Aggregate * group = &table->groups[i];
+        double average = group->count > 0 ? (double) group->sum / (double) group->count : 0;
+        int64_t key;
+        memcpy(&key, group->key, sizeof(int64_t));
+        switch (report) {
+            case REPORT_SUMMARY:
+                // The extremes of a group without games are still the initial sentinels
+                if (group->count == 0) {
+                    printf("%12lld %12lld %8s %8s %10.2f %12.1fs\n", 0LL, 0LL, "-", "-", 0.0, 0.0);
+                    break;
+                }
+                printf("%12lld %12lld %8lld %8lld %10.2f %12.1fs\n", (long long) group->count, (long long) group->sum,
+                       (long long) group->min, (long long) group->max, average,
+                       (double) group->duration / (double) group->count / 1000.0);
+                break;
+            case REPORT_PLAYERS:
+                printf("%-*s %10lld %8lld %8lld %10.2f\n", NICK_MAX_LENGTH, group->key, (long long) group->count,
+                       (long long) group->min, (long long) group->max, average);
+                break;
+            case REPORT_DAYS: {
+                char day[16];
+                time_t seconds = (time_t) (key * 86400);
+                struct tm date;
+                strftime(day, sizeof(day), "%Y-%m-%d", gmtime_r(&seconds, &date));
+                printf("%-10s %10lld %8lld %10.2f\n", day, (long long) group->count, (long long) group->max, average);
+                break;
+            }
+            case REPORT_HISTOGRAM:
+                printf("%6lld - %6lld %10lld\n", (long long) (key * bucket), (long long) (key * bucket + bucket - 1), (long long) group->count);
+                break;
+        }
+    }
+}
+
+int runQuery(int argc, char ** argv) {
+    const char * usage = "Usage: snek --query summary|players|days|histogram [--since T] [--until T] [--bucket N] [--threads N]\n";
+    if (argc < 1) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+    Report report;
+    if (strcmp(argv[0], "summary") == 0) report = REPORT_SUMMARY;
+    else if (strcmp(argv[0], "players") == 0) report = REPORT_PLAYERS;
+    else if (strcmp(argv[0], "days") == 0) report = REPORT_DAYS;
+    else if (strcmp(argv[0], "histogram") == 0) report = REPORT_HISTOGRAM;
+    else {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+    // A single time range, given again the later bound wins
+    int64_t since = INT64_MIN;
+    int64_t until = INT64_MAX;
+    int64_t bucket = 10;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+        long long value = atoll(argv[i + 1]);
+        if (strcmp(argv[i], "--since") == 0) {
+            since = value;
+        } else if (strcmp(argv[i], "--until") == 0) {
+            until = value;
+        } else if (strcmp(argv[i], "--bucket") == 0 && value > 0) {
+            bucket = value;
+        } else if (strcmp(argv[i], "--threads") == 0 && value > 0) {
+            threads = value;
+        } else {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+        i++;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    ArchiveFilter filters[1] = {{ARCHIVE_TIMESTAMP, since, until}};
+    int filter_count = since != INT64_MIN || until != INT64_MAX ? 1 : 0;
+
+    ArchiveReader * reader = openArchive();
+    if (reader == NULL) {
+        fprintf(stderr, "Couldn't open the score archive\n");
+        return 2;
+    }
+    Worker workers[MAX_THREADS];
+    pthread_t thread_ids[MAX_THREADS];
+    bool started[MAX_THREADS];
+    size_t next_block = 0;
+    bool success = true;
+    for (long i = 0; i < threads; i++) {
+        workers[i] = (Worker) {reader, report, bucket, filters, filter_count, &next_block, {NULL, 0, 0, NULL, 0}, 0, true};
+        if (!createTable(&workers[i].table)) {
+            threads = i;
+            success = false;
+            break;
+        }
+        // The first worker runs on the calling thread
+        started[i] = i > 0 && pthread_create(&thread_ids[i], NULL, runWorker, &workers[i]) == 0;
+    }
+    if (threads > 0)
+        runWorker(&workers[0]);
+    size_t skipped = 0;
+    for (long i = 0; i < threads; i++) {
+        if (i > 0 && !started[i])
+            runWorker(&workers[i]);
+        else if (i > 0)
+            pthread_join(thread_ids[i], NULL);
+        success = success && workers[i].success;
+        if (i > 0 && success)
+            success = mergeTables(&workers[0].table, &workers[i].table);
+        skipped += workers[i].skipped;
+    }
+    if (success) {
+        printReport(&workers[0].table, report, bucket);
+        fprintf(stderr, "%zu blocks, %zu skipped by statistics, %ld threads\n", reader->block_count, skipped, threads);
+    } else {
+        fprintf(stderr, "Couldn't read the score archive\n");
+    }
+    for (long i = 0; i < threads; i++)
+        freeTable(&workers[i].table);
+    closeArchive(reader);
+    return success ? 0 : 2;
+}
@@ -0,0 +1,19 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_QUERY_H
+#define SNEK_QUERY_H
+
+/**
+ * Runs an aggregate report over the score archive and prints it to the standard output.
+ * Usage: <tt>snek --query summary|players|days|histogram [--since T] [--until T] [--bucket N] [--threads N]</tt>,
+ * where \p --since and \p --until are seconds since the epoch.
+ * @brief Entry point of the query mode
+ * @param argc number of arguments following \p --query
+ * @param argv arguments following \p --query
+ * @return exit code
+ */
+int runQuery(int argc, char ** argv);
+
+#endif //SNEK_QUERY_H
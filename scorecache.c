@@ -0,0 +1,289 @@
+/**
+ * The score cache replaces the separate \p getHighscore and \p getToplist passes
+ * over the scores file with a single one. Besides the toplist it keeps the best
+ * score of every player, so the file can be read before the nickname of the
+ * current player is known. Names are interned once, everything else refers to
+ * players by their \p PlayerId.
+ * \file scorecache.c
+ * \author hexadec
+ * \brief This file contains the session-level score cache
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "scorecache.h"
+#include "metrics.h"
+#include "trace.h"
+#include "allocator.h"
+
+/** @brief Buffer size for reading from file (greater than max line length) */
+#define BUFFER_SIZE 100
+
+/** @brief Initial number of players the best scores are allocated for */
+#define INITIAL_PLAYER_CAPACITY 64
+
+/**
+ * Reads records from the current position of the file up to the last complete line,
+ * and advances \p cache->offset past them. Malformed lines are skipped.
+ * @brief Adds the records of the scores file to the cache
+ * @param cache cache to update
+ * @param file scores file positioned at the first record to read
+ * @param cancelled if not \p NULL, reading stops early once it points to a non-zero value
+ * @return number of records added, -1 on allocation failure
+ */
+static int readScores(ScoreCache * cache, FILE * file, const int * cancelled);
+
+/**
+ * @brief Forgets every score in the cache, so the scores file can be read again
+ * @param cache cache to reset
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool resetScoreCache(ScoreCache * cache);
+
+/**
+ * @brief Remembers which file the scores are read from, to notice when it is replaced
+ * @param cache cache to update
+ * @param file the open scores file
+ * @return \p true if it is the file read before, or nothing has been read yet
+ */
+static bool recordScoreFile(ScoreCache * cache, FILE * file);
+
+/**
+ * @brief Adds the new records of the scores file to the cache, see \p refreshScoreCache
+ * @param cache loaded cache to update
+ * @return number of records added, -1 on allocation failure
+ */
+static int readNewScores(ScoreCache * cache);
+
+/**
+ * Inserts a score into the sorted toplist if it is high enough, dropping the lowest item.
+ * Among equal scores the newer one is placed first, as in \p getToplist.
+ * @brief Inserts a score into the toplist
+ * @param cache cache holding the toplist
+ * @param player ID of the player in \p cache->nicks
+ * @param score score to insert
+ */
+static void insertIntoToplist(ScoreCache * cache, PlayerId player, int score);
+
+/**
+ * @brief Raises the best score of a player, adding the player if needed
+ * @param cache cache holding the best scores
+ * @param player ID of the player in \p cache->nicks
+ * @param score score to record
+ * @return \p true on success, \p false on allocation failure
+ */
+static bool updatePlayerBest(ScoreCache * cache, PlayerId player, int score);
+
+/**
+ * @brief Length of a name as it is stored in the cache
+ * @param name player name
+ * @return length of \p name, at most \p NICK_MAX_LENGTH
+ */
+static size_t nickLength(const char * name);
+
+static const char scores_file[] = "scores.txt";
+
+ScoreCache * createScoreCache(int toplist_size) {
+    ScoreCache * cache = malloc(sizeof(ScoreCache));
+    if (cache == NULL)
+        return NULL;
+    cache->toplist_size = toplist_size;
+    cache->toplist = calloc(toplist_size, sizeof(Nick_Score));
+    cache->nicks = createNickDictionary();
+    cache->player_count = 0;
+    cache->offset = 0;
+    cache->device = 0;
+    cache->inode = 0;
+    cache->best_capacity = INITIAL_PLAYER_CAPACITY;
+    cache->best = malloc(cache->best_capacity * sizeof(int));
+    cache->leaderboard = createLeaderboard(cache->nicks);
+    if (cache->toplist == NULL || cache->nicks == NULL || cache->best == NULL || cache->leaderboard == NULL) {
+        freeScoreCache(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+bool loadScoreCache(ScoreCache * cache, const int * cancelled) {
+    FILE * file = fopen(scores_file, "r");
+    if (file == NULL)
+        return true;
+    TRACE_BEGIN("loadScoreCache");
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    recordScoreFile(cache, file);
+    bool result = readScores(cache, file, cancelled) >= 0;
+    fclose(file);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    recordScoreScan(SCAN_FULL, elapsedNanoseconds(&start, &end));
+    TRACE_END("loadScoreCache");
+    return result;
+}
+
+int refreshScoreCache(ScoreCache * cache) {
+    TRACE_BEGIN("refreshScoreCache");
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    int read = readNewScores(cache);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    recordScoreScan(SCAN_INCREMENTAL, elapsedNanoseconds(&start, &end));
+    TRACE_END("refreshScoreCache");
+    return read;
+}
+
+static int readNewScores(ScoreCache * cache) {
+    FILE * file = fopen(scores_file, "r");
+    if (file == NULL)
+        return 0;
+    // A replacement of any size is a new file, a truncated one is only shorter
+    bool replaced = !recordScoreFile(cache, file);
+    if (fseek(file, 0, SEEK_END) != 0 || (!replaced && ftell(file) == cache->offset)) {
+        fclose(file);
+        return 0;
+    }
+    if (replaced || ftell(file) < cache->offset) {
+        // The file has been replaced, its records have to be read again
+        if (!resetScoreCache(cache)) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fseek(file, cache->offset, SEEK_SET);
+    int read = readScores(cache, file, NULL);
+    fclose(file);
+    return read;
+}
+
+static int readScores(ScoreCache * cache, FILE * file, const int * cancelled) {
+    char buffer[BUFFER_SIZE];
+    int read = 0;
+    while (fgets(buffer, BUFFER_SIZE, file) != NULL) {
+        if (cancelled != NULL && __atomic_load_n(cancelled, __ATOMIC_RELAXED))
+            break;
+        // A record without its line break is still being written, it is read next time
+        if (strchr(buffer, '\n') == NULL && feof(file))
+            break;
+        cache->offset = ftell(file);
+        char * separator = strchr(buffer, ',');
+        int score;
+        if (separator == NULL || sscanf(separator + 1, "%d", &score) != 1)
+            continue;
+        *separator = '\0';
+        if (!updateScoreCache(cache, buffer, score))
+            return -1;
+        read++;
+    }
+    return read;
+}
+
+static bool recordScoreFile(ScoreCache * cache, FILE * file) {
+    struct stat status;
+    if (fstat(fileno(file), &status) != 0)
+        return true;
+    bool same = cache->inode == 0 || (status.st_ino == cache->inode && status.st_dev == cache->device);
+    cache->device = status.st_dev;
+    cache->inode = status.st_ino;
+    return same;
+}
+
+static bool resetScoreCache(ScoreCache * cache) {
+    Leaderboard * leaderboard = createLeaderboard(cache->nicks);
+    if (leaderboard == NULL)
+        return false;
+    freeLeaderboard(cache->leaderboard);
+    cache->leaderboard = leaderboard;
+    memset(cache->toplist, 0, cache->toplist_size * sizeof(Nick_Score));
+    // Interned names and their IDs stay valid, only the scores are forgotten
+    for (size_t i = 0; i < cache->player_count; i++)
+        cache->best[i] = SCORE_ABSENT;
+    cache->offset = 0;
+    return true;
+}
+
+int getCachedHighscore(const ScoreCache * cache, const char * name) {
+    PlayerId player = findNick(cache->nicks, name, nickLength(name));
+    if (player == PLAYER_NONE || player >= cache->player_count || cache->best[player] == SCORE_ABSENT)
+        return 0;
+    return cache->best[player];
+}
+
+size_t getCachedRank(const ScoreCache * cache, const char * name) {
+    PlayerId player = findNick(cache->nicks, name, nickLength(name));
+    if (player == PLAYER_NONE || player >= cache->player_count || cache->best[player] == SCORE_ABSENT)
+        return 0;
+    return getLeaderboardRank(cache->leaderboard, player, cache->best[player]);
+}
+
+size_t getCachedPage(const ScoreCache * cache, size_t offset, size_t limit, Nick_Score * entries) {
+    return getLeaderboardRange(cache->leaderboard, offset + 1, limit, entries);
+}
+
+size_t getCachedPlayerCount(const ScoreCache * cache) {
+    return cache->leaderboard->size;
+}
+
+bool updateScoreCache(ScoreCache * cache, const char * name, int score) {
+    PlayerId player = internNick(cache->nicks, name, nickLength(name));
+    if (player == PLAYER_NONE || !updatePlayerBest(cache, player, score))
+        return false;
+    insertIntoToplist(cache, player, score);
+    return true;
+}
+
+static void insertIntoToplist(ScoreCache * cache, PlayerId player, int score) {
+    Nick_Score * toplist = cache->toplist;
+    int last = cache->toplist_size - 1;
+    if (last < 0 || (toplist[last].nick != NULL && toplist[last].score > score))
+        return;
+    int position = 0;
+    while (position < last && toplist[position].nick != NULL && toplist[position].score > score)
+        position++;
+    memmove(&toplist[position + 1], &toplist[position], (last - position) * sizeof(Nick_Score));
+    // The names are owned by the dictionary, Nick_Score has no const qualifier
+    toplist[position].nick = (char *) getNick(cache->nicks, player);
+    toplist[position].score = score;
+    toplist[position].player = player;
+}
+
+static bool updatePlayerBest(ScoreCache * cache, PlayerId player, int score) {
+    if (player >= cache->best_capacity) {
+        size_t capacity = cache->best_capacity;
+        while (capacity <= player)
+            capacity *= 2;
+        int * best = realloc(cache->best, capacity * sizeof(int));
+        if (best == NULL)
+            return false;
+        cache->best = best;
+        cache->best_capacity = capacity;
+    }
+    // IDs are dense, but the players interned meanwhile may have no score yet
+    while (cache->player_count <= player)
+        cache->best[cache->player_count++] = SCORE_ABSENT;
+    if (cache->best[player] == SCORE_ABSENT) {
+        cache->best[player] = score;
+        return insertLeaderboardEntry(cache->leaderboard, player, score);
+    }
+    if (score > cache->best[player]) {
+        removeLeaderboardEntry(cache->leaderboard, player, cache->best[player]);
+        cache->best[player] = score;
+        return insertLeaderboardEntry(cache->leaderboard, player, score);
+    }
+    return true;
+}
+
+static size_t nickLength(const char * name) {
+    return strnlen(name, NICK_MAX_LENGTH);
+}
+
+void freeScoreCache(ScoreCache * cache) {
+    if (cache == NULL)
+        return;
+    freeLeaderboard(cache->leaderboard);
+    free(cache->toplist);
+    free(cache->best);
+    freeNickDictionary(cache->nicks);
+    free(cache);
+}
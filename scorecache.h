@@ -0,0 +1,137 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_SCORECACHE_H
+#define SNEK_SCORECACHE_H
+
+#include <limits.h>
+#include <sys/types.h>
+#include "snek.h"
+#include "leaderboard.h"
+#include "nickdict.h"
+
+/**
+ * Session-level view of the scores file. It is built with a single pass over
+ * the file and then kept up to date in memory, so highscores and the toplist
+ * can be served without reading the file again.
+ * @brief Structure holding the scores relevant to the current session
+ */
+typedef struct ScoreCache {
+    /** @brief Number of items in \p toplist */
+    int toplist_size;
+    /**
+     * Toplist in descending order by score. Unused items have a \p NULL nick.
+     * Names point into \p nicks.
+     * @brief Toplist containing the highest scores
+     */
+    Nick_Score * toplist;
+    /** @brief Interned names of every player, truncated to \p NICK_MAX_LENGTH characters */
+    NickDictionary * nicks;
+    /**
+     * Interned players without a score, such as the players of a replaced
+     * scores file, hold \p SCORE_ABSENT.
+     * @brief Best score of every player, indexed by \p PlayerId
+     */
+    int * best;
+    /** @brief Number of items of \p best that are set, every ID below it has a score or \p SCORE_ABSENT */
+    size_t player_count;
+    /** @brief Number of items allocated in \p best */
+    size_t best_capacity;
+    /** @brief Best score of every player ordered by rank */
+    Leaderboard * leaderboard;
+    /** @brief Number of bytes of the scores file that have been read into the cache */
+    long offset;
+    /** @brief Device of the scores file that has been read, to notice when it is replaced */
+    dev_t device;
+    /** @brief Inode of the scores file that has been read, 0 if there was none */
+    ino_t inode;
+} ScoreCache;
+
+/** @brief Value of \p ScoreCache::best for players without a score */
+#define SCORE_ABSENT INT_MIN
+
+/**
+ * @brief Creates an empty score cache
+ * @param toplist_size how many items should the toplist contain
+ * @return dynamically allocated cache, \p NULL on allocation failure
+ */
+ScoreCache * createScoreCache(int toplist_size);
+
+/**
+ * Reads the scores file once, collecting the best score of every player
+ * and the highest scores at the same time. Malformed lines are skipped.
+ * A missing scores file leaves the cache empty.
+ * @brief Fills the score cache from the scores file
+ * @param cache empty cache to fill
+ * @param cancelled if not \p NULL, loading stops early once it points to a non-zero value
+ * @return \p true on success, \p false on allocation failure
+ */
+bool loadScoreCache(ScoreCache * cache, const int * cancelled);
+
+/**
+ * Reads only the records appended to the scores file since it was last read,
+ * so the cost is proportional to the new data. If the file is another one
+ * than was read before, or it has shrunk, it has been replaced and is read
+ * again from the start.
+ * @brief Adds the new records of the scores file to the cache
+ * @param cache loaded cache to update
+ * @return number of records added, -1 on allocation failure
+ */
+int refreshScoreCache(ScoreCache * cache);
+
+/**
+ * @brief Looks up the highscore of a player
+ * @param cache cache to search in
+ * @param name player name
+ * @return highscore of player, 0 if not found
+ */
+int getCachedHighscore(const ScoreCache * cache, const char * name);
+
+/**
+ * @brief Looks up the rank of a player among the best scores of all players in O(log n)
+ * @param cache cache to search in
+ * @param name player name
+ * @return rank of player starting from 1, 0 if not found
+ */
+size_t getCachedRank(const ScoreCache * cache, const char * name);
+
+/**
+ * Reads \p limit players ranked after the first \p offset ones. Only the page is
+ * copied, finding its first rank is O(log n), so the cost depends on the size of
+ * the page instead of the number of players. Names are owned by the cache.
+ * @brief Reads a page of the leaderboard
+ * @param cache cache to read from
+ * @param offset number of players ranked above the page
+ * @param limit maximum number of players on the page
+ * @param entries array of at least \p limit items to fill
+ * @return number of players on the page
+ */
+size_t getCachedPage(const ScoreCache * cache, size_t offset, size_t limit, Nick_Score * entries);
+
+/**
+ * @brief Returns the number of players on the leaderboard
+ * @param cache cache to read from
+ * @return number of ranked players
+ */
+size_t getCachedPlayerCount(const ScoreCache * cache);
+
+/**
+ * Records a score in the cache, without any file I/O. The score is not
+ * counted as read from the scores file, so saved scores should be picked up
+ * with \p refreshScoreCache instead, or they would be added twice.
+ * @brief Adds a score to the cache
+ * @param cache cache to update
+ * @param name name of the player the score belongs to
+ * @param score score to add
+ * @return \p true on success, \p false on allocation failure
+ */
+bool updateScoreCache(ScoreCache * cache, const char * name, int score);
+
+/**
+ * @brief Frees all memory used by the cache, \p NULL is ignored
+ * @param cache cache to free
+ */
+void freeScoreCache(ScoreCache * cache);
+
+#endif //SNEK_SCORECACHE_H
@@ -0,0 +1,62 @@
+/**
+ * Other instances only ever append to the scores file, so a notification is
+ * enough to tell the score cache that it has new records to read.
+ * \file scorewatch.c
+ * \author hexadec
+ * \brief This file contains the inotify watcher of the scores file
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "scorewatch.h"
+#include "allocator.h"
+
+/** @brief Size of the buffer notifications are read into, fits several events with names */
+#define EVENT_BUFFER_SIZE 4096
+
+/** @brief inotify instance, -1 if not open */
+static int watch_fd = -1;
+
+static const char scores_file[] = "scores.txt";
+
+bool openScoreWatch() {
+    if (watch_fd >= 0)
+        return true;
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0)
+        return false;
+    // Closing the file would be enough for the writer of this process, but
+    // the O_APPEND writes of other instances only show up as modifications
+    if (inotify_add_watch(watch_fd, ".", IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0) {
+        closeScoreWatch();
+        return false;
+    }
+    return true;
+}
+
+bool pollScoreWatch() {
+    if (watch_fd < 0)
+        return false;
+    // Aligned as required by the event structures read into it
+    char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(watch_fd, buffer, sizeof(buffer))) > 0) {
+        for (char * position = buffer; position < buffer + length;) {
+            const struct inotify_event * event = (const struct inotify_event *) position;
+            // The archive files live in the same directory, only the scores file is of interest
+            if (event->len > 0 && strcmp(event->name, scores_file) == 0)
+                changed = true;
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+void closeScoreWatch() {
+    if (watch_fd < 0)
+        return;
+    close(watch_fd);
+    watch_fd = -1;
+}
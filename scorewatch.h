@@ -0,0 +1,30 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_SCOREWATCH_H
+#define SNEK_SCOREWATCH_H
+
+#include <stdbool.h>
+
+/**
+ * Starts watching the scores file with inotify. The directory of the file is
+ * watched, so the file does not need to exist yet and replacing it is noticed too.
+ * @brief Starts watching the scores file for changes
+ * @return \p true on success, \p false if inotify is not available
+ */
+bool openScoreWatch();
+
+/**
+ * Consumes the pending notifications without blocking.
+ * @brief Checks if the scores file has changed since the last call
+ * @return \p true if the scores file has been written or replaced
+ */
+bool pollScoreWatch();
+
+/**
+ * @brief Stops watching the scores file, does nothing if it is not watched
+ */
+void closeScoreWatch();
+
+#endif //SNEK_SCOREWATCH_H
@@ -15,15 +15,24 @@
 #include <locale.h>
 #include <signal.h>
 #include <stdlib.h>
-#include "debugmalloc.h"
+#include "allocator.h"
 #include "screen.h"
 #include "snek.h"
+#include "trace.h"
+#include "startup.h"
+#include "metrics.h"
+#include "flightrec.h"
 
 /**
  * @brief Draw the frame around the game field
  */
 static void drawFrame();
 
+/**
+ * @brief Draw the border of the game field, below the status line
+ */
+static void drawBorder();
+
 /**
  * @brief Draw the snake itself
  */
@@ -35,15 +44,34 @@ static void drawSnake(bool);
 static void drawFood();
 
 /**
- * Handles signal events, such as terminal resize, and \p SIGUSR1.
- * \p SIGUSR1 is sent if the terminal size is too small.
+ * Only marks the resize, the game is torn down by \p checkResize on the main thread,
+ * as freeing memory and joining threads is not safe in a signal handler.
+ * The blocking reads are interrupted by the signal, so they return to check it.
+ * @brief Handles the terminal resize signal (\p SIGWINCH )
+ * @param signal code of received signal
+ */
+static void signalEventHandler(int);
+
+/**
+ * @brief Ends the game if the terminal has been resized since the last check
+ */
+static void checkResize();
+
+/**
  * This piece of code is mainly necessary to free memory on close,
  * no matter which state the program is in, and avoid any segfaults by preventing
  * freeing memory that is not yet used.
- * @brief Handles signal events (\p SIGWINCH and \p SIGUSR1 )
- * @param signal code of received signal
+ * @brief Closes the screen, ends the game and exits
+ * @param message message printed after the screen has been closed
  */
-static void signalEventHandler(int);
+static void abortGame(const char *);
+
+/**
+ * Colors are set up on the first colored drawing, so \p start_color does not
+ * delay the nickname prompt, which is drawn without colors.
+ * @brief Sets up the color pairs of \p TEXT_FORMATS, unless they already are
+ */
+static void initializeColors();
 
 /**
  * Necessary to have as a static global variable, as a window instance
@@ -59,6 +87,18 @@ static WINDOW * window;
  */
 static const Snek * snek;
 
+/** @brief Screen of \p initializeHeadlessScreen, \p NULL on a terminal */
+static SCREEN * headless_screen;
+
+/** @brief Output of the headless screen, \p NULL on a terminal */
+static FILE * headless_output;
+
+/** @brief Set by \p signalEventHandler when the terminal has been resized */
+static volatile sig_atomic_t resized = 0;
+
+/** @brief Whether \p initializeColors has set up the colors of the screen */
+static bool colors_initialized;
+
 /**
  * @brief \p enum storing indices of \p COLOR_PAIR -s
  */
@@ -72,74 +112,166 @@ enum TEXT_FORMATS {
     /** @brief Black text (darkgray), black background*/
     BLACK_BLACK,
     /** @brief Black text, white background*/
-    BLACK_WHITE
+    BLACK_WHITE,
+    /** @brief Cyan text, black background*/
+    CYAN_BLACK,
+    /** @brief Yellow text, black background*/
+    YELLOW_BLACK
 };
 
+/** @brief Colors of the players of the arena, the bots are drawn in \p YELLOW_BLACK */
+static const enum TEXT_FORMATS player_colors[] = {GREEN_BLACK, CYAN_BLACK};
+
 void initializeScreen(Snek * game) {
     snek = game;
-    // Support shading characters as well
-    setlocale(LC_ALL, "");
+    // Support shading characters as well, only the character set is needed,
+    // which spares loading every other category of the locale
+    setlocale(LC_CTYPE, "");
+    markStartupPhase("locale", false);
     window = initscr();
+    markStartupPhase("initscr", false);
     // Disable terminal echo (when the user presses a control key)
     noecho();
     // Hide cursor
     curs_set(0);
     game->game_size = (Point){getmaxx(window), getmaxy(window)};
-    if (game->game_size.x < 35 || game->game_size.y < 8)
+    if (game->game_size.x < 35 || game->game_size.y < 8) {
         //Too small terminal
-        signalEventHandler(SIGUSR1);
+        markFlightEnd(FLIGHT_TOO_SMALL);
+        abortGame("Terminal size too small, aborting\n");
+    }
     keypad(window, true);
+    static struct sigaction signal_handler;
+    memset(&signal_handler, 0, sizeof(struct sigaction));
+    signal_handler.sa_handler = signalEventHandler;
+    sigaction(SIGWINCH, &signal_handler, NULL);
+    markStartupPhase("screen", false);
+}
+
+bool initializeHeadlessScreen(Snek * game, int columns, int rows) {
+    snek = game;
+    setlocale(LC_CTYPE, "");
+    headless_output = fopen("/dev/null", "w");
+    if (headless_output == NULL)
+        return false;
+    const char * terminal = getenv("TERM");
+    headless_screen = newterm(terminal != NULL ? terminal : "xterm", headless_output, stdin);
+    if (headless_screen == NULL) {
+        fclose(headless_output);
+        headless_output = NULL;
+        return false;
+    }
+    window = stdscr;
+    resizeterm(rows, columns);
+    noecho();
+    curs_set(0);
+    game->game_size = (Point){getmaxx(window), getmaxy(window)};
+    return true;
+}
+
+static void initializeColors() {
+    if (colors_initialized)
+        return;
+    colors_initialized = true;
     start_color();
     init_pair(WHITE_BLACK, COLOR_WHITE, COLOR_BLACK);
     init_pair(RED_BLACK, COLOR_RED, COLOR_BLACK);
     init_pair(GREEN_BLACK, COLOR_GREEN, COLOR_BLACK);
     init_pair(BLACK_BLACK, COLOR_BLACK, COLOR_BLACK);
     init_pair(BLACK_WHITE, COLOR_BLACK, COLOR_WHITE);
-    static struct sigaction signal_handler;
-    memset(&signal_handler, 0, sizeof(struct sigaction));
-    signal_handler.sa_handler = signalEventHandler;
-    sigaction(SIGWINCH, &signal_handler, NULL);
+    init_pair(CYAN_BLACK, COLOR_CYAN, COLOR_BLACK);
+    init_pair(YELLOW_BLACK, COLOR_YELLOW, COLOR_BLACK);
+    markStartupPhase("colors", false);
 }
 
 static void signalEventHandler(int signal) {
-    switch (signal) {
-        case SIGWINCH:
-            endwin();
-            printf("Game aborted due to terminal resize\n");
-            endGame(snek);
-            exit(-1);
-            break;
-        case SIGUSR1:
-            endwin();
-            printf("Terminal size too small, aborting\n");
-            endGame(snek);
-            exit(-1);
-            break;
-        default:
-            break;
+    if (signal == SIGWINCH) {
+        // A single store into the mapped recording
+        markFlightEnd(FLIGHT_RESIZED);
+        resized = 1;
     }
 }
 
+static void checkResize() {
+    if (resized)
+        abortGame("Game aborted due to terminal resize\n");
+}
+
+static void abortGame(const char * message) {
+    endwin();
+    printf("%s", message);
+    endGame(snek);
+    exit(-1);
+}
+
 void closeScreen() {
     flushinp();
     endwin();
+    if (headless_screen != NULL) {
+        delscreen(headless_screen);
+        fclose(headless_output);
+        headless_screen = NULL;
+        headless_output = NULL;
+    }
+    colors_initialized = false;
 }
 
 void drawGame() {
+    TRACE_BEGIN("drawGame");
+    initializeColors();
     erase();
     drawFrame();
     drawFood();
     drawSnake(false);
+    startFrameMetrics();
     refresh();
+    finishFrameMetrics();
+    TRACE_END("drawGame");
 }
 
 int readCharacter(long timeout_ms) {
+    TRACE_BEGIN("readCharacter");
     timeout(timeout_ms);
     int key = wgetch(window);
-    if (key == ERR)
-        return -1;
-    flushinp();
-    return key;
+    if (key != ERR)
+        flushinp();
+    TRACE_END("readCharacter");
+    checkResize();
+    return key == ERR ? -1 : key;
+}
+
+int readPlayerDirection(long timeout_ms, Direction * direction) {
+    timeout(timeout_ms);
+    int key = wgetch(window);
+    checkResize();
+    switch (key) {
+        case 'w':
+            *direction = UP;
+            return 0;
+        case 'a':
+            *direction = LEFT;
+            return 0;
+        case 's':
+            *direction = DOWN;
+            return 0;
+        case 'd':
+            *direction = RIGHT;
+            return 0;
+        case KEY_UP:
+            *direction = UP;
+            return 1;
+        case KEY_LEFT:
+            *direction = LEFT;
+            return 1;
+        case KEY_DOWN:
+            *direction = DOWN;
+            return 1;
+        case KEY_RIGHT:
+            *direction = RIGHT;
+            return 1;
+        default:
+            return -1;
+    }
 }
 
 void print_error(const char * error) {
@@ -148,6 +280,7 @@ void print_error(const char * error) {
 
 void drawGameOver() {
     char game_over[] = "GAME OVER";
+    initializeColors();
     attron(A_BOLD);
     for (int i = 0; i < 10; i++) {
         drawSnake(i % 2 == 0);
@@ -164,11 +297,20 @@ void drawGameOver() {
 static void drawFrame() {
     attron(COLOR_PAIR(WHITE_BLACK));
     char status[50];
-    sprintf(status, "SCORE%6d        HIGHSCORE%6d", snek->score, snek->highscore);
+    if (snek->highscore >= 0)
+        sprintf(status, "SCORE%6d        HIGHSCORE%6d", snek->score, snek->highscore);
+    else // Scores are still being loaded in the background
+        sprintf(status, "SCORE%6d        HIGHSCORE%6s", snek->score, "-");
     wmove(window, 0, 0);
     printw(snek->player_name);
     wmove(window, 0, (int) (getmaxx(window) / 2 - strlen(status) / 2));
     printw(status);
+    drawBorder();
+    attroff(COLOR_PAIR(WHITE_BLACK));
+}
+
+static void drawBorder() {
+    attron(COLOR_PAIR(WHITE_BLACK));
     for (int i = 0; i < getmaxx(window); i++) {
         mvaddstr(1, i, "▒");
         mvaddstr(getmaxy(window) - 1, i, "▒");
@@ -197,20 +339,102 @@ static void drawSnake(bool ghost) {
     attroff(COLOR_PAIR(GREEN_BLACK));
 }
 
+void drawArena(const Arena * arena, size_t players) {
+    TRACE_BEGIN("drawArena");
+    initializeColors();
+    erase();
+    int column = 0;
+    for (size_t i = 0; i < players; i++) {
+        attron(COLOR_PAIR(player_colors[i]) | (arena->snakes[i].alive ? A_BOLD : A_DIM));
+        mvprintw(0, column, "PLAYER %zu%6d", i + 1, arena->snakes[i].score);
+        attroff(COLOR_PAIR(player_colors[i]) | (arena->snakes[i].alive ? A_BOLD : A_DIM));
+        column += 18;
+    }
+    attron(COLOR_PAIR(WHITE_BLACK));
+    mvprintw(0, column, "SNAKES%5zu/%zu", arena->alive, arena->snake_count);
+    attroff(COLOR_PAIR(WHITE_BLACK));
+    drawBorder();
+    // The board is read row by row, the snakes are not walked one by one
+    for (int y = 2; y < arena->size.y - 1; y++) {
+        const uint16_t * row = &arena->cells[(size_t) y * arena->size.x];
+        for (int x = 1; x < arena->size.x - 1; x++) {
+            if (row[x] == ARENA_EMPTY)
+                continue;
+            if (row[x] == ARENA_FOOD) {
+                attron(COLOR_PAIR(RED_BLACK));
+                mvaddstr(y, x, "●");
+                attroff(COLOR_PAIR(RED_BLACK));
+                continue;
+            }
+            size_t index = row[x] - 1u;
+            enum TEXT_FORMATS color = index < players ? player_colors[index] : YELLOW_BLACK;
+            attron(COLOR_PAIR(color));
+            mvaddstr(y, x, "▓");
+            attroff(COLOR_PAIR(color));
+        }
+    }
+    startFrameMetrics();
+    refresh();
+    finishFrameMetrics();
+    TRACE_END("drawArena");
+}
+
+void drawArenaOver(const Arena * arena, size_t players) {
+    char game_over[] = "GAME OVER";
+    drawArena(arena, players);
+    attron(A_BOLD | COLOR_PAIR(RED_BLACK));
+    mvaddstr((int) (getmaxy(window) / 2), (int) (getmaxx(window) / 2 - strlen(game_over) / 2), game_over);
+    attroff(A_BOLD | COLOR_PAIR(RED_BLACK));
+    mvprintw(getmaxy(window) - 1, 0, "Press any key to continue");
+    refresh();
+    flushinp();
+}
+
 void getNickname(char ** username) {
     const int nick_max_size = NICK_MAX_LENGTH;
     int columns = getmaxx(window);
     echo();
     *username = malloc((nick_max_size + 1) * sizeof(char));
+    if (*username == NULL)
+        return;
     mvaddstr(getmaxy(window) / 2, columns / 2 - (columns > 30 ? 8 : columns / 4), "Nickname?  ");
     keypad(window, false);
-    getnstr(*username, nick_max_size);
+    // Interrupted by a resize, nothing may have been read
+    if (getnstr(*username, nick_max_size) == ERR)
+        (*username)[0] = '\0';
+    checkResize();
     if (strlen(*username) < 1)
         strcpy(*username, "anonymous");
     noecho();
     keypad(window, true);
 }
 
+int getLeaderboardPageSize() {
+    // Two rows for the title, one for the controls
+    return getmaxy(window) - 3;
+}
+
+void drawLeaderboardPage(Nick_Score * entries, size_t first_rank, int size, size_t players, size_t highlight) {
+    erase();
+    int centerx = getmaxx(window) / 2 - 20 / 2;
+    if (size > 0)
+        mvprintw(0, centerx, "RANKS %zu-%zu OF %zu", first_rank, first_rank + size - 1, players);
+    else
+        mvprintw(0, centerx, "NO PLAYERS YET");
+    mvprintw(1, centerx, "────────────────────");
+    for (int i = 0; i < size; i++) {
+        size_t nicklen = strlenUTF8(entries[i].nick);
+        bool own = first_rank + i == highlight;
+        if (own)
+            attron(A_BOLD);
+        mvprintw(2 + i, centerx - 7, "%6zu %s%*d", first_rank + i, entries[i].nick, (int) (20 - nicklen), entries[i].score);
+        if (own)
+            attroff(A_BOLD);
+    }
+    mvprintw(getmaxy(window) - 1, 0, "w/s: scroll, q: quit");
+    refresh();
+}
+
 bool drawQuestionDialog(char * question, char * optTrue, char * optFalse) {
     erase();
     size_t question_length = strlenUTF8(question);
@@ -218,6 +442,7 @@ bool drawQuestionDialog(char * question, char * optTrue, char * optFalse) {
     size_t opt_false_length = strlenUTF8(optFalse);
     int centerx = getmaxx(window) / 2;
     int centery = getmaxy(window) / 2 - 4 / 2;
+    initializeColors();
     attron(A_BOLD);
     mvprintw(centery, centerx - question_length / 2, question);
     attroff(A_BOLD);
@@ -233,6 +458,7 @@ bool drawQuestionDialog(char * question, char * optTrue, char * optFalse) {
         attron(selection % 2 == 1 ? COLOR_PAIR(BLACK_WHITE) : COLOR_PAIR(WHITE_BLACK));
         mvprintw(centery + 3, centerx - opt_false_length / 2, optFalse);
         attroff(selection % 2 == 1 ? COLOR_PAIR(BLACK_WHITE) : COLOR_PAIR(WHITE_BLACK));
+        checkResize();
     } while ((c = getch()) != '\n'); // Until the user presses enter
     return selection % 2 == 0;
 }
@@ -260,7 +486,7 @@ size_t strlenUTF8(char * str) {
     return count;
 }
 
-void drawToplist(Nick_Score * toplist, int size) {
+int drawToplist(Nick_Score * toplist, int size) {
     erase();
     int centerx = getmaxx(window) / 2 - 20 / 2;
     int centery = getmaxy(window) / 2 - size / 2;
@@ -274,10 +500,33 @@ void drawToplist(Nick_Score * toplist, int size) {
             break;
         if (i < 3)
             attron(A_BOLD);
-        mvprintw(centery++, centerx, "%s%*d", toplist[i].nick, 20 - nicklen,toplist[i].score);
+        mvprintw(centery++, centerx, "%s%*d", toplist[i].nick, (int) (20 - nicklen), toplist[i].score);
         if (i < 3)
             attroff(A_BOLD);
     }
-    mvprintw(getmaxy(window) - 1, 0, "Press any key to quit");
+    mvprintw(getmaxy(window) - 1, 0, "s: all players, other keys: quit");
+    refresh();
+    return centery;
+}
+
+void drawPlayerRank(int row, size_t rank, size_t players, double percentile, Nick_Score * neighbours, size_t first_rank, int size) {
+    if (rank == 0)
+        return;
+    int centerx = getmaxx(window) / 2 - 20 / 2;
+    // Keep the last row free for the "Press any key" message
+    int last_row = getmaxy(window) - 2;
+    if (++row > last_row)
+        return;
+    mvprintw(row++, centerx, "RANK %zu/%zu (TOP %.1f%%)", rank, players, percentile);
+    for (int i = 0; i < size && row <= last_row; i++) {
+        size_t nicklen = strlenUTF8(neighbours[i].nick);
+        bool own = first_rank + i == rank;
+        if (own)
+            attron(A_BOLD);
+        // Ranks are printed in the margin, so names line up with the toplist
+        mvprintw(row++, centerx - 7, "%6zu %s%*d", first_rank + i, neighbours[i].nick, (int) (20 - nicklen), neighbours[i].score);
+        if (own)
+            attroff(A_BOLD);
+    }
     refresh();
 }
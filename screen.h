@@ -6,6 +6,7 @@
 #define SNEK_SCREEN_H
 
 #include "snek.h"
+#include "arena.h"
 
 /**
  * @brief Draws the current state of the game on the terminal
@@ -22,6 +23,17 @@ void drawGame();
  */
 void initializeScreen(Snek * snek);
 
+/**
+ * Used by the benchmarks: the frames are drawn as on a terminal of the given size,
+ * but written to \p /dev/null. No input can be read and no signals are handled.
+ * @brief Prepares a screen without a terminal
+ * @param game hold all important game parameters
+ * @param columns width of the screen
+ * @param rows height of the screen
+ * @return \p true on success, \p false if the terminal type of \p TERM is unknown
+ */
+bool initializeHeadlessScreen(Snek * game, int columns, int rows);
+
 /**
  * @brief Closes ncurses sessions, flushes characters in input queue
  */
@@ -34,6 +46,17 @@ void closeScreen();
  */
 int readCharacter(long);
 
+/**
+ * The first player controls with the letters (w, a, s, d), the second one with the arrows.
+ * Unlike \p readCharacter, the keys pressed meanwhile are kept,
+ * so the keys of two players pressed at the same time are not lost.
+ * @brief Reads a control key of the multi-snake game in a non-blocking way
+ * @param timeout_ms milliseconds to wait before returning if no key has been pressed
+ * @param direction set to the direction of the key
+ * @return index of the player the key belongs to, -1 if no control key was pressed
+ */
+int readPlayerDirection(long, Direction *);
+
 /**
  * @brief Prints an error message to the standard error output
  * @param error string to print
@@ -45,12 +68,43 @@ void print_error(const char *);
  */
 void drawGameOver();
 
+/**
+ * The first snakes are the players, drawn in their own colors, the rest are the bots.
+ * @brief Draws the current state of the multi-snake game on the terminal
+ * @param arena the arena, the size of the screen
+ * @param players number of snakes played from the keyboard
+ */
+void drawArena(const Arena * arena, size_t players);
+
+/**
+ * The keys pressed while the last snakes were dying are dropped, so they do not skip it.
+ * @brief Draws the game-over screen of the multi-snake game
+ * @param arena the arena
+ * @param players number of snakes played from the keyboard
+ */
+void drawArenaOver(const Arena * arena, size_t players);
+
 /**
  * @brief Draws the toplist on the screen
  * @param toplist list containing nickname-score pairs (in \p Nick_Score structures)
  * @param size size of the \p toplist
+ * @return first row below the toplist
+ */
+int drawToplist(Nick_Score * toplist, int size);
+
+/**
+ * Draws the rank of the player and the players ranked around them,
+ * below the toplist. Rows that do not fit on the screen are skipped.
+ * @brief Draws the rank of the player and their neighbours
+ * @param row first row to draw to
+ * @param rank rank of the player starting from 1, 0 if the player is not ranked
+ * @param players number of ranked players
+ * @param percentile percentage of players ranked at or above the player
+ * @param neighbours players ranked around the player (in \p Nick_Score structures)
+ * @param first_rank rank of the first item of \p neighbours
+ * @param size size of \p neighbours
  */
-void drawToplist(Nick_Score * toplist, int size);
+void drawPlayerRank(int row, size_t rank, size_t players, double percentile, Nick_Score * neighbours, size_t first_rank, int size);
 
 /**
  * @brief Asks the user for their nickname
@@ -65,6 +119,23 @@ void getNickname(char ** username);
  */
 size_t strlenUTF8(char * string);
 
+/**
+ * @brief Returns how many players fit on a page of the leaderboard view
+ * @return number of rows available for players
+ */
+int getLeaderboardPageSize();
+
+/**
+ * Draws one page of the scrollable leaderboard, with the ranks in the margin.
+ * @brief Draws a page of the leaderboard on the screen
+ * @param entries players on the page (in \p Nick_Score structures)
+ * @param first_rank rank of the first item of \p entries
+ * @param size size of \p entries, at most \p getLeaderboardPageSize()
+ * @param players number of ranked players
+ * @param highlight rank to draw in bold, 0 for none
+ */
+void drawLeaderboardPage(Nick_Score * entries, size_t first_rank, int size, size_t players, size_t highlight);
+
 /**
  * @brief Draws a yes/no style question dialog on the screen
  * @param question String to draw as the question
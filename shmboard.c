@@ -0,0 +1,427 @@
+/**
+ * The shared leaderboard is a memory mapped file used by every instance on the host.
+ * The per-player table is updated lock-free: slots are claimed and best scores are raised
+ * with compare-and-swap. The toplist is protected by a seqlock, writers take it by
+ * moving the sequence number from even to odd with compare-and-swap, readers retry
+ * their copy if the sequence number was odd or has changed in the meantime.
+ * The segment, the seqlock and every slot being claimed hold the pid of their owner,
+ * so a process that dies while holding any of them is detected and taken over.
+ * \file shmboard.c
+ * \author hexadec
+ * \brief This file contains the shared-memory leaderboard
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmboard.h"
+#include "allocator.h"
+
+/** @brief Identifies a snek leaderboard segment ("SNEK") */
+#define SHARED_BOARD_MAGIC 0x4B454E53u
+
+/** @brief Layout version, segments of a different version are ignored */
+#define SHARED_BOARD_VERSION 2u
+
+/** @brief Number of slots in the player table (power of two) */
+#define SHARED_PLAYER_CAPACITY 65536u
+
+/** @brief Number of attempts before giving up on a busy seqlock or slot held by a living writer */
+#define SHARED_MAX_ATTEMPTS 100000
+
+/** @brief Number of attempts of the lookups made by the interface, which must not stall the game */
+#define SHARED_READ_ATTEMPTS 100
+
+/**
+ * @brief States of the segment and of its player slots
+ */
+enum SharedState {
+    /** @brief Unused slot, or segment being created */
+    SHARED_EMPTY = 0,
+    /** @brief Segment being rebuilt by its creator */
+    SHARED_BUSY = 1,
+    /** @brief Slot (or segment) ready to be used */
+    SHARED_READY = 2
+};
+
+/**
+ * @brief Results of \p awaitSlot
+ */
+enum SlotStatus {
+    /** @brief The slot has never been claimed */
+    SLOT_UNUSED,
+    /** @brief The slot has been claimed for the player */
+    SLOT_CLAIMED,
+    /** @brief The slot holds a player */
+    SLOT_READY,
+    /** @brief The slot is still being claimed, or has been abandoned by a dead process */
+    SLOT_STUCK
+};
+
+/**
+ * @brief Score entry of the shared toplist
+ */
+typedef struct {
+    /** @brief Player name, empty for unused entries */
+    char nick[NICK_MAX_LENGTH + 1];
+    /** @brief Score of the entry */
+    int32_t score;
+} SharedEntry;
+
+/**
+ * @brief Slot of the shared player table
+ */
+typedef struct {
+    /** @brief One of \p SharedState */
+    uint32_t state;
+    /** @brief Best score of the player, only ever raised */
+    int32_t best;
+    /** @brief Pid of the process that claimed the slot, 0 if unused */
+    int32_t owner;
+    /** @brief Player name, written before the slot becomes \p SHARED_READY */
+    char nick[NICK_MAX_LENGTH + 1];
+} SharedPlayer;
+
+/**
+ * @brief Layout of the shared segment
+ */
+typedef struct {
+    /** @brief \p SHARED_BOARD_MAGIC */
+    uint32_t magic;
+    /** @brief \p SHARED_BOARD_VERSION */
+    uint32_t version;
+    /** @brief \p SHARED_READY once the segment has been rebuilt from the scores file */
+    uint32_t state;
+    /** @brief Seqlock of the toplist, odd while a writer is modifying it */
+    uint32_t sequence;
+    /** @brief Pid of the process rebuilding the segment, 0 before it is claimed */
+    int32_t creator;
+    /** @brief Pid of the process holding the seqlock, 0 if none */
+    int32_t writer;
+    /** @brief Toplist in descending order by score */
+    SharedEntry toplist[TOPLIST_SIZE];
+    /** @brief Open addressing hash table of the best score of every player */
+    SharedPlayer players[SHARED_PLAYER_CAPACITY];
+} SharedBoard;
+
+/**
+ * @brief Copies a name into a fixed size field, truncating it if necessary
+ * @param destination field of \p NICK_MAX_LENGTH + 1 characters
+ * @param name name to copy
+ */
+static void copyNick(char * destination, const char * name);
+
+/**
+ * @brief Finds the slot of a player, optionally claiming an empty slot for it
+ * @param nick player name, already truncated
+ * @param claim claim an empty slot if the player is not found
+ * @return the slot of the player, \p NULL if not found (or the table is full)
+ */
+static SharedPlayer * findPlayer(const char * nick, bool claim);
+
+/**
+ * A slot that is unused, or abandoned by a process that died while claiming it,
+ * is claimed for the player, otherwise the claim of its owner is waited for.
+ * @brief Waits until a slot becomes ready, or claims it
+ * @param slot slot to wait for
+ * @param nick player name to claim the slot for, \p NULL to only wait
+ * @param attempts number of attempts before giving up on the slot
+ * @return one of \p SlotStatus
+ */
+static int awaitSlot(SharedPlayer * slot, const char * nick, int attempts);
+
+/**
+ * @brief Checks if the process holding a lock has exited
+ * @param pid pid stored with the lock, 0 if it is not held
+ * @return \p true if the process does not exist anymore
+ */
+static bool isProcessGone(int32_t pid);
+
+/**
+ * A writer that died while holding the seqlock is taken over, and the toplist
+ * it may have left half modified is repaired.
+ * @brief Takes the seqlock of the toplist as its writer
+ * @param attempts number of attempts before giving up on a living writer
+ * @return \p true if the lock has been taken
+ */
+static bool lockToplist(int attempts);
+
+/**
+ * @brief Releases the seqlock of the toplist
+ */
+static void unlockToplist();
+
+/**
+ * The order of the scores of the toplist is lost, so it is rebuilt from the
+ * best score of every player, must be called by the seqlock writer.
+ * @brief Rebuilds the toplist left half modified by a dead writer
+ */
+static void repairToplist();
+
+/**
+ * @brief Inserts a score into the shared toplist, must be called by the seqlock writer
+ * @param nick player name, already truncated
+ * @param score score to insert
+ */
+static void insertIntoToplist(const char * nick, int score);
+
+/**
+ * @brief Fills a freshly created segment from the loaded scores
+ * @param scores scores read from the scores file
+ */
+static void rebuildSharedBoard(const ScoreCache * scores);
+
+/** @brief Mapping of the shared segment, \p NULL if not open */
+static SharedBoard * board = NULL;
+
+bool openSharedBoard(const char * path, const ScoreCache * scores) {
+    if (board != NULL)
+        return true;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+    // A segment another user can write to is not trusted
+    struct stat info;
+    bool usable = fstat(fd, &info) == 0 && info.st_uid == geteuid() && (info.st_mode & 0077) == 0;
+    // A new file is resized by whoever gets to it first, in case its creator has died before
+    if (usable && info.st_size == 0)
+        usable = ftruncate(fd, sizeof(SharedBoard)) == 0;
+    else if (usable)
+        usable = info.st_size == (off_t) sizeof(SharedBoard);
+    void * mapping = usable ? mmap(NULL, sizeof(SharedBoard), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    board = mapping;
+    if (__atomic_load_n(&board->state, __ATOMIC_ACQUIRE) == SHARED_READY) {
+        if (board->magic == SHARED_BOARD_MAGIC && board->version == SHARED_BOARD_VERSION)
+            return true;
+        // Written by an incompatible version
+        closeSharedBoard();
+        return false;
+    }
+    // The segment is new, or its creator has died while rebuilding it
+    int32_t creator = __atomic_load_n(&board->creator, __ATOMIC_ACQUIRE);
+    if ((creator != 0 && !isProcessGone(creator))
+        || !__atomic_compare_exchange_n(&board->creator, &creator, (int32_t) getpid(), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // Still being rebuilt by its creator
+        closeSharedBoard();
+        return false;
+    }
+    if (creator != 0) {
+        board->sequence = 0;
+        board->writer = 0;
+        memset(board->toplist, 0, sizeof(board->toplist));
+        memset(board->players, 0, sizeof(board->players));
+    }
+    board->magic = SHARED_BOARD_MAGIC;
+    board->version = SHARED_BOARD_VERSION;
+    __atomic_store_n(&board->state, SHARED_BUSY, __ATOMIC_RELEASE);
+    rebuildSharedBoard(scores);
+    __atomic_store_n(&board->state, SHARED_READY, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool isSharedBoardOpen() {
+    return board != NULL;
+}
+
+static void rebuildSharedBoard(const ScoreCache * scores) {
+    // The names of the cache are already truncated to NICK_MAX_LENGTH
+    for (size_t player = 0; player < scores->player_count; player++) {
+        int best = scores->best[player];
+        SharedPlayer * slot = best != SCORE_ABSENT ? findPlayer(getNick(scores->nicks, (PlayerId) player), true) : NULL;
+        if (slot != NULL)
+            __atomic_store_n(&slot->best, best, __ATOMIC_RELAXED);
+    }
+    if (!lockToplist(SHARED_MAX_ATTEMPTS))
+        return;
+    for (int i = 0; i < scores->toplist_size && i < TOPLIST_SIZE; i++) {
+        if (scores->toplist[i].nick != NULL)
+            insertIntoToplist(scores->toplist[i].nick, scores->toplist[i].score);
+    }
+    unlockToplist();
+}
+
+static void copyNick(char * destination, const char * name) {
+    size_t length = strlen(name);
+    if (length > NICK_MAX_LENGTH)
+        length = NICK_MAX_LENGTH;
+    memcpy(destination, name, length);
+    destination[length] = '\0';
+}
+
+static bool isProcessGone(int32_t pid) {
+    return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+static int awaitSlot(SharedPlayer * slot, const char * nick, int attempts) {
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == SHARED_READY)
+            return SLOT_READY;
+        int32_t owner = __atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE);
+        if (owner == 0 || isProcessGone(owner)) {
+            // Lookups skip an abandoned slot, the player may have been added after it
+            if (nick == NULL)
+                return owner == 0 ? SLOT_UNUSED : SLOT_STUCK;
+            if (__atomic_compare_exchange_n(&slot->owner, &owner, (int32_t) getpid(), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                strcpy(slot->nick, nick);
+                __atomic_store_n(&slot->best, INT32_MIN, __ATOMIC_RELAXED);
+                __atomic_store_n(&slot->state, SHARED_READY, __ATOMIC_RELEASE);
+                return SLOT_CLAIMED;
+            }
+            // Another process claimed it first, it may be claiming it for the same player
+            continue;
+        }
+        sched_yield();
+    }
+    return SLOT_STUCK;
+}
+
+static SharedPlayer * findPlayer(const char * nick, bool claim) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char * c = nick; *c != '\0'; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 16777619u;
+    }
+    for (uint32_t probe = 0; probe < SHARED_PLAYER_CAPACITY; probe++) {
+        SharedPlayer * slot = &board->players[(hash + probe) & (SHARED_PLAYER_CAPACITY - 1)];
+        int status = awaitSlot(slot, claim ? nick : NULL, claim ? SHARED_MAX_ATTEMPTS : SHARED_READ_ATTEMPTS);
+        if (status == SLOT_UNUSED)
+            return NULL;
+        if (status == SLOT_CLAIMED)
+            return slot;
+        // The slot may not be terminated if it was written by a misbehaving process
+        if (status == SLOT_READY && strncmp(slot->nick, nick, sizeof(slot->nick)) == 0)
+            return slot;
+    }
+    return NULL;
+}
+
+static bool lockToplist(int attempts) {
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        int32_t writer = __atomic_load_n(&board->writer, __ATOMIC_RELAXED);
+        if ((writer == 0 || isProcessGone(writer))
+            && __atomic_compare_exchange_n(&board->writer, &writer, (int32_t) getpid(), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            uint32_t sequence = __atomic_load_n(&board->sequence, __ATOMIC_RELAXED);
+            if (sequence % 2 != 0) {
+                // The previous writer died in the middle of a modification, the sequence stays odd
+                repairToplist();
+            } else {
+                __atomic_store_n(&board->sequence, sequence + 1, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+            }
+            return true;
+        }
+        sched_yield();
+    }
+    return false;
+}
+
+static void unlockToplist() {
+    __atomic_store_n(&board->sequence, __atomic_load_n(&board->sequence, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&board->writer, 0, __ATOMIC_RELEASE);
+}
+
+static void repairToplist() {
+    memset(board->toplist, 0, sizeof(board->toplist));
+    char nick[NICK_MAX_LENGTH + 1];
+    for (uint32_t i = 0; i < SHARED_PLAYER_CAPACITY; i++) {
+        SharedPlayer * slot = &board->players[i];
+        int32_t best = __atomic_load_n(&slot->best, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SHARED_READY || best == INT32_MIN)
+            continue;
+        memcpy(nick, slot->nick, NICK_MAX_LENGTH);
+        nick[NICK_MAX_LENGTH] = '\0';
+        insertIntoToplist(nick, best);
+    }
+}
+
+bool publishSharedScore(const char * name, int score) {
+    if (board == NULL)
+        return false;
+    char nick[NICK_MAX_LENGTH + 1];
+    copyNick(nick, name);
+
+    SharedPlayer * player = findPlayer(nick, true);
+    if (player != NULL) {
+        int32_t best = __atomic_load_n(&player->best, __ATOMIC_RELAXED);
+        while (best < score && !__atomic_compare_exchange_n(&player->best, &best, score, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+    if (!lockToplist(SHARED_MAX_ATTEMPTS))
+        return false;
+    insertIntoToplist(nick, score);
+    unlockToplist();
+    return player != NULL;
+}
+
+static void insertIntoToplist(const char * nick, int score) {
+    SharedEntry * toplist = board->toplist;
+    int last = TOPLIST_SIZE - 1;
+    if (toplist[last].nick[0] != '\0' && toplist[last].score > score)
+        return;
+    int position = 0;
+    while (position < last && toplist[position].nick[0] != '\0' && toplist[position].score > score)
+        position++;
+    memmove(&toplist[position + 1], &toplist[position], (last - position) * sizeof(SharedEntry));
+    strcpy(toplist[position].nick, nick);
+    toplist[position].score = score;
+}
+
+bool getSharedHighscore(const char * name, int * highscore) {
+    if (board == NULL)
+        return false;
+    char nick[NICK_MAX_LENGTH + 1];
+    copyNick(nick, name);
+    SharedPlayer * player = findPlayer(nick, false);
+    *highscore = player != NULL ? __atomic_load_n(&player->best, __ATOMIC_RELAXED) : 0;
+    if (*highscore < 0)
+        *highscore = 0;
+    return true;
+}
+
+bool readSharedToplist(SharedToplist * snapshot) {
+    if (board == NULL)
+        return false;
+    SharedEntry toplist[TOPLIST_SIZE];
+    for (int attempt = 0; attempt < SHARED_READ_ATTEMPTS; attempt++) {
+        uint32_t before = __atomic_load_n(&board->sequence, __ATOMIC_ACQUIRE);
+        if (before % 2 != 0) {
+            // A writer that died while holding the seqlock leaves it odd until someone repairs the toplist
+            if (isProcessGone(__atomic_load_n(&board->writer, __ATOMIC_RELAXED)) && lockToplist(1))
+                unlockToplist();
+            else
+                sched_yield();
+            continue;
+        }
+        memcpy(toplist, board->toplist, sizeof(toplist));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&board->sequence, __ATOMIC_RELAXED) != before)
+            continue;
+        snapshot->version = before;
+        for (int i = 0; i < TOPLIST_SIZE; i++) {
+            // Terminate defensively, the copy may come from a misbehaving writer
+            toplist[i].nick[NICK_MAX_LENGTH] = '\0';
+            strcpy(snapshot->nicks[i], toplist[i].nick);
+            snapshot->toplist[i].nick = toplist[i].nick[0] != '\0' ? snapshot->nicks[i] : NULL;
+            snapshot->toplist[i].score = toplist[i].score;
+            snapshot->toplist[i].player = PLAYER_NONE;
+        }
+        return true;
+    }
+    return false;
+}
+
+void closeSharedBoard() {
+    if (board != NULL)
+        munmap(board, sizeof(SharedBoard));
+    board = NULL;
+}
@@ -0,0 +1,78 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_SHMBOARD_H
+#define SNEK_SHMBOARD_H
+
+#include "snek.h"
+#include "scorecache.h"
+
+/** @brief Default location of the shared leaderboard segment, followed by the user id */
+#define SHARED_BOARD_DEFAULT_PATH "/dev/shm/snek-leaderboard"
+
+/**
+ * @brief Consistent copy of the toplist held in the shared leaderboard
+ */
+typedef struct SharedToplist {
+    /** @brief Version of the toplist, changes whenever the toplist is modified */
+    unsigned version;
+    /** @brief Storage of the names pointed to by \p toplist */
+    char nicks[TOPLIST_SIZE][NICK_MAX_LENGTH + 1];
+    /** @brief Toplist in descending order by score, unused items have a \p NULL nick */
+    Nick_Score toplist[TOPLIST_SIZE];
+} SharedToplist;
+
+/**
+ * Maps the shared leaderboard segment, a file (normally under /dev/shm) that holds
+ * the toplist and the best score of every player for all instances running on the host.
+ * If the segment does not exist yet, or its creator died before finishing it,
+ * it is created and rebuilt from the scores already loaded from the scores file.
+ * The segment is private to the user, a segment owned by or writable for others is refused.
+ * @brief Opens the shared leaderboard
+ * @param path path of the segment
+ * @param scores loaded scores to rebuild a new segment from
+ * @return \p true if the leaderboard is available, \p false otherwise
+ */
+bool openSharedBoard(const char * path, const ScoreCache * scores);
+
+/**
+ * @brief Checks if the shared leaderboard has been opened successfully
+ * @return \p true if the shared leaderboard is available
+ */
+bool isSharedBoardOpen();
+
+/**
+ * Records a score in the shared leaderboard. The best score of the player is raised
+ * with compare-and-swap, the toplist is modified as the writer of its seqlock.
+ * @brief Adds a score to the shared leaderboard
+ * @param name player name, truncated to \p NICK_MAX_LENGTH characters
+ * @param score score to add
+ * @return \p true on success, \p false if the leaderboard is unavailable or busy
+ */
+bool publishSharedScore(const char * name, int score);
+
+/**
+ * @brief Looks up the highscore of a player in the shared leaderboard
+ * @param name player name
+ * @param highscore set to the highscore of the player, 0 if not found
+ * @return \p true on success, \p false if the leaderboard is unavailable
+ */
+bool getSharedHighscore(const char * name, int * highscore);
+
+/**
+ * Copies the toplist out of the shared leaderboard. The copy is retried a few times
+ * until no writer has modified the toplist while it was being read, a writer that
+ * died in the middle of a modification is taken over and the toplist is repaired.
+ * @brief Reads a consistent snapshot of the shared toplist
+ * @param snapshot structure to fill
+ * @return \p true on success, \p false if the leaderboard is unavailable or a writer is stuck
+ */
+bool readSharedToplist(SharedToplist * snapshot);
+
+/**
+ * @brief Unmaps the shared leaderboard, safe to call if it has not been opened
+ */
+void closeSharedBoard();
+
+#endif //SNEK_SHMBOARD_H
@@ -0,0 +1,419 @@
+/**
+ * Headless simulation of many games, played by a bot without a terminal.
+ * Every finished game is saved like in the real game, and the score cache is
+ * refreshed and queried as the end screen does, so the workload covers the game
+ * rules, the containers and the score I/O. It is the training workload of the
+ * profile guided optimisation build, and useful to profile the game on its own.
+ * The scores are written into a temporary directory, which is removed at exit.
+ * With \p --arena many bots play at the same time on a shared board instead,
+ * and the dead ones are put back, to measure the steps of a crowded arena.
+ * \file sim.c
+ * \author hexadec
+ * \brief This file contains the headless game simulation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "snek.h"
+#include "game.h"
+#include "arena.h"
+#include "fileio.h"
+#include "scorecache.h"
+#include "perfcounters.h"
+#include "metrics.h"
+#include "allocator.h"
+
+/** @brief Default number of simulated games */
+#define SIM_GAMES 200
+
+/** @brief Default size of the game area, a common terminal size */
+#define SIM_COLUMNS 80
+/** @brief Default size of the game area, a common terminal size */
+#define SIM_ROWS 24
+
+/** @brief Number of different bot players the games are saved for */
+#define SIM_PLAYERS 50
+
+/** @brief Default number of steps of an arena run */
+#define SIM_ARENA_TICKS 10000
+
+/** @brief Number of players read from the leaderboard after every game, as on the end screen */
+#define SIM_PAGE_SIZE 20
+
+/**
+ * @brief Totals of a simulation run
+ */
+typedef struct SimStats {
+    /** @brief Number of games played */
+    long games;
+    /** @brief Steps made in all games */
+    long long ticks;
+    /** @brief Sum of the scores of all games */
+    long long score_sum;
+    /** @brief Highest score of all games */
+    int best_score;
+} SimStats;
+
+/** @brief Path of the temporary directory holding the score files */
+static char work_directory[] = "/tmp/snek_sim_XXXXXX";
+
+/**
+ * Moves towards the food, along the axis with the larger distance first,
+ * and avoids the walls and the snake, if it can.
+ * @brief Chooses the direction of the next step of the bot
+ * @param snek holds all important game parameters
+ * @return the chosen direction
+ */
+static Direction chooseDirection(const Snek *);
+
+/**
+ * @brief Checks if the snake can step to a block without hitting something
+ * @param snek holds all important game parameters
+ * @param x column index
+ * @param y row index
+ * @return \p true if the block is inside the game area and not occupied by the snake
+ */
+static bool isFree(const Snek *, int, int);
+
+/**
+ * The game ends when the snake dies, or after a step limit, in case the bot
+ * goes around in circles.
+ * @brief Plays a game with the bot and saves its score
+ * @param game_size size of the game area
+ * @param nick name of the bot player
+ * @param stats totals to add the game to
+ * @return \p true on success, \p false if there is not enough memory or the score cannot be saved
+ */
+static bool playGame(Point, const char *, SimStats *);
+
+/**
+ * @brief Reads the new scores into the cache, and looks up the player as the end screen does
+ * @param cache score cache to refresh
+ * @param nick name of the player of the last game
+ * @return \p true on success, \p false if there is not enough memory
+ */
+static bool showResults(ScoreCache *, const char *);
+
+/**
+ * Every snake is a bot, the dead ones are put back after every step, and no score is saved.
+ * @brief Plays an arena and prints its summary
+ * @param game_size size of the board
+ * @param snakes number of snakes
+ * @param foods number of food on the board
+ * @param ticks number of steps
+ * @param perf \p true to count hardware events
+ * @return 0 on success, -3 if there is not enough memory
+ */
+static int runArena(Point, long, long, long, bool);
+
+/**
+ * @brief Removes the score files and the temporary directory
+ * @param original working directory to return to
+ */
+static void removeWorkDirectory(const char *);
+
+/**
+ * @brief Prints the usage of the program
+ * @param program name of the executable
+ */
+static void printUsage(const char *);
+
+/**
+ * @brief Prints the hardware event counts of the whole run, and per step
+ * @param counts counts read after the games
+ * @param ticks number of steps in all games
+ */
+static void printPerfCounts(const PerfCounts *, long long);
+
+/**
+ * \p --games sets the number of games, \p --columns and \p --rows the size of the game area.
+ * \p --perf counts hardware events during the games, if the system allows it.
+ * \p --arena plays an arena of the given number of snakes for \p --ticks steps,
+ * with \p --foods food on the board, by default as many as snakes.
+ * The metrics are exported like in the game, if SNEK_METRICS is set.
+ * A summary of the games is printed when they are over.
+ * @brief Entry point of the simulation
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @return 0 on success, 1 on wrong arguments, -3 if there is not enough memory
+ */
+int main(int argc, char ** argv) {
+    long games = SIM_GAMES;
+    Point game_size = {SIM_COLUMNS, SIM_ROWS};
+    bool perf = false;
+    long snakes = 0;
+    long foods = -1;
+    long ticks = SIM_ARENA_TICKS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+            games = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            game_size.x = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            game_size.y = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+        } else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            snakes = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--foods") == 0 && i + 1 < argc) {
+            foods = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            ticks = atol(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    // Same limits as the terminal
+    if (games < 1 || game_size.x < 35 || game_size.y < 8 || snakes < 0 || snakes > ARENA_MAX_SNAKES || ticks < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    startMetrics();
+    if (snakes > 0)
+        return runArena(game_size, snakes, foods < 0 ? snakes : foods, ticks, perf);
+    char original[4096];
+    if (getcwd(original, sizeof(original)) == NULL || mkdtemp(work_directory) == NULL || chdir(work_directory) != 0) {
+        perror("Couldn't create the working directory");
+        return -3;
+    }
+    ScoreCache * cache = createScoreCache(TOPLIST_SIZE);
+    if (cache == NULL || !loadScoreCache(cache, NULL)) {
+        freeScoreCache(cache);
+        removeWorkDirectory(original);
+        fprintf(stderr, "Couldn't allocate memory\n");
+        return -3;
+    }
+
+    PerfCounters counters;
+    if (perf && !openPerfCounters(&counters)) {
+        fprintf(stderr, "Hardware performance counters are not available, counting nothing\n");
+        perf = false;
+    }
+    PerfCounts counts;
+    struct timespec start, end;
+    if (perf)
+        startPerfCounters(&counters);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    SimStats stats = {0, 0, 0, 0};
+    bool success = true;
+    char nick[NICK_MAX_LENGTH + 1];
+    for (long i = 0; i < games && success; i++) {
+        snprintf(nick, sizeof(nick), "bot%ld", i % SIM_PLAYERS);
+        success = playGame(game_size, nick, &stats) && showResults(cache, nick);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    if (perf) {
+        stopPerfCounters(&counters, &counts);
+        closePerfCounters(&counters);
+    }
+    double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1E9;
+
+    closeScoreWriter();
+    freeScoreCache(cache);
+    removeWorkDirectory(original);
+    if (!success) {
+        fprintf(stderr, "Simulation aborted after %ld games\n", stats.games);
+        return -3;
+    }
+    printf("games: %ld\nticks: %lld\nmean score: %.1f\nbest score: %d\nseconds: %.3f\nticks per second: %.0f\n",
+           stats.games, stats.ticks, (double) stats.score_sum / (double) stats.games, stats.best_score,
+           elapsed, elapsed > 0 ? (double) stats.ticks / elapsed : 0.0);
+    if (perf)
+        printPerfCounts(&counts, stats.ticks);
+    return 0;
+}
+
+static Direction chooseDirection(const Snek * snek) {
+    LinkedList * snake = snek->snake;
+    snake->toStart(snake);
+    Point head = *(Point *) snake->node->data;
+    int dx = snek->food->x - head.x;
+    int dy = snek->food->y - head.y;
+    Direction horizontal = dx < 0 ? LEFT : RIGHT;
+    Direction vertical = dy < 0 ? UP : DOWN;
+    Direction preferred[4];
+    if (abs(dx) >= abs(dy)) {
+        preferred[0] = horizontal;
+        preferred[1] = vertical;
+    } else {
+        preferred[0] = vertical;
+        preferred[1] = horizontal;
+    }
+    // The directions away from the food, if nothing better is free
+    static const Direction opposite[] = {[UP] = DOWN, [DOWN] = UP, [LEFT] = RIGHT, [RIGHT] = LEFT};
+    preferred[2] = opposite[preferred[1]];
+    preferred[3] = opposite[preferred[0]];
+    for (int i = 0; i < 4; i++) {
+        Point next = head;
+        switch (preferred[i]) {
+            case UP:
+                next.y--;
+                break;
+            case DOWN:
+                next.y++;
+                break;
+            case LEFT:
+                next.x--;
+                break;
+            case RIGHT:
+                next.x++;
+                break;
+        }
+        if (isFree(snek, next.x, next.y))
+            return preferred[i];
+    }
+    return snek->direction;
+}
+
+static bool isFree(const Snek * snek, int x, int y) {
+    // The game area is the same as checked by isGameOver
+    if (x < 1 || y < 2 || x > snek->game_size.x - 2 || y > snek->game_size.y - 2)
+        return false;
+    return !isPointInSnake(snek, x, y, false);
+}
+
+static bool playGame(Point game_size, const char * nick, SimStats * stats) {
+    Snek snek;
+    memset(&snek, 0, sizeof(Snek));
+    snek.game_size = game_size;
+    snek.score = 1;
+    snek.direction = UP;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &snek.started);
+    snek.food = malloc(sizeof(Point));
+    if (snek.food == NULL || !createSnake(&snek)) {
+        freeSnake(&snek);
+        free(snek.food);
+        return false;
+    }
+    placeNewFood(&snek);
+    // Enough to fill the game area a few times over
+    long long step_limit = 4LL * game_size.x * game_size.y;
+    bool alive = true;
+    // Reading the clock would be a noticeable part of a step
+    bool timed = metricsEnabled();
+    struct timespec start, end;
+    while (alive && snek.ticks < step_limit) {
+        snek.direction = chooseDirection(&snek);
+        snek.ticks++;
+        if (timed)
+            clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        alive = stepGame(&snek);
+        if (timed) {
+            clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+            recordTick(elapsedNanoseconds(&start, &end));
+        }
+    }
+    recordGame();
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    GameRecord game = {
+            nick, snek.score, (int64_t) time(NULL),
+            (int) ((now.tv_sec - snek.started.tv_sec) * 1000L + (now.tv_nsec - snek.started.tv_nsec) / (long) 1E6),
+            snek.ticks, game_size.x, game_size.y, snek.food_eaten
+    };
+    stats->games++;
+    stats->ticks += snek.ticks;
+    stats->score_sum += snek.score;
+    if (snek.score > stats->best_score)
+        stats->best_score = snek.score;
+    freeSnake(&snek);
+    free(snek.food);
+    return saveScore(&game) > 0;
+}
+
+static bool showResults(ScoreCache * cache, const char * nick) {
+    if (refreshScoreCache(cache) < 0)
+        return false;
+    Nick_Score page[SIM_PAGE_SIZE];
+    size_t rank = getCachedRank(cache, nick);
+    size_t offset = rank > SIM_PAGE_SIZE / 2 ? rank - SIM_PAGE_SIZE / 2 : 0;
+    getCachedPage(cache, offset, SIM_PAGE_SIZE, page);
+    return getCachedHighscore(cache, nick) > 0;
+}
+
+static int runArena(Point game_size, long snakes, long foods, long ticks, bool perf) {
+    Arena * arena = createArena(game_size, (size_t) snakes, (size_t) foods, (unsigned long long) time(NULL) | 1u);
+    if (arena == NULL) {
+        fprintf(stderr, "Couldn't create the arena, the snakes and the food may not fit on the board\n");
+        return -3;
+    }
+    PerfCounters counters;
+    if (perf && !openPerfCounters(&counters)) {
+        fprintf(stderr, "Hardware performance counters are not available, counting nothing\n");
+        perf = false;
+    }
+    PerfCounts counts;
+    long long deaths = 0;
+    bool success = true;
+    bool timed = metricsEnabled();
+    struct timespec start, end, step_start, step_end;
+    if (perf)
+        startPerfCounters(&counters);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (long tick = 0; tick < ticks && success; tick++) {
+        if (timed)
+            clock_gettime(CLOCK_MONOTONIC_RAW, &step_start);
+        for (size_t i = 0; i < arena->snake_count; i++)
+            steerArenaBot(arena, i);
+        int died = stepArena(arena);
+        success = died >= 0;
+        deaths += died;
+        for (size_t i = 0; arena->alive < arena->snake_count && i < arena->snake_count; i++)
+            respawnArenaSnake(arena, i);
+        if (timed) {
+            clock_gettime(CLOCK_MONOTONIC_RAW, &step_end);
+            recordTick(elapsedNanoseconds(&step_start, &step_end));
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    if (perf) {
+        stopPerfCounters(&counters, &counts);
+        closePerfCounters(&counters);
+    }
+    double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1E9;
+    long long food_eaten = 0;
+    size_t longest = 0;
+    for (size_t i = 0; i < arena->snake_count; i++) {
+        food_eaten += arena->snakes[i].food_eaten;
+        if (arena->snakes[i].length > longest)
+            longest = arena->snakes[i].length;
+    }
+    freeArena(arena);
+    if (!success) {
+        fprintf(stderr, "Arena aborted, a snake couldn't grow\n");
+        return -3;
+    }
+    printf("snakes: %ld\nfood: %ld\nticks: %ld\ndeaths: %lld\nfood eaten by the living: %lld\nlongest snake: %zu\n"
+           "seconds: %.3f\nticks per second: %.0f\nsnake steps per second: %.0f\n",
+           snakes, foods, ticks, deaths, food_eaten, longest, elapsed,
+           elapsed > 0 ? (double) ticks / elapsed : 0.0, elapsed > 0 ? (double) ticks * (double) snakes / elapsed : 0.0);
+    if (perf)
+        printPerfCounts(&counts, ticks);
+    return 0;
+}
+
+static void removeWorkDirectory(const char * original) {
+    unlink("scores.txt");
+    unlink("scores.archive");
+    unlink("scores.pending");
+    if (chdir(original) != 0 || rmdir(work_directory) != 0)
+        perror("Couldn't remove the working directory");
+}
+
+static void printUsage(const char * program) {
+    fprintf(stderr, "Usage: %s [--games N] [--columns N] [--rows N] [--perf] [--arena SNAKES [--foods N] [--ticks N]]\n", program);
+}
+
+static void printPerfCounts(const PerfCounts * counts, long long ticks) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (!counts->available[i])
+            continue;
+        printf("%s: %.0f (%.1f per tick)\n", perfEventName((PerfEvent) i), counts->value[i],
+               ticks > 0 ? counts->value[i] / (double) ticks : 0.0);
+    }
+}
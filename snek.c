@@ -4,76 +4,136 @@
  * \brief This file handles the logic of the game, and also contains the entry point of the program
  */
 
+#include <stdio.h>
 #include <stdlib.h>
-#include <sys/random.h>
 #include <time.h>
+#include <unistd.h>
 #include "snek.h"
+#include "game.h"
+#include "arena.h"
 #include "screen.h"
-#include "debugmalloc.h"
+#include "allocator.h"
 #include "fileio.h"
+#include "scorecache.h"
+#include "prefetch.h"
+#include "shmboard.h"
+#include "query.h"
+#include "scorewatch.h"
+#include "trace.h"
+#include "startup.h"
+#include "metrics.h"
+#include "flightrec.h"
+
+/** @brief Interval of checking the leaderboards for changes while the toplist is shown */
+#define TOPLIST_REFRESH_MS 500
+
+/** @brief Time between two steps of the multi-snake game, every snake steps at the same time */
+#define ARENA_TICK_MS 150
+
+/** @brief Default number of bots of \p --arena */
+#define ARENA_DEFAULT_BOTS 7
+
+/** @brief Most players of \p --arena, one on the letters and one on the arrows */
+#define ARENA_MAX_PLAYERS 2
 
 /**
- * @brief Frees the memory used by the toplist
- * @param toplist Toplist containing nickname and score pairs
- * @param toplist_size Size of the toplist
+ * @brief A window of consecutive ranks of the leaderboard
  */
-void freeToplist(Nick_Score *, int);
+typedef struct LeaderboardPage {
+    /** @brief Number of players ranked above the page, \p SIZE_MAX if not loaded */
+    size_t offset;
+    /** @brief Number of players on the page */
+    int count;
+    /** @brief Players on the page, names are owned by the score cache */
+    Nick_Score * entries;
+} LeaderboardPage;
 
 /**
- * Steps the game to its next state. This includes moving the snake and placing a new food
- * @brief Steps the game to its next state
+ * This function is responsible for controlling the game after it has started
+ * It reads a control character and steps the game until an exit condition has been reached
+ * @brief Manages all game actions
  * @param snek holds all important game parameters
- * @return \p false if an exit condition has been met, \p true otherwise
+ * @returns when an exit condition had been met
  */
-bool stepGame(Snek *);
+void gameLoop(Snek *);
+
+/**
+ * Sets up a board of the size of the terminal with the players and the bots,
+ * steps it at a fixed rate until every player has died or a single snake is left,
+ * and shows the game-over screen. No score is saved, as the players have no nicknames.
+ * @brief Plays the multi-snake game of \p --arena
+ * @param snek holds the size of the screen, and the arena once it is created
+ * @param players number of snakes played from the keyboard
+ * @param bots number of snakes played by the computer
+ */
+void arenaLoop(Snek *, size_t, size_t);
 
 /**
- * @brief Adds a new head to the snake to the direction specified
+ * Initialises game: read highscore for given player, create necessary data structures
+ * @brief Initialises the game
  * @param snek holds all important game parameters
  */
-void addNewHead(Snek *);
+void initGame(Snek *);
 
 /**
- * Places a new food in the game in a random position, on a block that is not occupied by the snake
- * @brief Places a new food in the game
+ * Draws the first frame and waits for the scores, and the shared leaderboard,
+ * then ends the game without saving a score, and prints the startup profile.
+ * @brief Runs the startup of \p --profile-startup
  * @param snek holds all important game parameters
  */
-void placeNewFood(Snek *);
+void profileStartup(Snek *);
 
 /**
- * This function is responsible for controlling the game after it has started
- * It reads a control character and steps the game until an exit condition has been reached
- * @brief Manages all game actions
+ * Takes the scores loaded by the background worker and looks up the highscore of the player,
+ * also on the shared leaderboard the worker has opened.
+ * Does nothing if the scores have already been resolved.
+ * @brief Resolves the highscore of the player from the prefetched scores
  * @param snek holds all important game parameters
- * @returns when an exit condition had been met
+ * @param wait block until the scores are loaded, otherwise return immediately if they are not ready
  */
-void gameLoop(Snek *);
+void resolveHighscore(Snek *, bool);
 
 /**
- * Initialises game: read highscore for given player, create necessary data structures
- * @brief Initialises the game
+ * @brief Collects the results and the metadata of the finished game
  * @param snek holds all important game parameters
+ * @param game record to fill
  */
-void initGame(Snek *);
+void fillGameRecord(const Snek *, GameRecord *);
 
 /**
- * Checks if an end-of-game condition has been met.
- * This includes the snake biting on its tail and hitting a wall.
- * @brief Checks if an end-of-game condition has been met.
+ * Shows the toplist and the rank of the player until a key is pressed.
+ * If the shared leaderboard is available, its toplist is shown and redrawn
+ * whenever another instance changes it. Scores appended to the scores file
+ * meanwhile are read into the score cache and redrawn as well.
+ * Pressing 's' opens the leaderboard of every player.
+ * @brief Shows the toplist
  * @param snek holds all important game parameters
- * @return \p true if an end-of-game condition has been met, \p false otherwise
  */
-bool isGameOver(const Snek *);
+void showToplist(const Snek *);
 
 /**
- * @brief Checks if a given point is occupied by the snake
+ * The leaderboard is read one page at a time, and the page after the shown one
+ * is read ahead while waiting for a key. Pages are redrawn if new scores arrive.
+ * @brief Shows the scrollable leaderboard of every player, starting at the page of the player
  * @param snek holds all important game parameters
- * @param x column index
- * @param y row index
- * @param ignore_head do not check for x, y point in the head of the snake
- * @return \p true if the point is inside the snake, \p false otherwise
  */
-bool isPointInSnake(const Snek *, int, int, bool);
+void showLeaderboard(const Snek *);
+
+/**
+ * @brief Reads a page of the leaderboard from the score cache
+ * @param scores score cache to read from
+ * @param page page to fill, its \p entries must fit \p size items
+ * @param offset number of players ranked above the page
+ * @param size maximum number of players on the page
+ */
+void loadLeaderboardPage(const ScoreCache *, LeaderboardPage *, size_t, int);
+
+/**
+ * @brief Draws the rank of the player and the players around them on the leaderboard
+ * @param snek holds all important game parameters
+ * @param row first row to draw to
+ */
+void drawRank(const Snek *, int);
 
 /**
  * Finishes the game, prints an error message
@@ -83,66 +143,149 @@ bool isPointInSnake(const Snek *, int, int, bool);
  */
 void mallocError(const Snek * snek);
 
+/**
+ * Used in the strict mode of \p TickAllocations, to fail tests that catch
+ * the game loop allocating. Prints the allocations of the offending tick.
+ * @brief Finishes the game after a tick has allocated memory
+ * @param snek holds all important game parameters
+ */
+void allocationError(const Snek * snek);
+
 /**
  * Entry point of the program that (tries to) ensure that all pointers
  * are null before pointing to an allocated memory to avoid any segfaults.
+ * With \p --query as the first argument, a report is printed instead of starting the game.
+ * With \p --profile-startup, the game is only started up to the first frame, and the
+ * duration of each startup phase is printed. \p --arena [BOTS] [PLAYERS] starts the
+ * multi-snake game instead, with 1 or 2 players and 7 bots by default.
+ * The metrics are exported if the SNEK_METRICS environment variable is set,
+ * and the last ticks are recorded if SNEK_FLIGHT_RECORDER is.
  * @brief Entry point of the program
+ * @param argc number of command line arguments
+ * @param argv command line arguments
  * @return exit code
  */
-int main() {
+int main(int argc, char ** argv) {
+    if (argc > 1 && strcmp(argv[1], "--query") == 0)
+        return runQuery(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--arena") == 0) {
+        long bots = argc > 2 ? atol(argv[2]) : ARENA_DEFAULT_BOTS;
+        long players = argc > 3 ? atol(argv[3]) : 1;
+        if (bots < 0 || players < 1 || players > ARENA_MAX_PLAYERS || bots + players > ARENA_MAX_SNAKES) {
+            fprintf(stderr, "Usage: %s --arena [BOTS] [1|2]\n", argv[0]);
+            return 1;
+        }
+        Snek snek;
+        memset(&snek, 0, sizeof(Snek));
+        startMetrics();
+        initializeScreen(&snek);
+        arenaLoop(&snek, (size_t) players, (size_t) bots);
+        endGame(&snek);
+        return 0;
+    }
+    bool profile_startup = argc > 1 && strcmp(argv[1], "--profile-startup") == 0;
+    if (profile_startup)
+        startStartupProfile();
     Snek snek;
     // Sets memory to zero -> all pointers will be NULL
     // Avoids segfault if resize occurs before these are set
     memset(&snek, 0, sizeof(Snek));
+    // Before the prefetch thread, which times the reading of the scores
+    if (!profile_startup)
+        startMetrics();
+    // The shared leaderboard is optional, enabled by the SNEK_SHM environment variable
+    const char * shared_board = getenv("SNEK_SHM");
+    static char shared_path[64];
+    if (shared_board != NULL && shared_board[0] != '/') {
+        snprintf(shared_path, sizeof(shared_path), "%s-%u", SHARED_BOARD_DEFAULT_PATH, (unsigned) geteuid());
+        shared_board = shared_path;
+    }
+    // Read the scores in the background while the player types their nickname and plays,
+    // then open the shared leaderboard there, which is rebuilt from them if it is new
+    if (!startScorePrefetch(TOPLIST_SIZE, shared_board)) {
+        print_error("Couldn't allocate memory\n");
+        return -3;
+    }
+    markStartupPhase("prefetch", false);
     initializeScreen(&snek);
     initGame(&snek);
+    if (profile_startup) {
+        profileStartup(&snek);
+        return 0;
+    }
+    startFlightRecorder(&snek);
     gameLoop(&snek);
-    saveScore(snek.player_name, snek.score);
+    markFlightEnd(FLIGHT_FINISHED);
+    recordGame();
+    // The scores have had the whole game to load, this should not block
+    resolveHighscore(&snek, true);
+    GameRecord game;
+    fillGameRecord(&snek, &game);
+    if (saveScore(&game) > 0) {
+        // Reads the saved score back, along with any other instance finished meanwhile
+        if (refreshScoreCache(snek.scores) < 0) mallocError(&snek);
+        publishSharedScore(snek.player_name, snek.score);
+    }
     drawGameOver();
     readCharacter(-1);
 
     //Add spaces to the options to make them nicer on screen (not necessary)
-    //Only load the toplist if the user choses to see it, this also avoids closing with allocated memory
-    if (drawQuestionDialog("Do you want to see the toplist?", "  Yes  ", "  No   ")) {
-        int toplist_size = 10;
-        Nick_Score *toplist = getToplist(toplist_size);
-        drawToplist(toplist, toplist_size);
-        //Free immediately to avoid closing with unfreed memory (e.g. on SIGWINCH)
-        freeToplist(toplist, toplist_size);
-        readCharacter(-1);
-    }
+    //The toplist has been loaded with the highscore, only new records are read from here
+    if (drawQuestionDialog("Do you want to see the toplist?", "  Yes  ", "  No   "))
+        showToplist(&snek);
 
     endGame(&snek);
+    if (snek.allocations.report)
+        printTickAllocationTotals(&snek.allocations, stderr);
     return 0;
 }
 void initGame(Snek * snek) {
     getNickname(&(snek->player_name));
     if (snek->player_name == NULL) mallocError(NULL);
+    markStartupPhase("nickname", true);
 
-    snek->highscore = getHighscore(snek->player_name);
+    // -1 marks a highscore that is still being loaded
+    snek->highscore = -1;
+    resolveHighscore(snek, false);
     snek->score = 1;
     snek->direction = UP;
-    snek->snake = createLinkedList();
-    if (snek->snake == NULL) mallocError(snek);
-
-    Point * first = malloc(sizeof(Point));
-    if (first == NULL) mallocError(snek);
-    first->x = snek->game_size.x / 2;
-    first->y = snek->game_size.y / 2;
-    if (snek->snake->addFirst(snek->snake, first) == false) mallocError(snek);
+    if (!createSnake(snek)) mallocError(snek);
 
     snek->food = malloc(sizeof(Point));
     if (snek->food == NULL) mallocError(snek);
     placeNewFood(snek);
+    markStartupPhase("game", false);
+}
+
+void profileStartup(Snek * snek) {
+    drawGame(snek);
+    markStartupPhase("first frame", false);
+    resolveHighscore(snek, true);
+    endGame(snek);
+    printStartupProfile(stderr);
 }
 
 void gameLoop(Snek * snek) {
-    struct timespec start, end;
+    struct timespec start, end, tick_start, render_end;
     long remainder = 0;
     bool continue_game = true;
+    bool first_frame = true;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &snek->started);
+    startTickAllocations(&snek->allocations);
     do {
-        if (!remainder)
+        if (!remainder) {
+            TRACE_BEGIN("tick");
+            clock_gettime(CLOCK_MONOTONIC_RAW, &tick_start);
+            enterTickPhase(&snek->allocations, TICK_RENDER);
+            resolveHighscore(snek, false);
             drawGame(snek);
+            if (first_frame) {
+                markStartupPhase("first frame", false);
+                first_frame = false;
+            }
+            clock_gettime(CLOCK_MONOTONIC_RAW, &render_end);
+        }
+        enterTickPhase(&snek->allocations, TICK_INPUT);
         clock_gettime(CLOCK_MONOTONIC_RAW, &start);
         int dir = readCharacter(remainder == 0 ? 750 : remainder);
         bool invalid_button = false;
@@ -186,107 +329,198 @@ void gameLoop(Snek * snek) {
             continue;
         }
         remainder = 0;
+        snek->ticks++;
+        enterTickPhase(&snek->allocations, TICK_STEP);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
         continue_game = stepGame(snek);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        // The time spent drawing and stepping, without waiting for the keys
+        long long busy_ns = elapsedNanoseconds(&tick_start, &render_end) + elapsedNanoseconds(&start, &end);
+        recordTick(busy_ns);
+        recordFlightTick(snek, dir, continue_game, busy_ns);
+        TRACE_END("tick");
+        if (!finishTick(&snek->allocations) && snek->allocations.strict)
+            allocationError(snek);
     } while (continue_game);
 }
 
-bool stepGame(Snek * snek) {
-    addNewHead(snek);
-    if (isGameOver(snek)) return false;
-    LinkedList * snake = snek->snake;
-    snake->toStart(snake);
-    Point * head = snake->node->data;
-    if (head->x == snek->food->x && head->y == snek->food->y) {
-        snek->score++;
-        placeNewFood(snek);
-    } else {
-        snake->toEnd(snake);
-        snake->removeItem(snake);
+void arenaLoop(Snek * snek, size_t players, size_t bots) {
+    size_t snakes = players + bots;
+    snek->arena = createArena(snek->game_size, snakes, snakes, (unsigned long long) time(NULL) | 1u);
+    if (snek->arena == NULL) {
+        endGame(snek);
+        fprintf(stderr, "Couldn't create the arena, the terminal may be too small for %zu snakes\n", snakes);
+        exit(-3);
     }
-    return true;
-}
-
-void addNewHead(Snek * snek) {
-    LinkedList * snake = snek->snake;
-    snake->toStart(snake);
-    Point * head = snake->node->data;
-    Point * new = malloc(sizeof(Point));
-    if (new == NULL) mallocError(snek);
-    switch (snek->direction) {
-        case UP:
-            new->x = head->x;
-            new->y = head->y - 1;
-            break;
-        case DOWN:
-            new->x = head->x;
-            new->y = head->y + 1;
-            break;
-        case LEFT:
-            new->x = head->x - 1;
-            new->y = head->y;
-            break;
-        case RIGHT:
-            new->x = head->x + 1;
-            new->y = head->y;
-            break;
+    Arena * arena = snek->arena;
+    struct timespec tick_start, now, step_start, step_end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &snek->started);
+    bool running = true;
+    while (running) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &tick_start);
+        drawArena(arena, players);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &step_start);
+        long long busy_ns = elapsedNanoseconds(&tick_start, &step_start);
+        // The keys only turn the snakes, they all step together when the tick is over
+        long remainder = ARENA_TICK_MS;
+        do {
+            Direction direction;
+            int player = readPlayerDirection(remainder, &direction);
+            // A single player can use both the letters and the arrows
+            if (player >= 0)
+                steerArenaSnake(arena, players > 1 ? (size_t) player : 0, direction);
+            clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+            remainder = ARENA_TICK_MS - (long) (elapsedNanoseconds(&tick_start, &now) / 1000000);
+        } while (remainder > 0);
+        snek->ticks++;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &step_start);
+        for (size_t i = players; i < snakes; i++)
+            steerArenaBot(arena, i);
+        if (stepArena(arena) < 0)
+            mallocError(snek);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &step_end);
+        recordTick(busy_ns + elapsedNanoseconds(&step_start, &step_end));
+        size_t players_alive = 0;
+        for (size_t i = 0; i < players; i++)
+            players_alive += arena->snakes[i].alive;
+        running = players_alive > 0 && (arena->alive > 1 || snakes == 1);
     }
-    if (!snake->addFirst(snake, new)) mallocError(snek);
+    recordGame();
+    drawArenaOver(arena, players);
+    readCharacter(-1);
 }
 
-void placeNewFood(Snek * snek) {
-    int x, y;
-    unsigned int coords[2];
-    do {
-        //Generate cryptographically secure random numbers (for fun) (syscall!)
-        getrandom(&coords, 2 * sizeof(unsigned int), GRND_RANDOM);
-        x = (int) (coords[0] % (snek->game_size.x - 2) + 1);
-        y = (int) (coords[1] % (snek->game_size.y - 3) + 2);
-    } while (isPointInSnake(snek, x, y, false));
-    snek->food->x = x;
-    snek->food->y = y;
+void resolveHighscore(Snek * snek, bool wait) {
+    if (snek->scores != NULL)
+        return;
+    ScoreCache * scores = NULL;
+    if (wait)
+        scores = awaitScorePrefetch();
+    else if (!pollScorePrefetch(&scores))
+        return;
+    if (scores == NULL) mallocError(snek);
+    snek->scores = scores;
+    markStartupPhase("scores", false);
+    int highscore = getCachedHighscore(scores, snek->player_name);
+    if (highscore > snek->highscore)
+        snek->highscore = highscore;
+    // Opened by the prefetch thread, it can be used once the scores have been claimed
+    if (getSharedHighscore(snek->player_name, &highscore) && highscore > snek->highscore)
+        snek->highscore = highscore;
 }
 
-bool isGameOver(const Snek * snek) {
-    LinkedList * snake = snek->snake;
-    snake->toStart(snake);
-    Point * head = snake->node->data;
-    if (head->x < 1 || head->y < 2)
-        return true;
-    if (head->x > snek->game_size.x - 2 || head->y > snek->game_size.y - 2)
-        return true;
-    return isPointInSnake(snek, head->x, head->y, true);
+void fillGameRecord(const Snek * snek, GameRecord * game) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    game->nick = snek->player_name;
+    game->score = snek->score;
+    game->timestamp = (int64_t) time(NULL);
+    game->duration_ms = (int) ((now.tv_sec - snek->started.tv_sec) * 1000L + (now.tv_nsec - snek->started.tv_nsec) / (long) 1E6);
+    game->ticks = snek->ticks;
+    game->width = snek->game_size.x;
+    game->height = snek->game_size.y;
+    game->food_eaten = snek->food_eaten;
 }
 
-bool isPointInSnake(const Snek * snek, int x, int y, bool ignore_head) {
-    LinkedList * snake = snek->snake;
-    snake->toStart(snake);
-    if (ignore_head) {
-        if (!snake->hasNext(snake)) return false;
-        else snake->next(snake);
+void showToplist(const Snek * snek) {
+    SharedToplist shared;
+    bool live = readSharedToplist(&shared);
+    bool watched = openScoreWatch();
+    drawRank(snek, drawToplist(live ? shared.toplist : snek->scores->toplist, TOPLIST_SIZE));
+    if (!live && !watched) {
+        if (readCharacter(-1) == 's')
+            showLeaderboard(snek);
+        return;
     }
+    int key;
+    while ((key = readCharacter(TOPLIST_REFRESH_MS)) == -1) {
+        bool changed = false;
+        if (pollScoreWatch()) {
+            int read = refreshScoreCache(snek->scores);
+            if (read < 0) mallocError(snek);
+            changed = read > 0;
+        }
+        unsigned version = shared.version;
+        if (live && readSharedToplist(&shared) && shared.version != version)
+            changed = true;
+        if (changed)
+            drawRank(snek, drawToplist(live ? shared.toplist : snek->scores->toplist, TOPLIST_SIZE));
+    }
+    if (key == 's')
+        showLeaderboard(snek);
+    closeScoreWatch();
+}
+
+void showLeaderboard(const Snek * snek) {
+    int page_size = getLeaderboardPageSize();
+    Nick_Score * entries = malloc(2 * page_size * sizeof(Nick_Score));
+    if (entries == NULL) mallocError(snek);
+    LeaderboardPage shown = {SIZE_MAX, 0, entries};
+    LeaderboardPage ahead = {SIZE_MAX, 0, entries + page_size};
+    size_t rank = getCachedRank(snek->scores, snek->player_name);
+    size_t offset = rank > 0 ? (rank - 1) / page_size * page_size : 0;
+    int key = -1;
     do {
-        Point * point = snake->node->data;
-        if (point->x == x && point->y == y)
-            return true;
-    } while (snake->next(snake));
-    return false;
+        size_t players = getCachedPlayerCount(snek->scores);
+        if (key == 's' && offset + page_size < players)
+            offset += page_size;
+        else if (key == 'w' && offset > 0)
+            offset -= page_size;
+        else if (key == -1 && pollScoreWatch()) {
+            if (refreshScoreCache(snek->scores) < 0) mallocError(snek);
+            // Ranks may have shifted, both pages have to be read again
+            shown.offset = ahead.offset = SIZE_MAX;
+            rank = getCachedRank(snek->scores, snek->player_name);
+        }
+        if (shown.offset != offset) {
+            if (ahead.offset == offset) {
+                LeaderboardPage page = shown;
+                shown = ahead;
+                ahead = page;
+            } else {
+                loadLeaderboardPage(snek->scores, &shown, offset, page_size);
+            }
+            drawLeaderboardPage(shown.entries, offset + 1, shown.count, getCachedPlayerCount(snek->scores), rank);
+        }
+        // Read the next page while the player looks at this one
+        if (ahead.offset != offset + page_size)
+            loadLeaderboardPage(snek->scores, &ahead, offset + page_size, page_size);
+    } while ((key = readCharacter(TOPLIST_REFRESH_MS)) != 'q');
+    free(entries);
 }
 
-void freeToplist(Nick_Score * toplist, int toplist_size) {
-    for (int i = 0; i < toplist_size; i++) {
-        free(toplist[i].nick);
-    }
-    free(toplist);
+void loadLeaderboardPage(const ScoreCache * scores, LeaderboardPage * page, size_t offset, int size) {
+    page->count = (int) getCachedPage(scores, offset, size, page->entries);
+    page->offset = offset;
+}
+
+void drawRank(const Snek * snek, int row) {
+    const Leaderboard * leaderboard = snek->scores->leaderboard;
+    size_t rank = getCachedRank(snek->scores, snek->player_name);
+    if (rank == 0)
+        return;
+    Nick_Score neighbours[2 * RANK_NEIGHBOURS + 1];
+    size_t first_rank = rank > RANK_NEIGHBOURS ? rank - RANK_NEIGHBOURS : 1;
+    size_t count = getLeaderboardRange(leaderboard, first_rank, 2 * RANK_NEIGHBOURS + 1, neighbours);
+    drawPlayerRank(row, rank, leaderboard->size, getLeaderboardPercentile(leaderboard, rank), neighbours, first_rank, (int) count);
 }
 
 void endGame(const Snek * snek) {
     closeScreen();
-    dumpLinkedList(snek->snake);
+    closeScoreWriter();
+    freeSnake(snek);
     free(snek->food);
     free(snek->player_name);
+    cancelScorePrefetch();
+    freeScoreCache(snek->scores);
+    closeSharedBoard();
+    closeScoreWatch();
+    stopFlightRecorder();
+    freeArena(snek->arena);
 }
 
 void mallocError(const Snek * snek){
+    markFlightEnd(FLIGHT_MALLOC_ERROR);
     if (snek != NULL)
         endGame(snek);
     else
@@ -294,3 +528,11 @@ void mallocError(const Snek * snek){
     print_error("Couldn't allocate memory\n");
     exit(-3);
 }
+
+void allocationError(const Snek * snek) {
+    TickAllocations allocations = snek->allocations;
+    markFlightEnd(FLIGHT_ALLOCATION_ERROR);
+    endGame(snek);
+    printTickAllocations(&allocations, stderr);
+    exit(-4);
+}
@@ -5,12 +5,21 @@
 #ifndef SNEK_SNEK_H
 #define SNEK_SNEK_H
 
+#include <time.h>
+#include <stdint.h>
 #include "linkedlist.h"
+#include "tickalloc.h"
 
 typedef enum {UP, DOWN, LEFT, RIGHT} Direction;
 
 #define NICK_MAX_LENGTH 15
 
+/** @brief Number of items shown on the toplist */
+#define TOPLIST_SIZE 10
+
+/** @brief Number of players shown above and below the player on the end screen */
+#define RANK_NEIGHBOURS 2
+
 /**
  * @brief Structure to hold positions in a 2D plane
  */
@@ -18,14 +27,25 @@ typedef struct Point {
     int x, y;
 } Point;
 
+/** @brief Compact integer identifier of a nickname, see \p NickDictionary */
+typedef uint32_t PlayerId;
+
+/** @brief \p PlayerId of names that have not been interned */
+#define PLAYER_NONE UINT32_MAX
+
 /**
  * @brief Structure holding a Nickname-Score pair
  */
 typedef struct {
     char * nick;
     int score;
+    /** @brief ID of \p nick in the dictionary it comes from, \p PLAYER_NONE if not interned */
+    PlayerId player;
 } Nick_Score;
 
+struct ScoreCache;
+struct Arena;
+
 /** @brief Structure to hold all important parameters of the game */
 typedef struct {
     /** @brief Current score of the current player */
@@ -40,8 +60,33 @@ typedef struct {
     Point game_size;
     /** @brief \p LinkedList containing the positions of the snake */
     LinkedList * snake;
+    /**
+     * Reserved when the game starts, so the snake can grow to fill the game area
+     * without allocating. The nodes of \p snake point into it, and are detached
+     * instead of removed, so the positions are not freed one by one.
+     * @brief Block holding the position of every segment the snake can have
+     */
+    Point * segments;
+    /** @brief Number of items of \p segments */
+    size_t segment_capacity;
+    /** @brief Number of items of \p segments handed out to the snake */
+    size_t segment_count;
+    /** @brief Position detached from the tail of the snake, reused by the next head */
+    Point * spare_segment;
+    /** @brief Allocations made by the game loop, see \p TickAllocations */
+    TickAllocations allocations;
     /** @brief nickname of current player */
     char * player_name;
+    /** @brief Scores loaded for this session, see \p ScoreCache */
+    struct ScoreCache * scores;
+    /** @brief Number of steps the snake has made */
+    int ticks;
+    /** @brief Number of food eaten */
+    int food_eaten;
+    /** @brief Time the game has started at (\p CLOCK_MONOTONIC_RAW) */
+    struct timespec started;
+    /** @brief Board of the multi-snake game of \p --arena, \p NULL in the single player game */
+    struct Arena * arena;
 } Snek;
 
 /**
@@ -0,0 +1,62 @@
+/**
+ * The startup profile is a fixed table of timestamps, filled by the main thread,
+ * so recording a phase does not allocate and costs a clock read.
+ * \file startup.c
+ * \author hexadec
+ * \brief This file contains the startup profile of \p --profile-startup
+ */
+
+#include <time.h>
+#include "startup.h"
+#include "allocator.h"
+
+/**
+ * @brief Timestamps of the startup phases
+ */
+static struct {
+    /** @brief Whether the profile has been started */
+    bool enabled;
+    /** @brief Beginning of the startup */
+    struct timespec start;
+    /** @brief Number of recorded phases */
+    int count;
+    /** @brief Recorded phases, in order */
+    StartupPhase phases[STARTUP_MAX_PHASES];
+} profile;
+
+void startStartupProfile() {
+    clock_gettime(CLOCK_MONOTONIC_RAW, &profile.start);
+    profile.enabled = true;
+    profile.count = 0;
+}
+
+bool isStartupProfiled() {
+    return profile.enabled;
+}
+
+void markStartupPhase(const char * name, bool input) {
+    if (!profile.enabled || profile.count == STARTUP_MAX_PHASES)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    StartupPhase * phase = &profile.phases[profile.count++];
+    phase->name = name;
+    phase->end_ns = (now.tv_sec - profile.start.tv_sec) * 1000000000LL + (now.tv_nsec - profile.start.tv_nsec);
+    phase->input = input;
+}
+
+void printStartupProfile(FILE * stream) {
+    fprintf(stream, "%-20s %12s %12s\n", "phase", "duration ms", "end ms");
+    long long previous = 0;
+    long long input = 0;
+    for (int i = 0; i < profile.count; i++) {
+        const StartupPhase * phase = &profile.phases[i];
+        long long duration = phase->end_ns - previous;
+        if (phase->input)
+            input += duration;
+        fprintf(stream, "%-20s %12.3f %12.3f%s\n", phase->name, (double) duration / 1E6, (double) phase->end_ns / 1E6,
+                phase->input ? " (input)" : "");
+        previous = phase->end_ns;
+    }
+    fprintf(stream, "startup: %.3f ms, %.3f ms without input\n", (double) previous / 1E6, (double) (previous - input) / 1E6);
+}
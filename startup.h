@@ -0,0 +1,56 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_STARTUP_H
+#define SNEK_STARTUP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/** @brief Most phases recorded by the startup profile, later ones are dropped */
+#define STARTUP_MAX_PHASES 16
+
+/**
+ * @brief The end of a phase of the startup
+ */
+typedef struct StartupPhase {
+    /** @brief Name of the phase, a string literal */
+    const char * name;
+    /** @brief Time of the end of the phase, in nanoseconds since the profile was started */
+    long long end_ns;
+    /** @brief Whether the phase was spent waiting for the player */
+    bool input;
+} StartupPhase;
+
+/**
+ * Records the beginning of the startup, phases are only recorded after this.
+ * Called first thing in \p main, so the loading of the executable is not included.
+ * @brief Starts the startup profile
+ */
+void startStartupProfile();
+
+/**
+ * @brief Checks if the startup is profiled
+ * @return \p true after \p startStartupProfile, \p false otherwise
+ */
+bool isStartupProfiled();
+
+/**
+ * Does nothing if the startup is not profiled, so it can be left in the startup code.
+ * The phase is the time since the previous phase ended.
+ * @brief Records the end of a phase of the startup
+ * @param name name of the phase, has to be a string literal
+ * @param input \p true if the phase was spent waiting for the player, it is left out of the startup time
+ */
+void markStartupPhase(const char *, bool);
+
+/**
+ * Prints every phase with its duration and end time, then the time to the
+ * last phase, with and without the time spent waiting for the player.
+ * @brief Prints the startup profile
+ * @param stream stream to print to
+ */
+void printStartupProfile(FILE *);
+
+#endif //SNEK_STARTUP_H
@@ -0,0 +1,88 @@
+/**
+ * The game loop is expected not to allocate once the game has started:
+ * the snake takes its nodes and positions from memory reserved by \p initGame.
+ * These counters make regressions visible without waiting for latency spikes.
+ * \file tickalloc.c
+ * \author hexadec
+ * \brief This file contains the per tick allocation counters of the game loop
+ */
+
+#include <string.h>
+#include "tickalloc.h"
+#include "allocator.h"
+
+/** @brief Names of the phases, indexed by \p TickPhase */
+static const char * phase_names[TICK_PHASES] = {"input", "step", "render"};
+
+/**
+ * @brief Adds the allocations made since the start of the running phase to it
+ * @param allocations counters of the game loop
+ */
+static void closePhase(TickAllocations *);
+
+/**
+ * @brief Prints a table of counts per phase
+ * @param counts counts indexed by \p TickPhase
+ * @param stream stream to print to
+ */
+static void printPhases(const TickCounts *, FILE *);
+
+void startTickAllocations(TickAllocations * allocations) {
+    memset(allocations, 0, sizeof(TickAllocations));
+    const char * mode = getenv("SNEK_TICK_ALLOCS");
+    if (mode != NULL) {
+        allocations->strict = strcmp(mode, "strict") == 0;
+        allocations->report = allocations->strict || strcmp(mode, "report") == 0;
+    }
+    allocations->phase = TICK_INPUT;
+    AllocatorThreadCounts now;
+    getAllocatorThreadCounts(&now);
+    allocations->mark = (TickCounts) {now.allocations, now.frees};
+}
+
+void enterTickPhase(TickAllocations * allocations, TickPhase phase) {
+    closePhase(allocations);
+    allocations->phase = phase;
+}
+
+bool finishTick(TickAllocations * allocations) {
+    closePhase(allocations);
+    bool allocated = false;
+    for (int i = 0; i < TICK_PHASES; i++) {
+        allocated |= allocations->tick[i].allocations != 0 || allocations->tick[i].frees != 0;
+        allocations->total[i].allocations += allocations->tick[i].allocations;
+        allocations->total[i].frees += allocations->tick[i].frees;
+    }
+    memcpy(allocations->last, allocations->tick, sizeof(allocations->tick));
+    memset(allocations->tick, 0, sizeof(allocations->tick));
+    allocations->ticks++;
+    if (allocated)
+        allocations->allocating_ticks++;
+    allocations->phase = TICK_INPUT;
+    return !allocated;
+}
+
+void printTickAllocations(const TickAllocations * allocations, FILE * stream) {
+    fprintf(stream, "Tick %lld has allocated memory\n", allocations->ticks);
+    printPhases(allocations->last, stream);
+}
+
+void printTickAllocationTotals(const TickAllocations * allocations, FILE * stream) {
+    fprintf(stream, "%lld of %lld ticks have allocated memory\n", allocations->allocating_ticks, allocations->ticks);
+    printPhases(allocations->total, stream);
+}
+
+static void closePhase(TickAllocations * allocations) {
+    AllocatorThreadCounts now;
+    getAllocatorThreadCounts(&now);
+    TickCounts * phase = &allocations->tick[allocations->phase];
+    phase->allocations += now.allocations - allocations->mark.allocations;
+    phase->frees += now.frees - allocations->mark.frees;
+    allocations->mark = (TickCounts) {now.allocations, now.frees};
+}
+
+static void printPhases(const TickCounts * counts, FILE * stream) {
+    fprintf(stream, "%-8s %12s %12s\n", "phase", "allocations", "frees");
+    for (int i = 0; i < TICK_PHASES; i++)
+        fprintf(stream, "%-8s %12lld %12lld\n", phase_names[i], counts[i].allocations, counts[i].frees);
+}
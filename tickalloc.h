@@ -0,0 +1,101 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_TICKALLOC_H
+#define SNEK_TICKALLOC_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @brief Phases of a tick of the game loop
+ */
+typedef enum TickPhase {
+    /** @brief Waiting for and handling the control keys */
+    TICK_INPUT = 0,
+    /** @brief Stepping the snake */
+    TICK_STEP,
+    /** @brief Drawing the game */
+    TICK_RENDER
+} TickPhase;
+
+/** @brief Number of phases in \p TickPhase */
+#define TICK_PHASES 3
+
+/**
+ * @brief Number of allocations and frees
+ */
+typedef struct TickCounts {
+    /** @brief Blocks allocated, a resized block counts as a free and an allocation */
+    long long allocations;
+    /** @brief Blocks freed */
+    long long frees;
+} TickCounts;
+
+/**
+ * Only the allocations of the thread running the game loop are counted,
+ * see \p getAllocatorThreadCounts.
+ * @brief Allocations made by the game loop, per tick and per phase
+ */
+typedef struct TickAllocations {
+    /** @brief Allocations of the running tick, per phase */
+    TickCounts tick[TICK_PHASES];
+    /** @brief Allocations of the last finished tick, per phase */
+    TickCounts last[TICK_PHASES];
+    /** @brief Allocations of all finished ticks, per phase */
+    TickCounts total[TICK_PHASES];
+    /** @brief Counters of the thread when the running phase has started */
+    TickCounts mark;
+    /** @brief The running phase */
+    TickPhase phase;
+    /** @brief Number of finished ticks */
+    long long ticks;
+    /** @brief Number of finished ticks that have allocated or freed memory */
+    long long allocating_ticks;
+    /** @brief Fail on the first tick that allocates or frees memory */
+    bool strict;
+    /** @brief Print the totals when the game is over */
+    bool report;
+} TickAllocations;
+
+/**
+ * The mode is read from the SNEK_TICK_ALLOCS environment variable:
+ * \p report prints the totals when the game is over, \p strict also fails
+ * the game on the first tick that allocates or frees memory.
+ * The counting itself is always on, it costs two reads of thread-local counters per phase.
+ * @brief Starts counting the allocations of the calling thread, in the input phase
+ * @param allocations counters to initialise
+ */
+void startTickAllocations(TickAllocations *);
+
+/**
+ * @brief Finishes the running phase and starts another one of the same tick
+ * @param allocations counters of the game loop
+ * @param phase phase to start, may be the running one
+ */
+void enterTickPhase(TickAllocations *, TickPhase);
+
+/**
+ * The next tick starts in the input phase.
+ * @brief Finishes the running tick
+ * @param allocations counters of the game loop
+ * @return \p false if the tick has allocated or freed memory, \p true otherwise
+ */
+bool finishTick(TickAllocations *);
+
+/**
+ * @brief Prints the allocations of the last finished tick, per phase
+ * @param allocations counters of the game loop
+ * @param stream stream to print to
+ */
+void printTickAllocations(const TickAllocations *, FILE *);
+
+/**
+ * @brief Prints the totals of all finished ticks, per phase
+ * @param allocations counters of the game loop
+ * @param stream stream to print to
+ */
+void printTickAllocationTotals(const TickAllocations *, FILE *);
+
+#endif //SNEK_TICKALLOC_H
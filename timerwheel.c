@@ -0,0 +1,150 @@
+/**
+ * The ticks of the wheel are counted from its creation with the monotonic clock.
+ * Advancing visits every slot between the last processed tick and the current
+ * one, but at most one turn of the wheel, as a turn visits every slot.
+ * \file timerwheel.c
+ * \author hexadec
+ * \brief This file contains the timer wheel of the arcade server
+ */
+
+#include "timerwheel.h"
+#include "allocator.h"
+
+/**
+ * @brief Reads the current tick of the wheel
+ * @param wheel the timer wheel
+ * @return ticks since the creation of the wheel
+ */
+static uint64_t currentTick(const TimerWheel *);
+
+/**
+ * Does not count the timer, it is counted when scheduled.
+ * @brief Appends a timer to the slot of its expiry
+ * @param wheel the timer wheel
+ * @param timer timer with \p expires set
+ */
+static void linkTimer(TimerWheel *, Timer *);
+
+TimerWheel * createTimerWheel(size_t slots, long long resolution_ns) {
+    size_t size = 1;
+    while (size < slots)
+        size <<= 1;
+    TimerWheel * wheel = malloc(sizeof(TimerWheel));
+    if (wheel == NULL)
+        return NULL;
+    wheel->slots = malloc(size * sizeof(Timer));
+    if (wheel->slots == NULL) {
+        free(wheel);
+        return NULL;
+    }
+    for (size_t i = 0; i < size; i++)
+        wheel->slots[i].prev = wheel->slots[i].next = &wheel->slots[i];
+    wheel->mask = size - 1;
+    wheel->resolution_ns = resolution_ns > 0 ? resolution_ns : 1;
+    clock_gettime(CLOCK_MONOTONIC, &wheel->start);
+    wheel->current = 0;
+    wheel->count = 0;
+    return wheel;
+}
+
+void freeTimerWheel(TimerWheel * wheel) {
+    if (wheel == NULL)
+        return;
+    free(wheel->slots);
+    free(wheel);
+}
+
+void scheduleTimer(TimerWheel * wheel, Timer * timer, long long delay_ns) {
+    cancelTimer(wheel, timer);
+    uint64_t now = currentTick(wheel);
+    uint64_t ticks = delay_ns > 0 ? (uint64_t) ((delay_ns + wheel->resolution_ns - 1) / wheel->resolution_ns) : 0;
+    timer->expires = now + ticks;
+    // Behind the processed ticks, it would only be found a turn later
+    if (timer->expires < wheel->current)
+        timer->expires = wheel->current;
+    linkTimer(wheel, timer);
+    wheel->count++;
+}
+
+void cancelTimer(TimerWheel * wheel, Timer * timer) {
+    if (!isTimerScheduled(timer))
+        return;
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+    wheel->count--;
+}
+
+bool isTimerScheduled(const Timer * timer) {
+    return timer->next != NULL;
+}
+
+size_t advanceTimerWheel(TimerWheel * wheel, void (*expired)(Timer *, void *), void * context) {
+    uint64_t now = currentTick(wheel);
+    if (now < wheel->current)
+        return 0;
+    uint64_t first = wheel->current;
+    if (now - first > wheel->mask)
+        first = now - wheel->mask;
+    size_t count = 0;
+    for (uint64_t tick = first; tick <= now; tick++) {
+        Timer * slot = &wheel->slots[tick & wheel->mask];
+        if (slot->next == slot)
+            continue;
+        // Detach the slot, so the callbacks can schedule into it
+        Timer pending = *slot;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        slot->prev = slot->next = slot;
+        while (pending.next != &pending) {
+            Timer * timer = pending.next;
+            pending.next = timer->next;
+            timer->next->prev = &pending;
+            if (timer->expires > now) {
+                // Expires in a later turn of the wheel
+                linkTimer(wheel, timer);
+                continue;
+            }
+            timer->prev = timer->next = NULL;
+            wheel->count--;
+            count++;
+            expired(timer, context);
+        }
+    }
+    wheel->current = now + 1;
+    return count;
+}
+
+int nextTimerTimeout(const TimerWheel * wheel) {
+    if (wheel->count == 0)
+        return -1;
+    uint64_t now = currentTick(wheel);
+    uint64_t tick = wheel->current > now ? wheel->current : now;
+    for (size_t i = 0; i <= wheel->mask; i++, tick++) {
+        const Timer * slot = &wheel->slots[tick & wheel->mask];
+        if (slot->next != slot)
+            break;
+    }
+    if (tick <= now)
+        return 0;
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    long long elapsed = (time.tv_sec - wheel->start.tv_sec) * 1000000000LL + (time.tv_nsec - wheel->start.tv_nsec);
+    long long wait = (long long) tick * wheel->resolution_ns - elapsed;
+    return wait > 0 ? (int) ((wait + 999999) / 1000000) : 0;
+}
+
+static uint64_t currentTick(const TimerWheel * wheel) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    long long elapsed = (time.tv_sec - wheel->start.tv_sec) * 1000000000LL + (time.tv_nsec - wheel->start.tv_nsec);
+    return (uint64_t) (elapsed / wheel->resolution_ns);
+}
+
+static void linkTimer(TimerWheel * wheel, Timer * timer) {
+    Timer * slot = &wheel->slots[timer->expires & wheel->mask];
+    timer->next = slot;
+    timer->prev = slot->prev;
+    slot->prev->next = timer;
+    slot->prev = timer;
+}
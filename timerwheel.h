@@ -0,0 +1,107 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_TIMERWHEEL_H
+#define SNEK_TIMERWHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Embedded into the objects it schedules, so scheduling does not allocate.
+ * The object is found from the timer with \p offsetof.
+ * @brief A timer of a \p TimerWheel
+ */
+typedef struct Timer {
+    /** @brief Previous timer of the slot, \p NULL if the timer is not scheduled */
+    struct Timer * prev;
+    /** @brief Next timer of the slot, \p NULL if the timer is not scheduled */
+    struct Timer * next;
+    /** @brief Wheel tick the timer expires at */
+    uint64_t expires;
+} Timer;
+
+/**
+ * Every slot is a circular list of the timers expiring in the ticks that map to it,
+ * so scheduling and cancelling are O(1). Timers further ahead than a turn of
+ * the wheel stay in their slot until their turn comes.
+ * @brief Hashed timer wheel, shared by many timers with the same resolution
+ */
+typedef struct TimerWheel {
+    /** @brief Sentinels of the slots, the number of slots is a power of two */
+    Timer * slots;
+    /** @brief Number of slots minus one */
+    size_t mask;
+    /** @brief Length of a tick of the wheel, in nanoseconds */
+    long long resolution_ns;
+    /** @brief Time the wheel was created, tick 0 */
+    struct timespec start;
+    /** @brief First tick that has not been processed yet */
+    uint64_t current;
+    /** @brief Number of scheduled timers */
+    size_t count;
+} TimerWheel;
+
+/**
+ * @brief Creates an empty timer wheel
+ * @param slots number of slots, rounded up to a power of two
+ * @param resolution_ns length of a tick of the wheel, in nanoseconds
+ * @return dynamically allocated timer wheel, \p NULL on allocation failure
+ */
+TimerWheel * createTimerWheel(size_t, long long);
+
+/**
+ * The timers still scheduled are not touched.
+ * @brief Frees the memory used by the timer wheel
+ * @param wheel timer wheel to free, can be \p NULL
+ */
+void freeTimerWheel(TimerWheel *);
+
+/**
+ * Reschedules the timer if it is already scheduled.
+ * @brief Schedules a timer
+ * @param wheel the timer wheel
+ * @param timer timer to schedule
+ * @param delay_ns time from now the timer expires in, rounded up to a tick
+ */
+void scheduleTimer(TimerWheel *, Timer *, long long);
+
+/**
+ * Does nothing if the timer is not scheduled.
+ * @brief Cancels a timer
+ * @param wheel the timer wheel
+ * @param timer timer to cancel
+ */
+void cancelTimer(TimerWheel *, Timer *);
+
+/**
+ * @brief Checks if a timer is scheduled
+ * @param timer the timer
+ * @return \p true if the timer is scheduled, \p false otherwise
+ */
+bool isTimerScheduled(const Timer *);
+
+/**
+ * Expired timers are unscheduled before their callback is called, so the
+ * callback can schedule them again, or free them.
+ * @brief Calls the callback of every timer that has expired
+ * @param wheel the timer wheel
+ * @param expired callback called with every expired timer
+ * @param context passed to the callback
+ * @return number of expired timers
+ */
+size_t advanceTimerWheel(TimerWheel *, void (*)(Timer *, void *), void *);
+
+/**
+ * Meant as the timeout of \p epoll_wait, it may be earlier than the expiry
+ * of the first timer, if that is more than a turn of the wheel away.
+ * @brief Time until the next timer expires
+ * @param wheel the timer wheel
+ * @return milliseconds to wait, rounded up, -1 if no timer is scheduled
+ */
+int nextTimerTimeout(const TimerWheel *);
+
+#endif //SNEK_TIMERWHEEL_H
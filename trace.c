@@ -0,0 +1,137 @@
+/**
+ * Only built with the SNEK_TRACE CMake option. Recording an event takes a
+ * clock read and a few stores: the ring buffer of a thread is only written by
+ * that thread, and the write counter is published with a release store, so
+ * no locks are taken. The rings are only read at exit.
+ * \file trace.c
+ * \author hexadec
+ * \brief This file contains the trace event recorder
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "allocator.h"
+
+/** @brief Number of events a thread keeps (power of two) */
+#define TRACE_RING_SIZE 65536
+
+/** @brief Default path of the trace file */
+#define TRACE_DEFAULT_FILE "snek_trace.json"
+
+/**
+ * @brief A recorded trace event
+ */
+typedef struct TraceEvent {
+    /** @brief Name of the span, a string literal */
+    const char * name;
+    /** @brief Time of the event, nanoseconds of \p CLOCK_MONOTONIC */
+    long long timestamp;
+    /** @brief \p 'B' or \p 'E' */
+    char phase;
+} TraceEvent;
+
+/**
+ * @brief Ring buffer of the events of a thread
+ */
+typedef struct TraceRing {
+    /** @brief The events, the one at \p written is the oldest once the ring is full */
+    TraceEvent events[TRACE_RING_SIZE];
+    /** @brief Number of events ever recorded, only written by the owner thread */
+    unsigned long long written;
+    /** @brief Kernel ID of the owner thread */
+    long thread;
+    /** @brief Ring of the thread registered before this one */
+    struct TraceRing * next;
+} TraceRing;
+
+/** @brief Rings of every thread that has recorded an event, kept after the thread exits */
+static TraceRing * rings;
+
+/** @brief Ring of the calling thread, \p NULL before its first event */
+static __thread TraceRing * own_ring;
+
+/** @brief Registers the writer of the trace file once */
+static pthread_once_t flush_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Maps and registers the ring of the calling thread
+ * @return the ring, \p NULL if it cannot be mapped
+ */
+static TraceRing * createRing();
+
+/**
+ * @brief Registers \p writeTrace to run at exit
+ */
+static void registerFlush();
+
+/**
+ * Unmatched ends at the start of a ring, left by overwritten beginnings, are
+ * ignored by the trace viewers.
+ * @brief Writes the events of every thread to the trace file
+ */
+static void writeTrace();
+
+void traceEvent(const char * name, char phase) {
+    TraceRing * ring = own_ring;
+    if (ring == NULL && (ring = createRing()) == NULL)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long index = ring->written;
+    TraceEvent * event = &ring->events[index & (TRACE_RING_SIZE - 1)];
+    event->name = name;
+    event->timestamp = now.tv_sec * 1000000000LL + now.tv_nsec;
+    event->phase = phase;
+    __atomic_store_n(&ring->written, index + 1, __ATOMIC_RELEASE);
+}
+
+static TraceRing * createRing() {
+    pthread_once(&flush_once, registerFlush);
+    TraceRing * ring = mmap(NULL, sizeof(TraceRing), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return NULL;
+    ring->thread = syscall(SYS_gettid);
+    ring->written = 0;
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    own_ring = ring;
+    return ring;
+}
+
+static void registerFlush() {
+    atexit(writeTrace);
+}
+
+static void writeTrace() {
+    const char * path = getenv("SNEK_TRACE_FILE");
+    FILE * file = fopen(path != NULL ? path : TRACE_DEFAULT_FILE, "w");
+    if (file == NULL) {
+        perror("Couldn't write the trace file");
+        return;
+    }
+    long pid = (long) getpid();
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    bool first = true;
+    for (TraceRing * ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        unsigned long long written = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+        unsigned long long oldest = written > TRACE_RING_SIZE ? written - TRACE_RING_SIZE : 0;
+        fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %ld, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",", pid, ring->thread, ring->thread == pid ? "main" : "worker");
+        first = false;
+        for (unsigned long long i = oldest; i < written; i++) {
+            const TraceEvent * event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            // Chrome traces count in microseconds
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %lld.%03lld, \"pid\": %ld, \"tid\": %ld}",
+                    event->name, event->phase, event->timestamp / 1000, event->timestamp % 1000, pid, ring->thread);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0)
+        perror("Couldn't write the trace file");
+}
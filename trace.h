@@ -0,0 +1,43 @@
+//
+// Created by hexadec on 11/12/20.
+//
+
+#ifndef SNEK_TRACE_H
+#define SNEK_TRACE_H
+
+/*
+ * Trace points, compiled in with the SNEK_TRACE CMake option, and removed
+ * completely otherwise. Every thread records its events into its own ring
+ * buffer, which is written to a Chrome trace JSON file at exit. The file can
+ * be opened with chrome://tracing or https://ui.perfetto.dev.
+ */
+
+#ifdef SNEK_TRACE
+
+/**
+ * The first event of a thread maps its ring buffer, outside of the allocator
+ * layer, so tracing does not show up in the allocation counters. When the ring
+ * is full, the oldest events are overwritten. At exit, the events of every
+ * thread are written to the file named by the SNEK_TRACE_FILE environment
+ * variable, \p snek_trace.json by default.
+ * @brief Records a trace event of the calling thread
+ * @param name name of the span, has to be a string literal
+ * @param phase \p 'B' for the beginning of the span, \p 'E' for its end
+ */
+void traceEvent(const char * name, char phase);
+
+/** @brief Begins a span of the trace, ended by \p TRACE_END with the same name */
+#define TRACE_BEGIN(NAME) traceEvent((NAME), 'B')
+/** @brief Ends a span of the trace begun by \p TRACE_BEGIN */
+#define TRACE_END(NAME) traceEvent((NAME), 'E')
+
+#else
+
+/** @brief Tracing is not compiled in */
+#define TRACE_BEGIN(NAME) ((void) 0)
+/** @brief Tracing is not compiled in */
+#define TRACE_END(NAME) ((void) 0)
+
+#endif //SNEK_TRACE
+
+#endif //SNEK_TRACE_H